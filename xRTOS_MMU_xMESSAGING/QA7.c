@@ -332,12 +332,47 @@ bool ReadCoreMessage (uint32_t* msg,								// Pointer to read result
 	return false;													// Return failure	
 }
 
+/*==========================================================================}
+{					 CORE MAILBOX IRQ API ROUTINES							}
+{==========================================================================*/
+
+/*-[ CoreMailboxIrqSetup ]--------------------------------------------------}
+. Routes the core mailbox to the IRQ of the core rather than the FIQ. The
+. core IRQ handler must use CoreIrqSource to tell it from other IRQ's.
+. RETURN: TRUE if successful, FALSE for any failure
+.--------------------------------------------------------------------------*/
+bool CoreMailboxIrqSetup (uint8_t coreNum,							// Core number
+						  uint8_t mailbox)							// Mailbox
+{
+	if ((coreNum <= RPi_CoresReady) && (mailbox < 4))				// Check Core number and mailbox valid
+	{
+		QA7->CoreMailbox_Read_Clear[coreNum].boxNumber[mailbox] = 0xFFFFFFFF; // Make sure mailbox clear
+		QA7->CoreMailboxIntControl[coreNum].FIQ_Routing &= ~(1 << mailbox);// Make sure Route mailbox FIQ to given Core is zero
+		QA7->CoreMailboxIntControl[coreNum].IRQ_Routing |= (1 << mailbox);// Route mailbox IRQ to given Core
+		return true;												// Return success
+	}
+	return false;													// Return failure	
+}
+
+/*-[ CoreIrqSource ]--------------------------------------------------------}
+. Returns the pending IRQ sources of the core, see the QA7_IRQ_ bits.
+. RETURN: The core IRQ source register, 0 for an invalid core
+.--------------------------------------------------------------------------*/
+uint32_t CoreIrqSource (uint8_t coreNum)							// Core number
+{
+	if (coreNum <= RPi_CoresReady)									// Check Core number valid
+		return QA7->CoreIRQSource[coreNum].Raw32;					// Return the IRQ sources
+	return 0;														// Return no sources
+}
+
 /*==========================================================================}
 {					 CORE MAILBOX FIQ API ROUTINES							}
 {==========================================================================*/
 
 /*-[ CoreMailboxFiqSetup ]--------------------------------------------------}
 . Sets the core mailbox FIQ to call the given routine at the address.
+. Other mailboxes of the core already routed to the FIQ remain routed so
+. one handler can service several mailboxes of a core.
 . RETURN: TRUE if successful, FALSE for any failure
 .--------------------------------------------------------------------------*/
 bool CoreMailboxFiqSetup (void (*ARMaddress) (void),				// Address of FIQ handler
@@ -348,8 +383,8 @@ bool CoreMailboxFiqSetup (void (*ARMaddress) (void),				// Address of FIQ handle
 	{
 		setFiqFuncAddress(ARMaddress);								// Set the FIQ address
 		QA7->CoreMailbox_Read_Clear[coreNum].boxNumber[mailbox] = 0xFFFFFFFF; // Make sure mailbox clear
-		QA7->CoreMailboxIntControl[coreNum].FIQ_Routing = (1 << mailbox);// Route mailbox FIQ to given Core
-		QA7->CoreMailboxIntControl[coreNum].IRQ_Routing = 0;		// Make sure Route mailbox IRQ to given Core is zero
+		QA7->CoreMailboxIntControl[coreNum].FIQ_Routing |= (1 << mailbox);// Route mailbox FIQ to given Core
+		QA7->CoreMailboxIntControl[coreNum].IRQ_Routing &= ~(1 << mailbox);// Make sure Route mailbox IRQ to given Core is zero
 		return true;												// Return success
 	}
 	return false;													// Return failure	
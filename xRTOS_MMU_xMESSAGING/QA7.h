@@ -70,12 +70,37 @@ bool ReadCoreMessage (uint32_t* msg,								// Pointer to read result
 					  uint8_t coreNum,								// Core number
 					  uint8_t mailbox);								// Mailbox number of core
 
+/*==========================================================================}
+{					 CORE MAILBOX IRQ API ROUTINES							}
+{==========================================================================*/
+
+/* Core IRQ source bits as returned by CoreIrqSource */
+#define QA7_IRQ_CNTPNSIRQ		( 1 << 1 )							// Non-secure physical (EL0) timer interrupt
+#define QA7_IRQ_MAILBOX(n)		( 1 << (4 + (n)) )					// Mailbox 0..3 interrupt
+#define QA7_IRQ_GPU				( 1 << 8 )							// GPU peripheral interrupt, routed to core 0 by default
+
+/*-[ CoreMailboxIrqSetup ]--------------------------------------------------}
+. Routes the core mailbox to the IRQ of the core rather than the FIQ. The
+. core IRQ handler must use CoreIrqSource to tell it from other IRQ's.
+. RETURN: TRUE if successful, FALSE for any failure
+.--------------------------------------------------------------------------*/
+bool CoreMailboxIrqSetup (uint8_t coreNum,							// Core number
+						  uint8_t mailbox);							// Mailbox
+
+/*-[ CoreIrqSource ]--------------------------------------------------------}
+. Returns the pending IRQ sources of the core, see the QA7_IRQ_ bits.
+. RETURN: The core IRQ source register, 0 for an invalid core
+.--------------------------------------------------------------------------*/
+uint32_t CoreIrqSource (uint8_t coreNum);							// Core number
+
 /*==========================================================================}
 {					 CORE MAILBOX FIQ API ROUTINES							}
 {==========================================================================*/
 
 /*-[ CoreMailboxFiqSetup ]--------------------------------------------------}
 . Sets the core mailbox FIQ to call the given routine at the address.
+. Other mailboxes of the core already routed to the FIQ remain routed so
+. one handler can service several mailboxes of a core.
 . RETURN: TRUE if successful, FALSE for any failure
 .--------------------------------------------------------------------------*/
 bool CoreMailboxFiqSetup (void (*ARMaddress) (void),				// Address of FIQ handler
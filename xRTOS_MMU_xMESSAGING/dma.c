@@ -0,0 +1,555 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "slab.h"
+#include "dma.h"
+
+/* DMA channel CS register bits */
+#define DMA_CS_ACTIVE			( 1 << 0 )							// Channel is running, write 1 to start it
+#define DMA_CS_END				( 1 << 1 )							// Transfer complete, write 1 to clear
+#define DMA_CS_INT				( 1 << 2 )							// Interrupt raised, write 1 to clear
+#define DMA_CS_ERROR			( 1 << 8 )							// DEBUG register holds an error
+#define DMA_CS_PRIORITY(n)		( (n) << 16 )						// AXI priority of normal transfers
+#define DMA_CS_PANIC_PRIORITY(n) ( (n) << 20 )						// AXI priority of panic transfers
+#define DMA_CS_WAIT_WRITES		( 1 << 28 )							// Wait for outstanding writes before the end
+#define DMA_CS_ABORT			( 1 << 30 )							// Abort the current control block
+#define DMA_CS_RESET			( 1u << 31 )						// Reset the channel
+#define DMA_CS_KEEP				( DMA_CS_ACTIVE | DMA_CS_PRIORITY(0xF) | DMA_CS_PANIC_PRIORITY(0xF) | DMA_CS_WAIT_WRITES )
+
+/* DMA control block TI bits */
+#define DMA_TI_INTEN			( 1 << 0 )							// Interrupt when this block completes
+#define DMA_TI_TDMODE			( 1 << 1 )							// 2D mode, full channels only
+#define DMA_TI_WAIT_RESP		( 1 << 3 )							// Wait for each write to be acknowledged
+#define DMA_TI_DEST_INC			( 1 << 4 )							// Destination address increments
+#define DMA_TI_SRC_INC			( 1 << 8 )							// Source address increments
+#define DMA_TI_BURST(n)			( (n) << 12 )						// Burst length in words less one
+
+#define DMA_DEBUG_ERRORS		( 0x7 )								// Read, FIFO and read last errors, write 1 to clear
+#define DMA_MAX_LEN				( 0x3FFFFFFC )						// Largest full channel transfer in one block
+#define DMA_MAX_ROWS			( 0x4000 )							// 2D mode YLENGTH is 14 bits
+#define DMA_MAX_GAP				( 0x7FFF )							// 2D mode strides are signed 16 bits
+#define DMA_COPY_TI				( DMA_TI_WAIT_RESP | DMA_TI_BURST(3) )
+
+/* Channels 0..10 each have a GPU interrupt from 16 up, 11..14 share 27 */
+#define DMA_IRQ_BIT(n)			( ((n) < 11) ? (1u << (16 + (n))) : (1u << 27) )
+
+/* Transfer states of a channel */
+#define DMA_IDLE				( 0 )
+#define DMA_RUNNING				( 1 )
+#define DMA_COMPLETING			( 2 )
+
+/*--------------------------------------------------------------------------}
+;{               RASPBERRY PI DMA CHANNEL HARDWARE REGISTERS				}
+;{-------------------------------------------------------------------------*/
+struct __attribute__((__packed__, aligned(4))) DmaChannelRegisters {
+	uint32_t CS;													// 0x00   Control and status
+	uint32_t CONBLK_AD;												// 0x04   Control block bus address
+	const uint32_t TI;												// 0x08   ** Read only copy of control block
+	const uint32_t SOURCE_AD;										// 0x0C
+	const uint32_t DEST_AD;											// 0x10
+	const uint32_t TXFR_LEN;										// 0x14
+	const uint32_t STRIDE;											// 0x18
+	const uint32_t NEXTCONBK;										// 0x1C
+	uint32_t DEBUG;													// 0x20   Error bits, write 1 to clear
+	uint32_t reserved[55];											// 0x24-0xFF
+};
+
+#define DMA_CHANNEL(n)	((volatile __attribute__((aligned(4))) struct DmaChannelRegisters*)(uintptr_t)(RPi_IO_Base_Addr + 0x7000 + (n) * 0x100))
+#define DMA_INT_STATUS	(*(volatile __attribute__((aligned(4))) uint32_t*)(uintptr_t)(RPi_IO_Base_Addr + 0x7FE0))
+#define DMA_ENABLE		(*(volatile __attribute__((aligned(4))) uint32_t*)(uintptr_t)(RPi_IO_Base_Addr + 0x7FF0))
+#define IRQ_ENABLE1		(*(volatile __attribute__((aligned(4))) uint32_t*)(uintptr_t)(RPi_IO_Base_Addr + 0xB210))
+
+/*--------------------------------------------------------------------------}
+{						DMA CHANNEL STRUCTURE DEFINED						}
+{--------------------------------------------------------------------------*/
+static struct DmaChannel
+{
+	DmaControlBlock_t cb;										/*< Control block for single transfers */
+	DmaControlBlock_t* first;									/*< First control block of the transfer */
+	TaskHandle_t task;											/*< Task notified on completion */
+	uint32_t notifyBits;										/*< Bits set in its notification value */
+	volatile uint32_t state;									/*< DMA_IDLE, DMA_RUNNING or DMA_COMPLETING */
+	volatile uint32_t error;									/*< DEBUG error bits of the last transfer */
+} dmaChannel[DMA_CHANNELS] = { 0 };
+
+static volatile uint32_t dmaOwned = 0;								// Bit for each channel allocated
+static uintptr_t dmaVcBase = 0;										// ARM caches nothing from the VC split up
+static SlabCache_t cbCache = SLAB_CACHE_INIT("DMACB", sizeof(DmaControlBlock_t));	// Chain control blocks
+
+/*--------------------------------------------------------------------------}
+{			Bus address the engine uses for 1:1 mapped ARM memory			}
+{--------------------------------------------------------------------------*/
+static inline uint32_t BusAddress (const void* p)
+{
+	return ARMaddrToGPUaddr((uint32_t)(uintptr_t)p);
+}
+
+/*--------------------------------------------------------------------------}
+{	A range the engine can reach is in the 1:1 map below the IO block and	}
+{	is whole words, as QEMU moves a word at a time							}
+{--------------------------------------------------------------------------*/
+static bool RangeValid (const void* p, size_t size)
+{
+	uintptr_t start = (uintptr_t)p;
+	return ((start & 3) == 0) && (size != 0) && ((size & 3) == 0) &&
+		(start < RPi_IO_Base_Addr) && (size <= RPi_IO_Base_Addr - start);
+}
+
+/*--------------------------------------------------------------------------}
+{	Bytes a block reads or writes from its start address in either mode		}
+{--------------------------------------------------------------------------*/
+static size_t BlockSpan (uint32_t ti, uint32_t txfr_len, uint32_t gap)
+{
+	if ((ti & DMA_TI_TDMODE) == 0) return txfr_len;
+	size_t rows = (txfr_len >> 16) + 1;
+	size_t xlen = txfr_len & 0xFFFF;
+	return rows * (xlen + gap) - gap;
+}
+
+/*--------------------------------------------------------------------------}
+{	Does the cache maintenance on the part of the range below the VC split,	}
+{	before the start (flush false) or after the end (flush true) a range	}
+{	the engine writes is invalidated rather than flushed					}
+{--------------------------------------------------------------------------*/
+enum CacheOp { CACHE_CLEAN, CACHE_FLUSH, CACHE_INVALIDATE };
+static void CacheRange (uint32_t busAddr, size_t size, enum CacheOp op)
+{
+	uintptr_t start = GPUaddrToARMaddr(busAddr);
+	if (start >= dmaVcBase) return;									// GPU memory is not cached by the ARM
+	if (size > dmaVcBase - start) size = dmaVcBase - start;			// Only the part below the split
+	switch (op)
+	{
+		case CACHE_CLEAN:
+			cache_clean_range((void*)start, size);
+			break;
+		case CACHE_FLUSH:
+			cache_flush_range((void*)start, size);
+			break;
+		default:
+			cache_invalidate_range((void*)start, size);
+			break;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Walks the chain cleaning sources and blocks and flushing destinations	}
+{	before a start, or invalidating destinations once it is done, so lines	}
+{	the core fetched while the engine ran are not read stale				}
+{--------------------------------------------------------------------------*/
+static void ChainCache (DmaControlBlock_t* first, bool done)
+{
+	DmaControlBlock_t* cb = first;
+	while (cb)
+	{
+		size_t dstSpan = BlockSpan(cb->ti, cb->txfr_len, cb->stride >> 16);
+		DmaControlBlock_t* next = (cb->nextconbk) ? (DmaControlBlock_t*)(uintptr_t)GPUaddrToARMaddr(cb->nextconbk) : 0;
+		if (done) CacheRange(cb->dest_ad, dstSpan, CACHE_INVALIDATE);
+		else {
+			if (cb->ti & DMA_TI_SRC_INC)
+				CacheRange(cb->source_ad, BlockSpan(cb->ti, cb->txfr_len, cb->stride & 0xFFFF), CACHE_CLEAN);
+			CacheRange(cb->dest_ad, dstSpan, CACHE_FLUSH);
+			CacheRange(BusAddress(cb), sizeof(DmaControlBlock_t), CACHE_CLEAN);// Block and any fill pattern
+		}
+		cb = next;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{					Sets a control block to a linear copy					}
+{--------------------------------------------------------------------------*/
+static bool SetMemcpy (DmaControlBlock_t* cb, void* dst, const void* src, size_t size)
+{
+	if (!RangeValid(dst, size) || !RangeValid(src, size) || (size > DMA_MAX_LEN)) return false;
+	cb->ti = DMA_COPY_TI | DMA_TI_SRC_INC | DMA_TI_DEST_INC;
+	cb->source_ad = BusAddress(src);
+	cb->dest_ad = BusAddress(dst);
+	cb->txfr_len = size;
+	cb->stride = 0;
+	cb->nextconbk = 0;
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{	Checks a rectangle fits 2D mode and returns the gap after each row		}
+{--------------------------------------------------------------------------*/
+static bool RectValid (const void* p, uint32_t pitch, uint32_t widthBytes, uint32_t rows)
+{
+	if ((rows == 0) || (rows > DMA_MAX_ROWS) || (widthBytes > DMA_LITE_MAX_LEN) ||
+		(pitch < widthBytes) || (pitch - widthBytes > DMA_MAX_GAP) || (pitch & 3)) return false;
+	return RangeValid(p, (size_t)(rows - 1) * pitch + widthBytes);
+}
+
+/*--------------------------------------------------------------------------}
+{	Sets a control block to a rectangle fill, the source is the pattern		}
+{	word in the block itself which is read again for every word written		}
+{--------------------------------------------------------------------------*/
+static bool SetFillRect (DmaControlBlock_t* cb, void* dst, uint32_t pitch,
+						 uint32_t widthBytes, uint32_t rows, uint32_t pattern)
+{
+	if (!RectValid(dst, pitch, widthBytes, rows)) return false;
+	cb->ti = DMA_COPY_TI | DMA_TI_DEST_INC | DMA_TI_TDMODE;
+	cb->pattern = pattern;
+	cb->source_ad = BusAddress(&cb->pattern);
+	cb->dest_ad = BusAddress(dst);
+	cb->txfr_len = ((rows - 1) << 16) | widthBytes;
+	cb->stride = (pitch - widthBytes) << 16;
+	cb->nextconbk = 0;
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{					Sets a control block to a rectangle copy				}
+{--------------------------------------------------------------------------*/
+static bool SetCopyRect (DmaControlBlock_t* cb, void* dst, uint32_t dstPitch,
+						 const void* src, uint32_t srcPitch, uint32_t widthBytes, uint32_t rows)
+{
+	if (!RectValid(dst, dstPitch, widthBytes, rows) ||
+		!RectValid(src, srcPitch, widthBytes, rows)) return false;
+	cb->ti = DMA_COPY_TI | DMA_TI_SRC_INC | DMA_TI_DEST_INC | DMA_TI_TDMODE;
+	cb->source_ad = BusAddress(src);
+	cb->dest_ad = BusAddress(dst);
+	cb->txfr_len = ((rows - 1) << 16) | widthBytes;
+	cb->stride = ((dstPitch - widthBytes) << 16) | (srcPitch - widthBytes);
+	cb->nextconbk = 0;
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{		Takes a block from the cache, linking it after prev if not NULL		}
+{--------------------------------------------------------------------------*/
+static DmaControlBlock_t* ChainLink (DmaControlBlock_t* prev, DmaControlBlock_t* cb, bool valid)
+{
+	if (cb == 0) return 0;											// Cache is out of memory
+	if (!valid)
+	{
+		vSlabFree(&cbCache, cb);									// Invalid transfer so give it back
+		return 0;
+	}
+	if (prev) prev->nextconbk = BusAddress(cb);						// Link it on the chain
+	return cb;
+}
+
+/*--------------------------------------------------------------------------}
+{		Clears the interrupt and end flags without pausing the channel		}
+{--------------------------------------------------------------------------*/
+static void ChannelAck (volatile struct DmaChannelRegisters* dma)
+{
+	dma->CS = (dma->CS & DMA_CS_KEEP) | DMA_CS_INT | DMA_CS_END;
+}
+
+/*--------------------------------------------------------------------------}
+{	Completes the transfer on the channel once, whether the IRQ or dma_wait	}
+{	gets here first. Before the scheduler only core 0 runs so no atomics	}
+{	are used, which matters as exclusives need the MMU on.					}
+{--------------------------------------------------------------------------*/
+static void ChannelComplete (int channel)
+{
+	struct DmaChannel* c = &dmaChannel[channel];
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+	{
+		if (c->state != DMA_RUNNING) return;
+		c->state = DMA_COMPLETING;
+	}
+	else {
+		uint32_t expected = DMA_RUNNING;
+		if (!__atomic_compare_exchange_n(&c->state, &expected, DMA_COMPLETING,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;		// Other side has it
+	}
+	volatile struct DmaChannelRegisters* dma = DMA_CHANNEL(channel);
+	uint32_t error = dma->DEBUG & DMA_DEBUG_ERRORS;
+	if (error || (dma->CS & DMA_CS_ERROR))							// Engine stopped on an error
+	{
+		dma->DEBUG = error;											// Clear the error bits
+		dma->CS = DMA_CS_RESET;										// Reset the channel for next use
+		error |= DMA_CS_ERROR;
+	}
+	c->error = error;
+	ChainCache(c->first, true);										// Invalidate what it wrote
+	TaskHandle_t task = c->task;
+	uint32_t bits = c->notifyBits;
+	__atomic_store_n(&c->state, DMA_IDLE, __ATOMIC_RELEASE);		// Channel can be used again
+	if (task) xTaskNotify(task, bits, eSetBits);					// Tell the task it is done
+}
+
+/*--------------------------------------------------------------------------}
+{	The GPU interrupt handler, every DMA completion interrupt comes here	}
+{--------------------------------------------------------------------------*/
+static void DmaIrqHandler (void)
+{
+	uint32_t status = DMA_INT_STATUS & DMA_CHANNEL_MASK & ((1 << DMA_CHANNELS) - 1);
+	while (status)
+	{
+		int channel = __builtin_ctz(status);						// Lowest channel interrupting
+		status &= status - 1;
+		ChannelAck(DMA_CHANNEL(channel));							// Clear its interrupt
+		ChannelComplete(channel);									// Finish the transfer
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Starts a chain on a channel the caller owns. Only the last block		}
+{	interrupts, and lite channels are checked for blocks they can not do.	}
+{--------------------------------------------------------------------------*/
+static bool ChannelStart (int channel, DmaControlBlock_t* first, uint32_t notifyBits)
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS) || (first == 0) ||
+		((dmaOwned & (1u << channel)) == 0)) return false;			// Invalid or not allocated channel
+	struct DmaChannel* c = &dmaChannel[channel];
+	if (c->state != DMA_IDLE) return false;							// Channel is busy
+	DmaControlBlock_t* last = 0;
+	for (DmaControlBlock_t* cb = first; cb; cb = (cb->nextconbk) ?
+		(DmaControlBlock_t*)(uintptr_t)GPUaddrToARMaddr(cb->nextconbk) : 0)
+	{
+		if ((channel >= DMA_FULL_CHANNELS) &&
+			((cb->ti & DMA_TI_TDMODE) || (cb->txfr_len > DMA_LITE_MAX_LEN)))
+			return false;											// Lite channel can not do this block
+		cb->ti &= ~DMA_TI_INTEN;
+		last = cb;
+	}
+	last->ti |= DMA_TI_INTEN;										// Interrupt at the end of the chain
+	c->first = first;
+	c->notifyBits = notifyBits;
+	c->task = (notifyBits) ? xTaskGetCurrentTaskHandle() : 0;
+	c->error = 0;
+	c->state = DMA_RUNNING;
+	ChainCache(first, false);										// Memory is coherent for the engine, ends with dsb
+	volatile struct DmaChannelRegisters* dma = DMA_CHANNEL(channel);
+	dma->CONBLK_AD = BusAddress(first);								// First block to load
+	dma->CS = DMA_CS_WAIT_WRITES | DMA_CS_PANIC_PRIORITY(15) | DMA_CS_PRIORITY(8) | DMA_CS_ACTIVE;
+	return true;
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ dma_init ]-------------------------------------------------------------}
+.  Resets and enables every channel in DMA_CHANNEL_MASK, enables their
+.  completion interrupts and installs the GPU interrupt handler. The GPU
+.  interrupt goes to core 0 so its scheduler must run for completions to be
+.  seen, except through dma_wait. Call it after xRTOS_Init and before
+.  xTaskStartScheduler as it reads the VC memory split with the mailbox.
+.  RETURN: true for success, false if the VC split could not be read
+.--------------------------------------------------------------------------*/
+bool dma_init (void)
+{
+	uint32_t msg[5] = { 0 };
+	if (!mailbox_tag_message(&msg[0], 5, MAILBOX_TAG_GET_VC_MEMORY, 8, 8, 0, 0))
+		return false;												// msg[3] has VC base addr msg[4] = VC memory size
+	uint32_t mask = DMA_CHANNEL_MASK & ((1 << DMA_CHANNELS) - 1);
+	uint32_t irqs = 0;
+	DMA_ENABLE |= mask;												// Enable the channels
+	for (int i = 0; i < DMA_CHANNELS; i++)
+	{
+		if ((mask & (1u << i)) == 0) continue;						// Channel belongs to the firmware
+		volatile struct DmaChannelRegisters* dma = DMA_CHANNEL(i);
+		dma->CS = DMA_CS_RESET;										// Reset the channel
+		dma->DEBUG = DMA_DEBUG_ERRORS;								// Clear any old errors
+		dma->CS = DMA_CS_INT | DMA_CS_END;							// Clear any old interrupt
+		irqs |= DMA_IRQ_BIT(i);
+	}
+	dmaVcBase = msg[3];
+	xTaskSetGpuIrqHandler(DmaIrqHandler);							// Completions come in on the GPU interrupt
+	IRQ_ENABLE1 = irqs;												// Writing 1 enables, 0 leaves as is
+	return true;
+}
+
+/*-[ dma_channel_alloc ]----------------------------------------------------}
+.  Takes a free channel for the caller to own, a full channel if fullOnly
+.  is set as only they can do the rectangle calls, any channel otherwise.
+.  RETURN: Channel number, -1 if none is free
+.--------------------------------------------------------------------------*/
+int dma_channel_alloc (bool fullOnly)
+{
+	uint32_t usable = DMA_CHANNEL_MASK & ((1 << DMA_CHANNELS) - 1);
+	if (fullOnly) usable &= (1 << DMA_FULL_CHANNELS) - 1;
+	if (dmaVcBase == 0) return -1;									// dma_init has not run
+	uint32_t owned = dmaOwned;
+	for (;;)
+	{
+		uint32_t free = usable & ~owned;
+		if (free == 0) return -1;									// No channel free
+		int channel = 31 - __builtin_clz(free);						// Highest so lite channels go first
+		if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+		{
+			dmaOwned = owned | (1u << channel);
+			return channel;
+		}
+		if (__atomic_compare_exchange_n(&dmaOwned, &owned, owned | (1u << channel),
+			false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return channel;
+	}
+}
+
+/*-[ dma_channel_free ]-----------------------------------------------------}
+.  Gives back a channel from dma_channel_alloc, it must not be busy.
+.  RETURN: true for success, false for an invalid, free or busy channel
+.--------------------------------------------------------------------------*/
+bool dma_channel_free (int channel)
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS) ||
+		((dmaOwned & (1u << channel)) == 0) ||
+		(dmaChannel[channel].state != DMA_IDLE)) return false;		// Invalid, free or busy channel
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+		dmaOwned &= ~(1u << channel);
+		else __atomic_fetch_and(&dmaOwned, ~(1u << channel), __ATOMIC_RELEASE);
+	return true;
+}
+
+/*-[ dma_memcpy ]-----------------------------------------------------------}
+.  Starts a copy of size bytes on the channel and returns without waiting.
+.  The buffers must be in 1:1 mapped memory and size a multiple of 4 bytes,
+.  at most DMA_LITE_MAX_LEN on a lite channel. The caches are cleaned and
+.  flushed here and the destination invalidated on completion, when the
+.  calling task is notified with eSetBits of notifyBits. With notifyBits 0
+.  no task is notified, use dma_wait.
+.  RETURN: true if started, false for a busy channel or invalid transfer
+.--------------------------------------------------------------------------*/
+bool dma_memcpy (int channel,										// Channel from dma_channel_alloc
+				 void* dst,											// Destination address
+				 const void* src,									// Source address
+				 size_t size,										// Bytes to copy, multiple of 4
+				 uint32_t notifyBits)								// Notification bits set on completion
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS) ||
+		(dmaChannel[channel].state != DMA_IDLE)) return false;		// Invalid or busy channel
+	DmaControlBlock_t* cb = &dmaChannel[channel].cb;
+	if (!SetMemcpy(cb, dst, src, size)) return false;				// Invalid transfer
+	return ChannelStart(channel, cb, notifyBits);
+}
+
+/*-[ dma_fill_rect ]--------------------------------------------------------}
+.  Starts a fill of rows rows of widthBytes bytes, pitch bytes apart, with
+.  the 32 bit pattern on a full channel. For 16 bit pixels repeat the colour
+.  in both halves of the pattern. widthBytes and pitch must be multiples of
+.  4. Completion is as dma_memcpy.
+.  RETURN: true if started, false for a busy channel or invalid rectangle
+.--------------------------------------------------------------------------*/
+bool dma_fill_rect (int channel,									// Full channel from dma_channel_alloc
+					void* dst,										// Top left of rectangle
+					uint32_t pitch,									// Bytes between rows
+					uint32_t widthBytes,							// Bytes in each row, multiple of 4
+					uint32_t rows,									// Number of rows
+					uint32_t pattern,								// 32 bit pattern written
+					uint32_t notifyBits)							// Notification bits set on completion
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS) ||
+		(dmaChannel[channel].state != DMA_IDLE)) return false;		// Invalid or busy channel
+	DmaControlBlock_t* cb = &dmaChannel[channel].cb;
+	if (!SetFillRect(cb, dst, pitch, widthBytes, rows, pattern)) return false;
+	return ChannelStart(channel, cb, notifyBits);
+}
+
+/*-[ dma_copy_rect ]--------------------------------------------------------}
+.  Starts a copy of rows rows of widthBytes bytes on a full channel from
+.  src with srcPitch bytes between rows to dst with dstPitch bytes between
+.  rows. Completion is as dma_memcpy.
+.  RETURN: true if started, false for a busy channel or invalid rectangle
+.--------------------------------------------------------------------------*/
+bool dma_copy_rect (int channel,									// Full channel from dma_channel_alloc
+					void* dst,										// Destination top left
+					uint32_t dstPitch,								// Destination bytes between rows
+					const void* src,								// Source top left
+					uint32_t srcPitch,								// Source bytes between rows
+					uint32_t widthBytes,							// Bytes in each row, multiple of 4
+					uint32_t rows,									// Number of rows
+					uint32_t notifyBits)							// Notification bits set on completion
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS) ||
+		(dmaChannel[channel].state != DMA_IDLE)) return false;		// Invalid or busy channel
+	DmaControlBlock_t* cb = &dmaChannel[channel].cb;
+	if (!SetCopyRect(cb, dst, dstPitch, src, srcPitch, widthBytes, rows)) return false;
+	return ChannelStart(channel, cb, notifyBits);
+}
+
+/*-[ dma_cb_memcpy ]--------------------------------------------------------}
+.  Takes a control block from the DMA slab cache, sets it to copy size
+.  bytes and links it after prev, unless prev is NULL for a new chain.
+.  RETURN: The control block, NULL for no memory or invalid transfer
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_memcpy (DmaControlBlock_t* prev, void* dst, const void* src, size_t size)
+{
+	DmaControlBlock_t* cb = pvSlabAlloc(&cbCache);
+	return ChainLink(prev, cb, cb && SetMemcpy(cb, dst, src, size));
+}
+
+/*-[ dma_cb_fill_rect ]-----------------------------------------------------}
+.  As dma_cb_memcpy for a block that fills a rectangle like dma_fill_rect.
+.  RETURN: The control block, NULL for no memory or invalid rectangle
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_fill_rect (DmaControlBlock_t* prev, void* dst, uint32_t pitch,
+									 uint32_t widthBytes, uint32_t rows, uint32_t pattern)
+{
+	DmaControlBlock_t* cb = pvSlabAlloc(&cbCache);
+	return ChainLink(prev, cb, cb && SetFillRect(cb, dst, pitch, widthBytes, rows, pattern));
+}
+
+/*-[ dma_cb_copy_rect ]-----------------------------------------------------}
+.  As dma_cb_memcpy for a block that copies a rectangle like dma_copy_rect.
+.  RETURN: The control block, NULL for no memory or invalid rectangle
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_copy_rect (DmaControlBlock_t* prev, void* dst, uint32_t dstPitch,
+									 const void* src, uint32_t srcPitch, uint32_t widthBytes, uint32_t rows)
+{
+	DmaControlBlock_t* cb = pvSlabAlloc(&cbCache);
+	return ChainLink(prev, cb, cb && SetCopyRect(cb, dst, dstPitch, src, srcPitch, widthBytes, rows));
+}
+
+/*-[ dma_chain_start ]------------------------------------------------------}
+.  Starts the chain from first on the channel, which runs every block in
+.  one go. A chain with rectangle blocks needs a full channel and one on a
+.  lite channel must keep each block to DMA_LITE_MAX_LEN bytes. Completion
+.  is as dma_memcpy and the chain must not be changed or freed until then.
+.  RETURN: true if started, false for a busy channel or invalid chain
+.--------------------------------------------------------------------------*/
+bool dma_chain_start (int channel, DmaControlBlock_t* first, uint32_t notifyBits)
+{
+	return ChannelStart(channel, first, notifyBits);
+}
+
+/*-[ dma_chain_free ]-------------------------------------------------------}
+.  Gives every control block in the chain from first back to the cache.
+.--------------------------------------------------------------------------*/
+void dma_chain_free (DmaControlBlock_t* first)
+{
+	while (first)
+	{
+		DmaControlBlock_t* next = (first->nextconbk) ?
+			(DmaControlBlock_t*)(uintptr_t)GPUaddrToARMaddr(first->nextconbk) : 0;
+		vSlabFree(&cbCache, first);
+		first = next;
+	}
+}
+
+/*-[ dma_busy ]-------------------------------------------------------------}
+.  RETURN: true while a transfer started on the channel is not complete
+.--------------------------------------------------------------------------*/
+bool dma_busy (int channel)
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS)) return false;
+	return (__atomic_load_n(&dmaChannel[channel].state, __ATOMIC_ACQUIRE) != DMA_IDLE);
+}
+
+/*-[ dma_wait ]-------------------------------------------------------------}
+.  Spins until the transfer on the channel completes, finishing it here if
+.  the interrupt has not. For short transfers or before the scheduler runs,
+.  a task waiting on a long one should use its notification instead.
+.  RETURN: true if the last transfer completed without error
+.--------------------------------------------------------------------------*/
+bool dma_wait (int channel)
+{
+	if ((channel < 0) || (channel >= DMA_CHANNELS)) return false;
+	volatile struct DmaChannelRegisters* dma = DMA_CHANNEL(channel);
+	while (dma_busy(channel))
+	{
+		uint32_t cs = dma->CS;
+		if ((cs & DMA_CS_ERROR) || ((cs & DMA_CS_ACTIVE) == 0))		// Engine has stopped
+		{
+			if ((cs & DMA_CS_ERROR) == 0) ChannelAck(dma);			// Clear the interrupt we will not need
+			ChannelComplete(channel);
+		}
+	}
+	return (dmaChannel[channel].error == 0);
+}
@@ -0,0 +1,160 @@
+#ifndef _DMA_H
+#define _DMA_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stdbool.h>							// Needed for bool
+#include <stddef.h>								// Needed for size_t
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+#include "task.h"								// Needed for TaskHandle_t
+
+#define DMA_CHANNELS		15					// Channels 0..14, channel 15 is in the VC block
+#define DMA_FULL_CHANNELS	7					// Channels 0..6 are full channels with 2D mode
+#define DMA_LITE_MAX_LEN	0xFFFC				// Largest transfer a lite channel (7..14) can do in one block
+
+/* Channels the firmware leaves free for the ARM, as given to Linux */
+#ifndef DMA_CHANNEL_MASK
+	#define DMA_CHANNEL_MASK	0x7F35
+#endif
+
+/*--------------------------------------------------------------------------}
+{					   DMA CONTROL BLOCK STRUCTURE DEFINED					}
+{---------------------------------------------------------------------------}
+.  The engine reads its work from a chain of these, each one a transfer, in
+.  memory it fetches by bus address so they must be 32 byte aligned. Build a
+.  chain with the dma_cb_ calls rather than filling them in directly.
+.--------------------------------------------------------------------------*/
+typedef struct DmaControlBlock
+{
+	uint32_t ti;													// Transfer information
+	uint32_t source_ad;												// Source bus address
+	uint32_t dest_ad;												// Destination bus address
+	uint32_t txfr_len;												// Length in bytes, or rows and row bytes in 2D mode
+	uint32_t stride;												// 2D mode destination and source gap after each row
+	uint32_t nextconbk;												// Bus address of next control block, 0 ends the chain
+	uint32_t pattern;												// Source word of a fill, the engine skips the last two words
+	uint32_t reserved;												// Must be zero
+} __attribute__((aligned(32))) DmaControlBlock_t;
+
+/*-[ dma_init ]-------------------------------------------------------------}
+.  Resets and enables every channel in DMA_CHANNEL_MASK, enables their
+.  completion interrupts and installs the GPU interrupt handler. The GPU
+.  interrupt goes to core 0 so its scheduler must run for completions to be
+.  seen, except through dma_wait. Call it after xRTOS_Init and before
+.  xTaskStartScheduler as it reads the VC memory split with the mailbox.
+.  RETURN: true for success, false if the VC split could not be read
+.--------------------------------------------------------------------------*/
+bool dma_init (void);
+
+/*-[ dma_channel_alloc ]----------------------------------------------------}
+.  Takes a free channel for the caller to own, a full channel if fullOnly
+.  is set as only they can do the rectangle calls, any channel otherwise.
+.  RETURN: Channel number, -1 if none is free
+.--------------------------------------------------------------------------*/
+int dma_channel_alloc (bool fullOnly);
+
+/*-[ dma_channel_free ]-----------------------------------------------------}
+.  Gives back a channel from dma_channel_alloc, it must not be busy.
+.  RETURN: true for success, false for an invalid, free or busy channel
+.--------------------------------------------------------------------------*/
+bool dma_channel_free (int channel);
+
+/*-[ dma_memcpy ]-----------------------------------------------------------}
+.  Starts a copy of size bytes on the channel and returns without waiting.
+.  The buffers must be in 1:1 mapped memory and size a multiple of 4 bytes,
+.  at most DMA_LITE_MAX_LEN on a lite channel. The caches are cleaned and
+.  flushed here and the destination invalidated on completion, when the
+.  calling task is notified with eSetBits of notifyBits. With notifyBits 0
+.  no task is notified, use dma_wait.
+.  RETURN: true if started, false for a busy channel or invalid transfer
+.--------------------------------------------------------------------------*/
+bool dma_memcpy (int channel,										// Channel from dma_channel_alloc
+				 void* dst,											// Destination address
+				 const void* src,									// Source address
+				 size_t size,										// Bytes to copy, multiple of 4
+				 uint32_t notifyBits);								// Notification bits set on completion
+
+/*-[ dma_fill_rect ]--------------------------------------------------------}
+.  Starts a fill of rows rows of widthBytes bytes, pitch bytes apart, with
+.  the 32 bit pattern on a full channel. For 16 bit pixels repeat the colour
+.  in both halves of the pattern. widthBytes and pitch must be multiples of
+.  4. Completion is as dma_memcpy.
+.  RETURN: true if started, false for a busy channel or invalid rectangle
+.--------------------------------------------------------------------------*/
+bool dma_fill_rect (int channel,									// Full channel from dma_channel_alloc
+					void* dst,										// Top left of rectangle
+					uint32_t pitch,									// Bytes between rows
+					uint32_t widthBytes,							// Bytes in each row, multiple of 4
+					uint32_t rows,									// Number of rows
+					uint32_t pattern,								// 32 bit pattern written
+					uint32_t notifyBits);							// Notification bits set on completion
+
+/*-[ dma_copy_rect ]--------------------------------------------------------}
+.  Starts a copy of rows rows of widthBytes bytes on a full channel from
+.  src with srcPitch bytes between rows to dst with dstPitch bytes between
+.  rows. Completion is as dma_memcpy.
+.  RETURN: true if started, false for a busy channel or invalid rectangle
+.--------------------------------------------------------------------------*/
+bool dma_copy_rect (int channel,									// Full channel from dma_channel_alloc
+					void* dst,										// Destination top left
+					uint32_t dstPitch,								// Destination bytes between rows
+					const void* src,								// Source top left
+					uint32_t srcPitch,								// Source bytes between rows
+					uint32_t widthBytes,							// Bytes in each row, multiple of 4
+					uint32_t rows,									// Number of rows
+					uint32_t notifyBits);							// Notification bits set on completion
+
+/*-[ dma_cb_memcpy ]--------------------------------------------------------}
+.  Takes a control block from the DMA slab cache, sets it to copy size
+.  bytes and links it after prev, unless prev is NULL for a new chain.
+.  RETURN: The control block, NULL for no memory or invalid transfer
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_memcpy (DmaControlBlock_t* prev, void* dst, const void* src, size_t size);
+
+/*-[ dma_cb_fill_rect ]-----------------------------------------------------}
+.  As dma_cb_memcpy for a block that fills a rectangle like dma_fill_rect.
+.  RETURN: The control block, NULL for no memory or invalid rectangle
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_fill_rect (DmaControlBlock_t* prev, void* dst, uint32_t pitch,
+									 uint32_t widthBytes, uint32_t rows, uint32_t pattern);
+
+/*-[ dma_cb_copy_rect ]-----------------------------------------------------}
+.  As dma_cb_memcpy for a block that copies a rectangle like dma_copy_rect.
+.  RETURN: The control block, NULL for no memory or invalid rectangle
+.--------------------------------------------------------------------------*/
+DmaControlBlock_t* dma_cb_copy_rect (DmaControlBlock_t* prev, void* dst, uint32_t dstPitch,
+									 const void* src, uint32_t srcPitch, uint32_t widthBytes, uint32_t rows);
+
+/*-[ dma_chain_start ]------------------------------------------------------}
+.  Starts the chain from first on the channel, which runs every block in
+.  one go. A chain with rectangle blocks needs a full channel and one on a
+.  lite channel must keep each block to DMA_LITE_MAX_LEN bytes. Completion
+.  is as dma_memcpy and the chain must not be changed or freed until then.
+.  RETURN: true if started, false for a busy channel or invalid chain
+.--------------------------------------------------------------------------*/
+bool dma_chain_start (int channel, DmaControlBlock_t* first, uint32_t notifyBits);
+
+/*-[ dma_chain_free ]-------------------------------------------------------}
+.  Gives every control block in the chain from first back to the cache.
+.--------------------------------------------------------------------------*/
+void dma_chain_free (DmaControlBlock_t* first);
+
+/*-[ dma_busy ]-------------------------------------------------------------}
+.  RETURN: true while a transfer started on the channel is not complete
+.--------------------------------------------------------------------------*/
+bool dma_busy (int channel);
+
+/*-[ dma_wait ]-------------------------------------------------------------}
+.  Spins until the transfer on the channel completes, finishing it here if
+.  the interrupt has not. For short transfers or before the scheduler runs,
+.  a task waiting on a long one should use its notification instead.
+.  RETURN: true if the last transfer completed without error
+.--------------------------------------------------------------------------*/
+bool dma_wait (int channel);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "governor.h"
+
+/* The name allocated to the governor task */
+#ifndef configGOVERNOR_TASK_NAME
+	#define configGOVERNOR_TASK_NAME "GOV"
+#endif
+
+/*--------------------------------------------------------------------------}
+{					   GOVERNOR STATE STRUCTURE DEFINED						}
+{--------------------------------------------------------------------------*/
+static struct Governor
+{
+	uint32_t minClock;											/*< Firmware minimum ARM clock in Hz */
+	uint32_t maxClock;											/*< Firmware maximum ARM clock in Hz */
+	uint32_t capClock;											/*< Highest clock allowed by temperature in Hz */
+	volatile uint32_t clock;									/*< ARM clock last set in Hz */
+	volatile uint32_t temperature;								/*< SoC temperature last read in 1/1000 C */
+	unsigned int lowPeriods;									/*< Consecutive periods load has been low */
+	bool packed;												/*< Best effort tasks are packed on one core */
+	TaskHandle_t task;											/*< Governor task */
+} gov = { 0 };
+
+/*--------------------------------------------------------------------------}
+{		  Sets the ARM clock if it changed and holds what was set			}
+{--------------------------------------------------------------------------*/
+static void GovernorSetClock (uint32_t rate)
+{
+	if (rate < gov.minClock) rate = gov.minClock;					// Never below firmware min
+	if (rate > gov.capClock) rate = gov.capClock;					// Never above thermal cap
+	if (rate != gov.clock)											// Only talk to firmware on a change
+	{
+		uint32_t set = ARM_setclockrate(rate);						// Set the ARM clock
+		if (set) gov.clock = set;									// Hold what firmware actually set
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	The governor task. The SoC temperature sets a cap on the clock that is	}
+{	stepped down while above the limit and only lifted again once below		}
+{	the limit less the hysteresis, so we back off before the firmware		}
+{	throttles hard. Before the cap is reached the best effort tasks are		}
+{	packed on to one core so the other cores idle in WFI and cool down.		}
+{	Within the cap a busy core takes the clock straight to the cap and low	}
+{	load steps it down only after several low periods. The temperature		}
+{	and clock calls go through the static 1:1 mapped tag message buffer,	}
+{	as this task's stack is in the TTBR1 stack region.						}
+{--------------------------------------------------------------------------*/
+static void prvGovernorTask (void* pvParameters)
+{
+	(void)pvParameters;
+	for (;;)
+	{
+		xTaskDelay(configGOVERNOR_PERIOD);							// Wait for next governor period
+
+		/* Thermal cap */
+		uint32_t temp = SOC_gettemperature(MAILBOX_TAG_GET_TEMPERATURE);
+		if (temp)
+		{
+			gov.temperature = temp;									// Hold last temperature
+			if (temp >= configGOVERNOR_TEMP_LIMIT)					// Too hot so lower the cap
+			{
+				if (gov.capClock >= gov.minClock + configGOVERNOR_STEP_HZ)
+					gov.capClock -= configGOVERNOR_STEP_HZ;
+					else gov.capClock = gov.minClock;
+			}
+			else if (temp < configGOVERNOR_TEMP_LIMIT - configGOVERNOR_TEMP_HYSTERESIS)
+				gov.capClock = gov.maxClock;						// Cool enough to lift the cap
+#if (configUSE_THERMAL_PLACEMENT == 1)
+			if ((temp >= configPLACEMENT_TEMP_LIMIT) && !gov.packed)	// Getting hot so concentrate the load
+			{
+				xTaskPackBestEffort(configPLACEMENT_CORE);			// Best effort tasks onto one core
+				gov.packed = true;
+			}
+			else if (gov.packed && (temp < configPLACEMENT_TEMP_LIMIT - configGOVERNOR_TEMP_HYSTERESIS))
+			{
+				xTaskUnpackBestEffort();							// Cool again so spread them back
+				gov.packed = false;
+			}
+#endif
+		}
+
+		/* Load on the busiest core */
+		unsigned int load = 0;
+		for (int i = 0; i < MAX_CPU_CORES; i++)
+		{
+			unsigned int coreLoad = xLoadPercentCore(i);
+			if (coreLoad > load) load = coreLoad;
+		}
+
+		if (load >= configGOVERNOR_LOAD_UP)							// Busy so go straight to the top
+		{
+			gov.lowPeriods = 0;
+			GovernorSetClock(gov.capClock);
+		}
+		else if (load <= configGOVERNOR_LOAD_DOWN)					// Quiet so step down slowly
+		{
+			if (++gov.lowPeriods >= configGOVERNOR_DOWN_PERIODS)
+			{
+				gov.lowPeriods = 0;
+				GovernorSetClock((gov.clock > configGOVERNOR_STEP_HZ) ?
+					gov.clock - configGOVERNOR_STEP_HZ : gov.minClock);
+			}
+		}
+		else {														// Between thresholds hold clock
+			gov.lowPeriods = 0;
+			if (gov.clock > gov.capClock) GovernorSetClock(gov.capClock);// But always obey the thermal cap
+		}
+	}
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ xGovernorStart ]-------------------------------------------------------}
+.  Creates the ARM clock governor task on the given core. Each governor
+.  period it reads the load of every core and the SoC temperature through
+.  the mailbox property interface and scales the ARM clock between the
+.  firmware min and max. It must be called before xTaskStartScheduler.
+.  RETURN: true for success, false for invalid core or no task available
+.--------------------------------------------------------------------------*/
+bool xGovernorStart (uint8_t corenum)
+{
+	if ((corenum >= MAX_CPU_CORES) || gov.task) return false;		// Invalid core or already started
+	gov.minClock = ARM_getclockrate(MAILBOX_TAG_GET_MIN_CLOCK_RATE);// Firmware min ARM clock
+	gov.maxClock = ARM_getclockrate(MAILBOX_TAG_GET_MAX_CLOCK_RATE);// Firmware max ARM clock
+	gov.clock = ARM_getclockrate(MAILBOX_TAG_GET_CLOCK_RATE);		// Current ARM clock
+	if ((gov.minClock == 0) || (gov.maxClock < gov.minClock))
+		return false;												// Firmware did not give us usable rates
+	gov.capClock = gov.maxClock;									// No thermal cap yet
+	gov.temperature = SOC_gettemperature(MAILBOX_TAG_GET_TEMPERATURE);
+	xTaskCreate(corenum, prvGovernorTask, configGOVERNOR_TASK_NAME,
+		configMINIMAL_STACK_SIZE * 2, 0, tskIDLE_PRIORITY + 1, &gov.task);
+	return (gov.task != 0);
+}
+
+/*-[ xGovernorGetClock ]----------------------------------------------------}
+.  RETURN: The ARM clock rate in Hz last set by the governor
+.--------------------------------------------------------------------------*/
+uint32_t xGovernorGetClock (void)
+{
+	return gov.clock;
+}
+
+/*-[ xGovernorGetTemperature ]----------------------------------------------}
+.  RETURN: The SoC temperature in 1/1000 C last read by the governor
+.--------------------------------------------------------------------------*/
+uint32_t xGovernorGetTemperature (void)
+{
+	return gov.temperature;
+}
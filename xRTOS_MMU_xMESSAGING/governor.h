@@ -0,0 +1,33 @@
+#ifndef _GOVERNOR_H
+#define _GOVERNOR_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stdbool.h>							// Needed for bool
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+
+/*-[ xGovernorStart ]-------------------------------------------------------}
+.  Creates the ARM clock governor task on the given core. Each governor
+.  period it reads the load of every core and the SoC temperature through
+.  the mailbox property interface and scales the ARM clock between the
+.  firmware min and max. It must be called before xTaskStartScheduler.
+.  RETURN: true for success, false for invalid core or no task available
+.--------------------------------------------------------------------------*/
+bool xGovernorStart (uint8_t corenum);
+
+/*-[ xGovernorGetClock ]----------------------------------------------------}
+.  RETURN: The ARM clock rate in Hz last set by the governor
+.--------------------------------------------------------------------------*/
+uint32_t xGovernorGetClock (void);
+
+/*-[ xGovernorGetTemperature ]----------------------------------------------}
+.  RETURN: The SoC temperature in 1/1000 C last read by the governor
+.--------------------------------------------------------------------------*/
+uint32_t xGovernorGetTemperature (void);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -0,0 +1,394 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "heap.h"
+#include "mmu.h"
+
+/* Two level segregated fit parameters */
+#define HEAP_ALIGN_LOG2		4										// Blocks and the memory returned are 16 byte aligned
+#define HEAP_ALIGN			(1 << HEAP_ALIGN_LOG2)
+#define HEAP_SL_LOG2		4										// 16 second level lists for each first level
+#define HEAP_SL_COUNT		(1 << HEAP_SL_LOG2)
+#define HEAP_FL_SHIFT		(HEAP_SL_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_SMALL_BLOCK	(1 << HEAP_FL_SHIFT)					// Below this size first level 0 lists are linear
+#define HEAP_FL_INDEX_MAX	31										// Blocks are smaller than 2^31 bytes
+#define HEAP_FL_COUNT		(HEAP_FL_INDEX_MAX - HEAP_FL_SHIFT + 1)
+#define HEAP_BLOCK_MAX		(((size_t)1 << HEAP_FL_INDEX_MAX) - HEAP_ALIGN)
+#define HEAP_ALLOC_MAX		((size_t)1 << (HEAP_FL_INDEX_MAX - 1))	// Rounding up for the search must stay in range
+#define HEAP_HEADER			HEAP_ALIGN								// Block header size, keeps the payload aligned
+#define HEAP_MIN_SIZE		HEAP_ALIGN								// Smallest payload, big enough for the free links
+
+/* Flags held in the low bits of the block size as sizes are aligned */
+#define BLOCK_FREE			1										// Block is free
+#define BLOCK_PREV_FREE		2										// Block before this in memory is free
+#define BLOCK_SIZE_MASK		(~(size_t)(HEAP_ALIGN - 1))
+
+extern uint8_t __heap_start__;										// Linker label at the end of the image
+
+/*--------------------------------------------------------------------------}
+{						  HEAP BLOCK STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  Every block has the header of the previous physical block pointer and
+.  the size. The free list links are only valid while the block is free
+.  and on 64 bit they share the first payload bytes with the user data.
+.--------------------------------------------------------------------------*/
+struct HeapBlock
+{
+	struct HeapBlock* prevPhys;										/*< Previous block in memory, only valid if BLOCK_PREV_FREE */
+	size_t size;													/*< Payload size in bytes with the block flags in the low bits */
+	struct HeapBlock* nextFree;										/*< Next block on the free list, only valid if free */
+	struct HeapBlock* prevFree;										/*< Prev block on the free list, only valid if free */
+};
+
+_Static_assert(offsetof(struct HeapBlock, nextFree) + 2 * sizeof(void*) <= HEAP_HEADER + HEAP_MIN_SIZE,
+	"Free links must fit in a minimum size block");
+
+/*--------------------------------------------------------------------------}
+{						  HEAP ARENA STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  Each core has its own arena so allocation never takes a lock. A free
+.  list is kept for each size class and the two bitmaps say which lists
+.  have blocks, so finding a block is a couple of bit scans. Blocks freed
+.  by another core are pushed on the lock free remoteFrees stack and the
+.  owning core merges them into the arena on its next call.
+.--------------------------------------------------------------------------*/
+static struct __attribute__((aligned(PER_CPU_LINE))) HeapArena
+{
+	struct HeapBlock* blocks[HEAP_FL_COUNT][HEAP_SL_COUNT];			/*< Free list heads for each size class */
+	uint32_t flBitmap;												/*< Bit set for each first level with a free block */
+	uint32_t slBitmap[HEAP_FL_COUNT];								/*< Bit set for each second level list with a free block */
+	struct HeapBlock* volatile remoteFrees;							/*< Blocks freed by other cores waiting to be merged */
+	uintptr_t start;												/*< First address in the arena */
+	uintptr_t end;													/*< Address after the arena */
+	size_t totalBytes;												/*< Bytes the arena manages */
+	size_t freeBytes;												/*< Payload bytes in free blocks */
+	size_t usedBytes;												/*< Payload bytes in allocated blocks */
+	size_t peakUsedBytes;											/*< Most usedBytes has been */
+	uint32_t freeBlocks;											/*< Count of free blocks */
+	uint32_t allocations;											/*< Successful allocations */
+	uint32_t frees;													/*< Blocks freed */
+	uint32_t failures;												/*< Allocations that failed */
+} heapArena[MAX_CPU_CORES] PER_CPU = { 0 };
+
+/*--------------------------------------------------------------------------}
+{	  Masks IRQ and FIQ on the core returning the previous mask state		}
+{--------------------------------------------------------------------------*/
+static inline RegType_t HeapMaskInterrupts (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	return state;
+}
+
+/*--------------------------------------------------------------------------}
+{		Restores the IRQ and FIQ mask state from HeapMaskInterrupts			}
+{--------------------------------------------------------------------------*/
+static inline void HeapRestoreInterrupts (RegType_t state)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+static inline size_t BlockSize (struct HeapBlock* b)
+{
+	return b->size & BLOCK_SIZE_MASK;
+}
+
+static inline struct HeapBlock* BlockNext (struct HeapBlock* b)
+{
+	return (struct HeapBlock*)((uintptr_t)b + HEAP_HEADER + BlockSize(b));
+}
+
+/* Index of the most significant set bit */
+static inline unsigned int HeapFls (size_t size)
+{
+	return 63 - __builtin_clzll((unsigned long long)size);
+}
+
+/*--------------------------------------------------------------------------}
+{				Size class list a block of the size belongs on				}
+{--------------------------------------------------------------------------*/
+static void MappingInsert (size_t size, unsigned int* fl, unsigned int* sl)
+{
+	if (size < HEAP_SMALL_BLOCK)									// Small sizes are linear steps of the alignment
+	{
+		*fl = 0;
+		*sl = size >> HEAP_ALIGN_LOG2;
+	}
+	else {
+		unsigned int f = HeapFls(size);
+		*sl = (size >> (f - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT;			// Next bits below the top bit
+		*fl = f - HEAP_FL_SHIFT + 1;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	 Size class whose every block fits the size, rounding the size up to	}
+{	 the next class so the first block of any list found is big enough		}
+{--------------------------------------------------------------------------*/
+static void MappingSearch (size_t size, unsigned int* fl, unsigned int* sl)
+{
+	if (size >= HEAP_SMALL_BLOCK)
+		size += ((size_t)1 << (HeapFls(size) - HEAP_SL_LOG2)) - 1;	// Round up to the next class
+	MappingInsert(size, fl, sl);
+}
+
+/*--------------------------------------------------------------------------}
+{	Finds a free block at or above the size class with two bitmap scans		}
+{--------------------------------------------------------------------------*/
+static struct HeapBlock* FindSuitableBlock (struct HeapArena* a, unsigned int fl, unsigned int sl)
+{
+	uint32_t slMap = a->slBitmap[fl] & (~0U << sl);					// Lists in this first level big enough
+	if (slMap == 0)
+	{
+		uint32_t flMap = a->flBitmap & (~0U << (fl + 1));			// Any larger first level
+		if (flMap == 0) return 0;									// Nothing big enough
+		fl = __builtin_ctz(flMap);									// Smallest larger first level
+		slMap = a->slBitmap[fl];
+	}
+	return a->blocks[fl][__builtin_ctz(slMap)];
+}
+
+/*--------------------------------------------------------------------------}
+{			   Puts a free block on the list for its size class				}
+{--------------------------------------------------------------------------*/
+static void InsertFreeBlock (struct HeapArena* a, struct HeapBlock* b)
+{
+	unsigned int fl, sl;
+	MappingInsert(BlockSize(b), &fl, &sl);
+	struct HeapBlock* head = a->blocks[fl][sl];
+	b->nextFree = head;
+	b->prevFree = 0;
+	if (head) head->prevFree = b;
+	a->blocks[fl][sl] = b;											// Block is new list head
+	a->flBitmap |= (1U << fl);										// Mark lists have a block
+	a->slBitmap[fl] |= (1U << sl);
+	a->freeBytes += BlockSize(b);
+	a->freeBlocks++;
+}
+
+/*--------------------------------------------------------------------------}
+{			  Takes a free block off the list for its size class			}
+{--------------------------------------------------------------------------*/
+static void RemoveFreeBlock (struct HeapArena* a, struct HeapBlock* b)
+{
+	unsigned int fl, sl;
+	MappingInsert(BlockSize(b), &fl, &sl);
+	if (b->nextFree) b->nextFree->prevFree = b->prevFree;
+	if (b->prevFree) b->prevFree->nextFree = b->nextFree;
+	else {
+		a->blocks[fl][sl] = b->nextFree;							// Block was list head
+		if (b->nextFree == 0)										// List is now empty
+		{
+			a->slBitmap[fl] &= ~(1U << sl);
+			if (a->slBitmap[fl] == 0) a->flBitmap &= ~(1U << fl);
+		}
+	}
+	a->freeBytes -= BlockSize(b);
+	a->freeBlocks--;
+}
+
+/*--------------------------------------------------------------------------}
+{	Frees a block into its own arena merging it with free neighbours, must	}
+{	run on the core that owns the arena with interrupts masked				}
+{--------------------------------------------------------------------------*/
+static void ArenaFree (struct HeapArena* a, struct HeapBlock* b)
+{
+	if (b->size & BLOCK_FREE) return;								// Already free
+	a->usedBytes -= BlockSize(b);
+	a->frees++;
+	b->size |= BLOCK_FREE;
+	if (b->size & BLOCK_PREV_FREE)									// Merge with free block before
+	{
+		struct HeapBlock* prev = b->prevPhys;
+		RemoveFreeBlock(a, prev);
+		prev->size += HEAP_HEADER + BlockSize(b);
+		b = prev;
+	}
+	struct HeapBlock* next = BlockNext(b);
+	if (next->size & BLOCK_FREE)									// Merge with free block after
+	{
+		RemoveFreeBlock(a, next);
+		b->size += HEAP_HEADER + BlockSize(next);
+		next = BlockNext(b);
+	}
+	next->prevPhys = b;												// Block after can find us to merge
+	next->size |= BLOCK_PREV_FREE;
+	InsertFreeBlock(a, b);
+}
+
+/*--------------------------------------------------------------------------}
+{	 Merges the blocks other cores have freed into the arena of this core	}
+{--------------------------------------------------------------------------*/
+static void DrainRemoteFrees (struct HeapArena* a)
+{
+	if (a->remoteFrees == 0) return;								// Plain check first, nothing to do is the norm
+	struct HeapBlock* b = __atomic_exchange_n(&a->remoteFrees, 0, __ATOMIC_ACQUIRE);
+	while (b)
+	{
+		struct HeapBlock* next = b->nextFree;						// Hold next before the merge reuses the link
+		ArenaFree(a, b);
+		b = next;
+	}
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ xHeapInit ]------------------------------------------------------------}
+.  Sets up the heap over the RAM from the end of the linked image to the
+.  MMU page pool, which sits just below the VideoCore split reported by the
+.  GET_VC_MEMORY tag, divided into one arena for each core.
+.  Called by xRTOS_Init so must not be called by user code.
+.  RETURN: true for success, false if the VC split could not be read
+.--------------------------------------------------------------------------*/
+bool xHeapInit (void)
+{
+	uint32_t msg[5] = { 0 };
+	if (!mailbox_tag_message(&msg[0], 5, MAILBOX_TAG_GET_VC_MEMORY, 8, 8, 0, 0))
+		return false;												// msg[3] has VC base addr msg[4] = VC memory size
+	if (msg[3] < MMU_PAGE_POOL_SIZE) return false;					// No room for the page pool
+	uintptr_t start = ((uintptr_t)&__heap_start__ + HEAP_ALIGN - 1) & ~(uintptr_t)(HEAP_ALIGN - 1);
+	uintptr_t end = MMU_PAGE_POOL_BASE(msg[3]);						// Page pool sits above the heap
+	if (end <= start) return false;									// No RAM below the VC split
+	size_t share = ((end - start) / MAX_CPU_CORES) & BLOCK_SIZE_MASK;// Each core gets an equal share
+	if (share < 2 * HEAP_HEADER + HEAP_MIN_SIZE) return false;		// Too small to hold a block
+	for (int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		struct HeapArena* a = &heapArena[i];
+		size_t size = share - 2 * HEAP_HEADER;						// Room for the block and the end sentinel
+		if (size > HEAP_BLOCK_MAX) size = HEAP_BLOCK_MAX;			// Anything above the largest class is unused
+		*a = (struct HeapArena){ 0 };
+		a->start = start + i * share;
+		a->end = a->start + size + 2 * HEAP_HEADER;
+		a->totalBytes = a->end - a->start;
+		struct HeapBlock* b = (struct HeapBlock*)a->start;			// One free block over the whole arena
+		b->prevPhys = 0;
+		b->size = size | BLOCK_FREE;
+		struct HeapBlock* sentinel = BlockNext(b);					// Used empty block stops merging off the end
+		sentinel->prevPhys = b;
+		sentinel->size = BLOCK_PREV_FREE;
+		InsertFreeBlock(a, b);
+	}
+	return true;
+}
+
+/*-[ pvPortMalloc ]---------------------------------------------------------}
+.  Allocates memory from the arena of the calling core. Allocation and free
+.  are two level segregated fit so they run in bounded constant time, and
+.  as each core only touches its own arena no lock is ever taken. The
+.  memory returned is 16 byte aligned. Interrupts are only masked for that
+.  bounded time so it may also be called from an IRQ or FIQ handler.
+.  RETURN: Pointer to the memory, NULL if the arena has no block to fit
+.--------------------------------------------------------------------------*/
+void* pvPortMalloc (size_t xWantedSize)
+{
+	void* p = 0;
+	RegType_t state = HeapMaskInterrupts();							// Arena is also used by IRQ and FIQ
+	struct HeapArena* a = &heapArena[xTaskGetCoreID()];				// Arena of this core, read masked
+	DrainRemoteFrees(a);											// Take back what other cores freed
+	if ((xWantedSize != 0) && (xWantedSize <= HEAP_ALLOC_MAX))
+	{
+		unsigned int fl, sl;
+		size_t size = (xWantedSize + HEAP_ALIGN - 1) & BLOCK_SIZE_MASK;
+		MappingSearch(size, &fl, &sl);
+		struct HeapBlock* b = FindSuitableBlock(a, fl, sl);
+		if (b)
+		{
+			RemoveFreeBlock(a, b);
+			size_t rem = BlockSize(b) - size;
+			if (rem >= HEAP_HEADER + HEAP_MIN_SIZE)					// Split the rest off as a free block
+			{
+				struct HeapBlock* rest = (struct HeapBlock*)((uintptr_t)b + HEAP_HEADER + size);
+				rest->size = (rem - HEAP_HEADER) | BLOCK_FREE;
+				rest->prevPhys = b;
+				BlockNext(rest)->prevPhys = rest;					// Block after still has a free block before
+				b->size = size;										// Block is now used
+				InsertFreeBlock(a, rest);
+			}
+			else {
+				b->size &= ~(size_t)BLOCK_FREE;						// Block is now used
+				BlockNext(b)->size &= ~(size_t)BLOCK_PREV_FREE;
+			}
+			a->usedBytes += BlockSize(b);
+			if (a->usedBytes > a->peakUsedBytes) a->peakUsedBytes = a->usedBytes;
+			a->allocations++;
+			p = (void*)((uintptr_t)b + HEAP_HEADER);				// Memory follows the header
+		}
+	}
+	if (p == 0) a->failures++;
+	HeapRestoreInterrupts(state);									// Restore interrupt state
+	return p;
+}
+
+/*-[ vPortFree ]------------------------------------------------------------}
+.  Frees memory from pvPortMalloc and may be called from any core. Memory
+.  from another core arena is handed back to that core lock free and is
+.  merged into its arena the next time that core allocates or frees.
+.--------------------------------------------------------------------------*/
+void vPortFree (void* pv)
+{
+	if (pv == 0) return;
+	struct HeapBlock* b = (struct HeapBlock*)((uintptr_t)pv - HEAP_HEADER);
+	RegType_t state = HeapMaskInterrupts();							// Arena is also used by IRQ and FIQ
+	unsigned int corenum = xTaskGetCoreID();						// Core read masked so caller can not be moved
+	DrainRemoteFrees(&heapArena[corenum]);							// Take back what other cores freed
+	for (unsigned int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		struct HeapArena* a = &heapArena[i];
+		if (((uintptr_t)b >= a->start) && ((uintptr_t)b < a->end))	// Arena the block came from
+		{
+			if (i == corenum) ArenaFree(a, b);						// Our arena so free it now
+			else {
+				struct HeapBlock* head = a->remoteFrees;
+				do {
+					b->nextFree = head;								// Block goes on top of current stack
+				} while (!__atomic_compare_exchange_n(&a->remoteFrees, &head, b,
+					true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));		// Hand it back to the owning core
+			}
+			break;
+		}
+	}
+	HeapRestoreInterrupts(state);									// Restore interrupt state
+}
+
+/*-[ vPortGetHeapStats ]----------------------------------------------------}
+.  Fills in the statistics for the arena of the given core. Another core
+.  arena may be changing so its statistics are only a snapshot.
+.--------------------------------------------------------------------------*/
+void vPortGetHeapStats (uint8_t corenum, HeapStats_t* pxHeapStats)
+{
+	if (pxHeapStats == 0) return;
+	*pxHeapStats = (HeapStats_t){ 0 };
+	if (corenum >= MAX_CPU_CORES) return;							// Invalid core
+	struct HeapArena* a = &heapArena[corenum];
+	pxHeapStats->totalBytes = a->totalBytes;
+	pxHeapStats->freeBytes = a->freeBytes;
+	pxHeapStats->peakUsedBytes = a->peakUsedBytes;
+	pxHeapStats->freeBlocks = a->freeBlocks;
+	pxHeapStats->allocations = a->allocations;
+	pxHeapStats->frees = a->frees;
+	pxHeapStats->failures = a->failures;
+	uint32_t flMap = a->flBitmap;
+	if (flMap)														// Largest class with a free block
+	{
+		unsigned int fl = 31 - __builtin_clz(flMap);
+		uint32_t slMap = a->slBitmap[fl];
+		struct HeapBlock* b = (slMap) ? a->blocks[fl][31 - __builtin_clz(slMap)] : 0;
+		if (b) pxHeapStats->largestFreeBlock = BlockSize(b);
+	}
+	if (pxHeapStats->freeBytes && (pxHeapStats->largestFreeBlock <= pxHeapStats->freeBytes))
+		pxHeapStats->fragmentation = 100 - (uint32_t)(((uint64_t)pxHeapStats->largestFreeBlock * 100)
+			/ pxHeapStats->freeBytes);
+}
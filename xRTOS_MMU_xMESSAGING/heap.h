@@ -0,0 +1,63 @@
+#ifndef _HEAP_H
+#define _HEAP_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stdbool.h>							// Needed for bool
+#include <stddef.h>								// Needed for size_t
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+
+/*--------------------------------------------------------------------------}
+{						HEAP STATISTICS STRUCTURE							}
+{--------------------------------------------------------------------------*/
+typedef struct HeapStats
+{
+	size_t totalBytes;							// Bytes the core arena manages (headers included)
+	size_t freeBytes;							// Bytes currently free in the core arena
+	size_t peakUsedBytes;						// Most bytes ever in use at once
+	size_t largestFreeBlock;					// Size of largest free block, bounded by its size class
+	uint32_t freeBlocks;						// Number of free blocks, more for the same free bytes is more fragmented
+	uint32_t fragmentation;						// Percent of free bytes not in the largest free block
+	uint32_t allocations;						// Successful pvPortMalloc calls
+	uint32_t frees;								// vPortFree calls
+	uint32_t failures;							// pvPortMalloc calls that returned NULL
+} HeapStats_t;
+
+/*-[ xHeapInit ]------------------------------------------------------------}
+.  Sets up the heap over the RAM from the end of the linked image to the
+.  MMU page pool, which sits just below the VideoCore split reported by the
+.  GET_VC_MEMORY tag, divided into one arena for each core.
+.  Called by xRTOS_Init so must not be called by user code.
+.  RETURN: true for success, false if the VC split could not be read
+.--------------------------------------------------------------------------*/
+bool xHeapInit (void);
+
+/*-[ pvPortMalloc ]---------------------------------------------------------}
+.  Allocates memory from the arena of the calling core. Allocation and free
+.  are two level segregated fit so they run in bounded constant time, and
+.  as each core only touches its own arena no lock is ever taken. The
+.  memory returned is 16 byte aligned. Interrupts are only masked for that
+.  bounded time so it may also be called from an IRQ or FIQ handler.
+.  RETURN: Pointer to the memory, NULL if the arena has no block to fit
+.--------------------------------------------------------------------------*/
+void* pvPortMalloc (size_t xWantedSize);
+
+/*-[ vPortFree ]------------------------------------------------------------}
+.  Frees memory from pvPortMalloc and may be called from any core. Memory
+.  from another core arena is handed back to that core lock free and is
+.  merged into its arena the next time that core allocates or frees.
+.--------------------------------------------------------------------------*/
+void vPortFree (void* pv);
+
+/*-[ vPortGetHeapStats ]----------------------------------------------------}
+.  Fills in the statistics for the arena of the given core. Another core
+.  arena may be changing so its statistics are only a snapshot.
+.--------------------------------------------------------------------------*/
+void vPortGetHeapStats (uint8_t corenum, HeapStats_t* pxHeapStats);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -7,26 +7,55 @@
 #include "task.h"
 #include "windows.h"
 #include "semaphore.h"
+#include "governor.h"
+#include "mmu.h"
+#include "heap.h"
+#include "dma.h"
 
+static SemaphoreHandle_t screenSem;
+
+/* Several tasks on a core draw, and the present holds the screen over a vsync
+   wait, so the screen lock blocks rather than spins with the tick masked */
+static void ScreenLock (void)
+{
+	while (!xSemaphoreTakeTimeout(screenSem, 1000)) {};				// Block until the screen is free
+}
+
+static void ScreenUnlock (void)
+{
+	xSemaphoreGive(screenSem);
+}
+
+/* Step only moves by one, so after the first step only the columns between
+   the positions of the steps either side can change and only they are drawn.
+   The pen is set to the brush so the narrow rectangles are not outlined. */
 void DoProgress(HDC dc, int step, int total, int x, int y, int barWth, int barHt,  COLORREF col)
 {
 
 	// minus label len
 	int pos = (step * barWth) / total;
+	int from = (step <= 1) ? 0 : ((step - 1) * barWth) / total;
+	int to = (step <= 1) ? barWth : ((step + 1) * barWth) / total;
+	if (to > barWth) to = barWth;
+
+	ScreenLock();
 
 	// Draw the colour bar
 	COLORREF orgBrush = SetDCBrushColor(dc, col);
-	Rectangle(dc, x, y, x+pos, y+barHt);
+	COLORREF orgPen = SetDCPenColor(dc, col);
+	Rectangle(dc, x+from, y, x+pos, y+barHt);
 
 	// Draw the no bar section 
 	SetDCBrushColor(dc, 0);
-	Rectangle(dc, x+pos, y, x+barWth, y+barHt);
+	SetDCPenColor(dc, 0);
+	Rectangle(dc, x+pos, y, x+to, y+barHt);
 
 	SetDCBrushColor(dc, orgBrush);
+	SetDCPenColor(dc, orgPen);
 
+	ScreenUnlock();
 }
 
-static SemaphoreHandle_t screenSem;
 static unsigned int Counts[4] = { 0 };
 
 #define WAIT_TASK1  0x1
@@ -48,10 +77,10 @@ void task1(void *pParam) {
 		DoProgress(Dc, step, total, 10, 100, GetScreenWidth()-20, 20, col);
 		xTaskWaitOnMessage(WAIT_TASK1);
 		Counts[0]++;
-		xSemaphoreTake(screenSem);
+		ScreenLock();
 		GotoXY(0, 10);
 		printf("Core 0 count %u\n", Counts[0]);
-		xSemaphoreGive(screenSem);
+		ScreenUnlock();
 	}
 }
 
@@ -70,10 +99,10 @@ void task2(void *pParam) {
 		DoProgress(Dc, step, total, 10, 200, GetScreenWidth() - 20, 20, col);
 		xTaskWaitOnMessage(WAIT_TASK2);
 		Counts[1]++;
-		xSemaphoreTake(screenSem);
+		ScreenLock();
 		GotoXY(0, 16);
 		printf("Core 1 count %u\n", Counts[1]);
-		xSemaphoreGive(screenSem);
+		ScreenUnlock();
 	}
 }
 
@@ -93,10 +122,10 @@ void task3(void *pParam) {
 		xTaskDelay(24);
 		xTaskReleaseMessage(WAIT_TASK2);
 		Counts[2]++;
-		xSemaphoreTake(screenSem);
+		ScreenLock();
 		GotoXY(0, 22);
 		printf("Core 2 count %u\n", Counts[2]);
-		xSemaphoreGive(screenSem);
+		ScreenUnlock();
 	}
 }
 
@@ -115,20 +144,80 @@ void task4 (void* pParam) {
 		DoProgress(Dc, step, total, 10, 400, GetScreenWidth() - 20, 20, col);
 		xTaskDelay(26);
 		Counts[3]++;
-		xSemaphoreTake(screenSem);
+		ScreenLock();
 		GotoXY(0, 28);
 		printf("Core 3 count %u\n", Counts[3]);
-		xSemaphoreGive(screenSem);
+		ScreenUnlock();
 	}
 }
 
+/* Copies a buffer, then fills a rectangle in it, with DMA and checks both */
+#define DMA_TEST_SIZE	65536
+static const char* DmaTest (void)
+{
+	const char* result = "DMA test: no channel or memory";
+	int channel = dma_channel_alloc(true);							// Full channel for the rectangle
+	uint32_t* src = pvPortMalloc(DMA_TEST_SIZE);
+	uint32_t* dst = pvPortMalloc(DMA_TEST_SIZE);
+	if ((channel >= 0) && src && dst)
+	{
+		for (unsigned int i = 0; i < DMA_TEST_SIZE / 4; i++)
+		{
+			src[i] = i * 0x9E3779B9;
+			dst[i] = 0;
+		}
+		result = "DMA copy 64K: failed";
+		if (dma_memcpy(channel, dst, src, DMA_TEST_SIZE, 1))		// Notify bit 0 on completion
+		{
+			xTaskNotifyWait(0, 1);									// Core is free while it copies
+			if (dma_wait(channel) && (memcmp(dst, src, DMA_TEST_SIZE) == 0))
+			{
+				result = "DMA copy 64K: ok, fill rect: failed";
+				if (dma_fill_rect(channel, &dst[8], 1024, 256, 64, 0xA5A5A5A5, 1))
+				{
+					xTaskNotifyWait(0, 1);
+					bool ok = dma_wait(channel);
+					for (unsigned int i = 0; ok && (i < DMA_TEST_SIZE / 4); i++)
+					{
+						bool inRect = ((i % 256) >= 8) && ((i % 256) < 8 + 64) && (i < 64 * 256);
+						ok = (dst[i] == ((inRect) ? 0xA5A5A5A5 : src[i]));
+					}
+					if (ok) result = "DMA copy 64K: ok, fill rect: ok";
+				}
+			}
+		}
+	}
+	if (channel >= 0) dma_channel_free(channel);
+	vPortFree(src);
+	vPortFree(dst);
+	return result;
+}
+
 void task1A(void* pParam) {
-	char buf[32];
+	char buf[64];
 	HDC Dc = CreateExternalDC(5);
 	COLORREF col = 0xFF00FFFF;
 	int total = 1000;
 	int step = 0;
 	int dir = 1;
+	MmuTlbBench_t bench;
+	if (MMU_tlb_benchmark(64, &bench))								// Same 2MB buffer as 4K pages, 64K runs and a 2MB block
+	{
+		sprintf(&buf[0], "TLB refills 4K: %u 64K: %u 2M: %u", (unsigned)bench.refills[MMU_BENCH_PAGES],
+			(unsigned)bench.refills[MMU_BENCH_CONTIGUOUS], (unsigned)bench.refills[MMU_BENCH_BLOCK]);
+		ScreenLock();
+		TextOut(Dc, 20, 40, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
+		sprintf(&buf[0], "Cycles 4K: %u 64K: %u 2M: %u", (unsigned)bench.cycles[MMU_BENCH_PAGES],
+			(unsigned)bench.cycles[MMU_BENCH_CONTIGUOUS], (unsigned)bench.cycles[MMU_BENCH_BLOCK]);
+		ScreenLock();
+		TextOut(Dc, 20, 60, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
+	}
+	sprintf(&buf[0], "%s", DmaTest());								// QEMU raspi3b emulates the DMA engine too
+	ScreenLock();
+	TextOut(Dc, 20, 100, &buf[0], strlen(&buf[0]));
+	ScreenUnlock();
 	while (1) {
 		step += dir;
 		if ((step == total) || (step == 0))
@@ -138,14 +227,16 @@ void task1A(void* pParam) {
 		DoProgress(Dc, step, total, 10, 125, GetScreenWidth() - 20, 20, col);
 		xTaskDelay(35);
 		xTaskReleaseMessage(WAIT_TASK1);
-		sprintf(&buf[0], "Core 0 Load: %3i%% Task count: %2i", xLoadPercentCPU(), xTaskGetNumberOfTasks());
+		sprintf(&buf[0], "Core 0 Load: %3i%% Idle: %3i%% Task count: %2i", xLoadPercentCPU(), xIdleResidencyPercent(), xTaskGetNumberOfTasks());
+		ScreenLock();
 		TextOut(Dc, 20, 80, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
 	}
 }
 
 
 void task2A(void* pParam) {
-	char buf[32];
+	char buf[64];
 	HDC Dc = CreateExternalDC(6);
 	COLORREF col = 0xFFFFFFFF;
 	int total = 1000;
@@ -159,13 +250,15 @@ void task2A(void* pParam) {
 		}
 		DoProgress(Dc, step, total, 10, 225, GetScreenWidth() - 20, 20, col);
 		xTaskDelay(37);
-		sprintf(&buf[0], "Core 1 Load: %3i%% Task count: %2i", xLoadPercentCPU(), xTaskGetNumberOfTasks());
+		sprintf(&buf[0], "Core 1 Load: %3i%% Idle: %3i%% Task count: %2i", xLoadPercentCPU(), xIdleResidencyPercent(), xTaskGetNumberOfTasks());
+		ScreenLock();
 		TextOut(Dc, 20, 180, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
 	}
 }
 
 void task3A(void* pParam) {
-	char buf[32];
+	char buf[64];
 	HDC Dc = CreateExternalDC(7);
 	COLORREF col = 0xFF7F7F7F;
 	int total = 1000;
@@ -179,13 +272,15 @@ void task3A(void* pParam) {
 		}
 		DoProgress(Dc, step, total, 10, 325, GetScreenWidth() - 20, 20, col);
 		xTaskDelay(39);
-		sprintf(&buf[0], "Core 2 Load: %3i%% Task count: %2i", xLoadPercentCPU(), xTaskGetNumberOfTasks());
+		sprintf(&buf[0], "Core 2 Load: %3i%% Idle: %3i%% Task count: %2i", xLoadPercentCPU(), xIdleResidencyPercent(), xTaskGetNumberOfTasks());
+		ScreenLock();
 		TextOut(Dc, 20, 280, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
 	}
 }
 
 void task4A(void* pParam) {
-	char buf[32];
+	char buf[64];
 	HDC Dc = CreateExternalDC(8);
 	COLORREF col = 0xFFFF00FF;
 	int total = 1000;
@@ -199,28 +294,51 @@ void task4A(void* pParam) {
 		}
 		DoProgress(Dc, step, total, 10, 425, GetScreenWidth() - 20, 20, col);
 		xTaskDelay(41);
-		sprintf(&buf[0], "Core 3 Load: %3i%% Task count: %2i", xLoadPercentCPU(), xTaskGetNumberOfTasks());
+		sprintf(&buf[0], "Core 3 Load: %3i%% Idle: %3i%% Task count: %2i", xLoadPercentCPU(), xIdleResidencyPercent(), xTaskGetNumberOfTasks());
+		ScreenLock();
 		TextOut(Dc, 20, 380, &buf[0], strlen(&buf[0]));
+		ScreenUnlock();
 	}
 }
 
 
+/* Flips the double buffered console about 50 times a second, holding the
+   screen lock so no task is drawing while the buffers swap. Drawing tasks
+   wait blocked for the vsync rather than spinning */
+void taskPresent(void* pParam) {
+	while (1) {
+		xTaskDelay(20);
+		ScreenLock();
+		PiConsole_Present();
+		ScreenUnlock();
+	}
+}
+
+/* Called in the fault exception so it only prints */
+void TaskFault (TaskHandle_t task, const char* name, bool overflow, RegType_t address)
+{
+	printf("Task %s %s at %p\n", (name) ? name : "?", (overflow) ? "stack overflow" : "fault", (void*)address);
+}
+
 void main (void)
 {
 	Init_EmbStdio(WriteText);										// Initialize embedded stdio
-	PiConsole_Init(0, 0, 0, printf);								// Auto resolution console, message to screen
+	PiConsole_InitEx(0, 0, 0, true, printf);						// Auto resolution double buffered console, message to screen
 	displaySmartStart(printf);										// Display smart start details
 	ARM_setmaxspeed(printf);										// ARM CPU to max speed
 	printf("Task tick rate: %u\n", configTICK_RATE_HZ);
 
 
 	xRTOS_Init();													// Initialize the xRTOS system .. done before any other xRTOS call
+	dma_init();														// DMA channels and completion interrupt
 
 	screenSem = xSemaphoreCreateBinary();
+	xTaskSetFaultHook(TaskFault);									// Report any task that faults
 
 	/* Core 0 tasks */
 	xTaskCreate(0, task1, "Core0-1", 512, NULL, 4, NULL);
 	xTaskCreate(0, task1A, "Core0-2", 512, NULL, 2, NULL);
+	xTaskCreate(0, taskPresent, "Present", 512, NULL, 2, NULL);
 
 	/* Core 1 tasks */
 	xTaskCreate(1, task2, "Core1-1", 512, NULL, 2, NULL);
@@ -234,6 +352,11 @@ void main (void)
 	xTaskCreate(3, task4, "Core3-1", 512, NULL, 2, NULL);
 	xTaskCreate(3, task4A, "Core3-2", 512, NULL, 2, NULL);
 
+#if (configUSE_GOVERNOR == 1)
+	/* ARM clock governor on core 0 scales the clock from max set above */
+	xGovernorStart(0);
+#endif
+
 	/* Start scheduler */
 	xTaskStartScheduler();
 	/*
@@ -1,3 +1,5 @@
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "rpi-SmartStart.h"
 #include "mmu.h"
@@ -33,8 +35,6 @@
 static RegType_t __attribute__((aligned(TLB_ALIGNMENT))) page_table_map1to1[NUM_PAGE_TABLE_ENTRIES] = { 0 };
 /* First Level Page Table for virtual mapping */
 static RegType_t __attribute__((aligned(TLB_ALIGNMENT))) page_table_virtualmap[NUM_PAGE_TABLE_ENTRIES] = { 0 };
-/* First Level Page Table for virtual mapping */
-static RegType_t __attribute__((aligned(TLB2_ALIGNMENT))) Stage2virtual[512] = { 0 };
 
 #if __aarch64__ == 1
 typedef union {
@@ -53,11 +53,11 @@ typedef union {
 			} SH : 2;						// @8-9
 			uint64_t AF : 1;				// @10		Accessable flag
 
-		uint64_t _reserved11 : 1;			// @11		Set to 0
+		uint64_t nG : 1;					// @11		Not global, entry is only used by the ASID it was loaded with
 		uint64_t Address : 36;				// @12-47	36 Bits of address
 		uint64_t _reserved48_51 : 4;		// @48-51	Set to 0
 		uint64_t Contiguous : 1;			// @52		Contiguous
-		uint64_t _reserved53 : 1;			// @53		Set to 0
+		uint64_t PXN : 1;					// @53		No execute at EL1 if bit set
 		uint64_t XN : 1;					// @54		No execute if bit set
 		uint64_t _reserved55_58 : 4;		// @55-58	Set to 0
 		
@@ -87,13 +87,707 @@ typedef union {
 static_assert(sizeof(VMSAv8_64_DESCRIPTOR) == sizeof(RegType_t), "VMSAv8_64_DESCRIPTOR should be size of a register");
 
 /* Level 2 and final ... 1 to 1 mapping */
-/* This will have 1024 entries x 2M so a full range of 2GB */
-static VMSAv8_64_DESCRIPTOR __attribute__((aligned(TLB_ALIGNMENT))) Stage2map1to1[1024] = { 0 };
+/* This will have 512 entries x 2M so a full range of 1GB, the second GB is one level 1 block */
+static VMSAv8_64_DESCRIPTOR __attribute__((aligned(TLB_ALIGNMENT))) Stage2map1to1[512] = { 0 };
+
+#endif
+
+/***************************************************************************}
+{					   PAGE POOL AND MAPPING DEFINITIONS				    }
+****************************************************************************/
+#define PAGE_SHIFT			12											// Page frames and the smallest mapping are 4K
+#define PAGE_SIZE			((uintptr_t)1 << PAGE_SHIFT)
+#define PAGE_MAX_ORDER		9											// Largest buddy block is 2^9 pages = 2MB
+#define POOL_PAGES			(MMU_PAGE_POOL_SIZE >> PAGE_SHIFT)
+#define PAGE_FREE			0x80										// pageOrder flag for the first frame of a free block
+#define PAGE_TAIL			0x40										// pageOrder flag for any other frame of a block
+#define CONTIG_ENTRIES		16											// Entries in a contiguous run
+#define ATTR_NOT_GLOBAL		0x20000000									// Internal attrs flag for address space entries
+
+_Static_assert((MMU_PAGE_POOL_SIZE % (PAGE_SIZE << PAGE_MAX_ORDER)) == 0, "MMU_PAGE_POOL_SIZE must be a multiple of 2MB");
+
+#if __aarch64__ == 1
+#define MMU_LEVELS			3											// Level 1, 2 and 3 tables for a 39 bit VA
+#define BLOCK_LEVEL			0											// Level 1 is the first to hold blocks (1GB)
+#define TTBR0_VA_END		((uintptr_t)1 << 39)						// T0SZ=25 gives TTBR0 the bottom 512GB
+#define TTBR1_VA_START		((uintptr_t)0xFFFFFF8000000000)				// T1SZ=25 gives TTBR1 the top 512GB
+#define DESC_ADDR_MASK		((uint64_t)0x0000FFFFFFFFF000)				// Output address bits of a descriptor
+#define DESC_CONTIGUOUS		((uint64_t)1 << 52)							// Contiguous hint bit of a descriptor
+#define MMU_ASIDS			256											// 8 bit ASIDs, 0 is the kernel map
+#define SPACE_VA_START		((uintptr_t)2 << 30)						// Address space regions sit above the 2GB kernel map
+static const uint8_t levelShift[MMU_LEVELS] = { 30, 21, 12 };
+static const uint16_t levelEntries[MMU_LEVELS] = { 512, 512, 512 };
+#else
+#define MMU_LEVELS			2											// Level 1 and level 2 short descriptor tables
+#define BLOCK_LEVEL			0											// Level 1 holds sections (1MB)
+#define TTBR1_VA_START		((uintptr_t)0x80000000)						// TTBCR.N=1 gives TTBR1 the top 2GB
+#define L2_TABLE_SIZE		1024										// Level 2 table is 256 entries of 4 bytes
+static const uint8_t levelShift[MMU_LEVELS] = { 20, 12 };
+static const uint16_t levelEntries[MMU_LEVELS] = { 4096, 256 };
+#endif
+
+enum { ENTRY_INVALID, ENTRY_TABLE, ENTRY_LEAF };
+
+/*--------------------------------------------------------------------------}
+{						  TLB BATCH STRUCTURE DEFINED						}
+{--------------------------------------------------------------------------*/
+struct TlbBatch
+{
+	unsigned int count;													// Pages in the batch
+	bool all;															// Batch overflowed so flush the whole TLB
+	bool exec;															// An executable entry was removed
+	uint16_t asid;														// Address space of the entries, 0 for the kernel map
+	uintptr_t va[MMU_TLB_BATCH];										// Pages to invalidate
+};
+
+static void (*coreSync) (void) = 0;										// Makes every other core synchronize its context
+
+/*--------------------------------------------------------------------------}
+{						 PAGE POOL STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  A binary buddy allocator over the 4K page frames of the pool. Free blocks
+.  are linked through their own first frame, which the 1:1 map lets us
+.  write, and pageOrder holds the order of the block each frame starts.
+.--------------------------------------------------------------------------*/
+struct FreePage
+{
+	struct FreePage* next;												// Next free block of the same order
+	struct FreePage* prev;												// Previous free block of the same order
+};
+
+static struct PagePool
+{
+	uintptr_t base;														// Physical address of the first frame
+	unsigned int pages;													// Frames in the pool, 0 if there is no pool
+	unsigned int freePages;												// Frames currently free
+	struct FreePage* freeList[PAGE_MAX_ORDER + 1];						// Free blocks of each order
+	uint8_t pageOrder[POOL_PAGES];										// Order of the block each frame starts or PAGE_TAIL
+} pagePool = { 0 };
+
+static volatile uint32_t mmuLock = 0;									// Guards the page pool and all the tables
+
+#if __aarch64__ == 1
+static RegType_t* spaceRoot[MMU_ASIDS] = { 0 };						// Level 1 table of each address space
+#endif
+
+extern uint8_t __heap_start__;											// Linker label at the end of the image
+
+/*--------------------------------------------------------------------------}
+{					Returns true if the MMU is on for this core				}
+{--------------------------------------------------------------------------*/
+static inline bool MmuIsOn (void)
+{
+	RegType_t sctlr;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, sctlr_el1" : "=r" (sctlr));
+#else
+	__asm volatile ("mrc p15, 0, %0, c1, c0, 0" : "=r" (sctlr));
+#endif
+	return (sctlr & 1);
+}
+
+/*--------------------------------------------------------------------------}
+{	Masks IRQ and FIQ and takes the MMU lock. Exclusives need the MMU on	}
+{	and a core only runs with it off while core 0 is still in xRTOS_Init,	}
+{	where nothing else touches the tables, so only then is it not taken.	}
+{--------------------------------------------------------------------------*/
+static RegType_t MmuLock (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	if (MmuIsOn())
+		while (__atomic_exchange_n(&mmuLock, 1, __ATOMIC_ACQUIRE)) {};
+	return state;
+}
+
+/*--------------------------------------------------------------------------}
+{		  Releases the MMU lock and restores the IRQ and FIQ mask state		}
+{--------------------------------------------------------------------------*/
+static void MmuUnlock (RegType_t state)
+{
+	if (MmuIsOn()) __atomic_store_n(&mmuLock, 0, __ATOMIC_RELEASE);
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{				  Puts a block on the free list of its order				}
+{--------------------------------------------------------------------------*/
+static void PagePush (uintptr_t idx, unsigned int order)
+{
+	struct FreePage* p = (struct FreePage*)(pagePool.base + (idx << PAGE_SHIFT));
+	p->prev = 0;
+	p->next = pagePool.freeList[order];
+	if (p->next) p->next->prev = p;
+	pagePool.freeList[order] = p;
+	pagePool.pageOrder[idx] = order | PAGE_FREE;
+}
+
+/*--------------------------------------------------------------------------}
+{				  Takes a block off the free list of its order				}
+{--------------------------------------------------------------------------*/
+static void PageUnlink (uintptr_t idx, unsigned int order)
+{
+	struct FreePage* p = (struct FreePage*)(pagePool.base + (idx << PAGE_SHIFT));
+	if (p->prev) p->prev->next = p->next;
+		else pagePool.freeList[order] = p->next;
+	if (p->next) p->next->prev = p->prev;
+}
+
+/*--------------------------------------------------------------------------}
+{	Allocates a block of 2^order frames, splitting a larger free block and	}
+{	giving back the upper halves if there is none of that order. MMU lock	}
+{	must be held.															}
+{--------------------------------------------------------------------------*/
+static uintptr_t PageAlloc (unsigned int order)
+{
+	unsigned int o = order;
+	while ((o <= PAGE_MAX_ORDER) && (pagePool.freeList[o] == 0)) o++;
+	if (o > PAGE_MAX_ORDER) return 0;									// Nothing big enough is free
+	uintptr_t idx = ((uintptr_t)pagePool.freeList[o] - pagePool.base) >> PAGE_SHIFT;
+	PageUnlink(idx, o);
+	while (o > order)
+	{
+		o--;
+		PagePush(idx + ((uintptr_t)1 << o), o);							// Upper half goes back free
+	}
+	pagePool.pageOrder[idx] = order;									// Allocated block of this order
+	pagePool.freePages -= 1u << order;
+	return pagePool.base + (idx << PAGE_SHIFT);
+}
+
+/*--------------------------------------------------------------------------}
+{	Frees a block merging it with its buddy while the buddy is also free.	}
+{	MMU lock must be held.													}
+{--------------------------------------------------------------------------*/
+static bool PageFree (uintptr_t pa)
+{
+	uintptr_t idx = (pa - pagePool.base) >> PAGE_SHIFT;
+	if ((pa < pagePool.base) || (pa & (PAGE_SIZE - 1)) || (idx >= pagePool.pages))
+		return false;													// Not a frame in the pool
+	unsigned int order = pagePool.pageOrder[idx];
+	if (order & (PAGE_FREE | PAGE_TAIL)) return false;					// Not the first frame of an allocated block
+	pagePool.freePages += 1u << order;
+	while (order < PAGE_MAX_ORDER)
+	{
+		uintptr_t buddy = idx ^ ((uintptr_t)1 << order);
+		if ((buddy >= pagePool.pages) || (pagePool.pageOrder[buddy] != (order | PAGE_FREE)))
+			break;														// Buddy is not free so stop merging
+		PageUnlink(buddy, order);
+		pagePool.pageOrder[(idx > buddy) ? idx : buddy] = PAGE_TAIL;	// Upper half is now inside the block
+		if (buddy < idx) idx = buddy;
+		order++;
+	}
+	PagePush(idx, order);
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{	Sets up the pool as free 2MB blocks below the VideoCore split. If the	}
+{	split is too low to leave the pool above the image there is no pool.	}
+{--------------------------------------------------------------------------*/
+static void PagePoolInit (uintptr_t vcBase)
+{
+	if ((vcBase < MMU_PAGE_POOL_SIZE) ||
+		(MMU_PAGE_POOL_BASE(vcBase) < (uintptr_t)&__heap_start__)) return;
+	pagePool.base = MMU_PAGE_POOL_BASE(vcBase);
+	pagePool.pages = POOL_PAGES;
+	pagePool.freePages = POOL_PAGES;
+	for (uintptr_t idx = 0; idx < POOL_PAGES; idx++)
+		pagePool.pageOrder[idx] = PAGE_TAIL;
+	for (uintptr_t idx = POOL_PAGES; idx > 0; idx -= (1 << PAGE_MAX_ORDER))
+		PagePush(idx - (1 << PAGE_MAX_ORDER), PAGE_MAX_ORDER);			// Lowest block ends up first on the list
+}
+
+/*--------------------------------------------------------------------------}
+{					 Returns true if the frame is in the pool				}
+{--------------------------------------------------------------------------*/
+static inline bool InPagePool (uintptr_t pa)
+{
+	return ((pa - pagePool.base) < ((uintptr_t)pagePool.pages << PAGE_SHIFT));
+}
+
+/*--------------------------------------------------------------------------}
+{	Returns the level 1 table of an address space, the 1:1 map for ASID 0,	}
+{	NULL if there is no such space. MMU lock must be held.					}
+{--------------------------------------------------------------------------*/
+static inline RegType_t* SpaceRoot (uint16_t asid)
+{
+	if (asid == 0) return &page_table_map1to1[0];
+#if __aarch64__ == 1
+	if (asid < MMU_ASIDS) return spaceRoot[asid];
+#endif
+	return 0;
+}
+
+/*--------------------------------------------------------------------------}
+{	Returns the level 1 table that translates va, root being the TTBR0		}
+{	table of the address space.												}
+{--------------------------------------------------------------------------*/
+static inline RegType_t* RootTable (RegType_t* root, uintptr_t va)
+{
+	return (va >= TTBR1_VA_START) ? &page_table_virtualmap[0] : root;
+}
+
+/*--------------------------------------------------------------------------}
+{	Returns true if a run of 16 leaf entries at the level can be marked		}
+{	contiguous. AARCH64 has the hint at every level, on AARCH32 only the	}
+{	64K large page exists as supersections need a 16MB physical layout.		}
+{--------------------------------------------------------------------------*/
+static inline bool LevelContiguous (unsigned int level)
+{
+#if __aarch64__ == 1
+	return true;
+#else
+	return (level == MMU_LEVELS - 1);
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{			Returns the index of the entry for va in a table at level		}
+{--------------------------------------------------------------------------*/
+static inline unsigned int TableIndex (uintptr_t va, unsigned int level)
+{
+	return (va >> levelShift[level]) & (levelEntries[level] - 1);
+}
+
+/*--------------------------------------------------------------------------}
+{			  Returns whether an entry is invalid, a table or a leaf		}
+{--------------------------------------------------------------------------*/
+static inline int EntryKind (RegType_t e, unsigned int level)
+{
+#if __aarch64__ == 1
+	if ((e & 1) == 0) return ENTRY_INVALID;
+	if ((level < MMU_LEVELS - 1) && ((e & 3) == 3)) return ENTRY_TABLE;
+#else
+	if ((e & 3) == 0) return ENTRY_INVALID;
+	if ((level == 0) && ((e & 3) == 1)) return ENTRY_TABLE;
+#endif
+	return ENTRY_LEAF;
+}
+
+/*--------------------------------------------------------------------------}
+{				  Returns the next level table of a table entry				}
+{--------------------------------------------------------------------------*/
+static inline RegType_t* EntryTable (RegType_t e)
+{
+#if __aarch64__ == 1
+	return (RegType_t*)(uintptr_t)(e & DESC_ADDR_MASK);
+#else
+	return (RegType_t*)(e & ~(RegType_t)(L2_TABLE_SIZE - 1));
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Returns the bytes a leaf entry maps, a contiguous run counted whole		}
+{--------------------------------------------------------------------------*/
+static inline uintptr_t LeafSpan (RegType_t e, unsigned int level)
+{
+	uintptr_t span = (uintptr_t)1 << levelShift[level];
+#if __aarch64__ == 1
+	if (e & DESC_CONTIGUOUS) span *= CONTIG_ENTRIES;
+#else
+	if ((level == 1) && ((e & 3) == 1)) span *= CONTIG_ENTRIES;			// Large page
+#endif
+	return span;
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes a leaf entry for pa from the MT_xxx type and flags in attrs. On	}
+{	AARCH32 the section format attributes are moved to the page format and	}
+{	a contiguous run becomes a large page which all 16 entries repeat.		}
+{--------------------------------------------------------------------------*/
+static RegType_t LeafEntry (uintptr_t pa, uint32_t attrs, unsigned int level, bool contiguous)
+{
+#if __aarch64__ == 1
+	uint8_t mt = attrs & MMU_MT_MASK;
+	VMSAv8_64_DESCRIPTOR d = {
+		.Address = pa >> 12,
+		.AF = 1,
+		.MemAttr = mt,
+		.EntryType = (level == MMU_LEVELS - 1) ? 3 : 1,
+	};
+	if (mt >= MT_NORMAL_NC) d.SH = STAGE2_SH_INNER_SHAREABLE;
+	if (attrs & MMU_READONLY) d.S2AP = STAGE2_S2AP_NO_WRITE;
+	if ((attrs & MMU_NOEXEC) || (mt < MT_NORMAL_NC)) d.PXN = d.XN = 1;	// Device memory is never executed
+	d.Contiguous = contiguous;
+	d.nG = ((attrs & ATTR_NOT_GLOBAL) != 0);							// Address space entries carry the ASID
+	return d.Raw64;
+#else
+	uint32_t s = attrs & ~(MMU_READONLY | MMU_NOEXEC | ATTR_NOT_GLOBAL);// Section format attributes
+	if (attrs & MMU_READONLY) s |= (1 << 15);							// APX with AP=01 is privileged read only
+	if (attrs & MMU_NOEXEC) s |= (1 << 4);								// XN
+	if (level == 0) return (pa & 0xFFF00000) | (s & 0x000FFFFF);		// Section
+	uint32_t e = (s & 0x0C) | ((s >> 6) & 0xE30);						// C B, AP to 5:4, APX to 9, S nG to 11:10
+	if (contiguous)
+		return (pa & 0xFFFF0000) | e | (s & 0x7000) | ((s & 0x10) << 11) | 1;// Large page, TEX 14:12, XN 15
+	return (pa & 0xFFFFF000) | e | ((s >> 6) & 0x1C0) | ((s >> 4) & 1) | 2;	// Small page, TEX 8:6, XN 0
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{				   Returns an entry that points to a table					}
+{--------------------------------------------------------------------------*/
+static inline RegType_t TableEntry (RegType_t* table)
+{
+#if __aarch64__ == 1
+	return (0x8000000000000000) | (uintptr_t)table | 3;
+#else
+	return (uintptr_t)table | 1;
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Writes a table entry. AARCH32 table walks do not look in the cache so	}
+{	the line is also cleaned out to memory.									}
+{--------------------------------------------------------------------------*/
+static inline void EntryWrite (RegType_t* entry, RegType_t value)
+{
+	*(volatile RegType_t*)entry = value;
+#if __aarch64__ != 1
+	__asm volatile ("mcr p15, 0, %0, c7, c10, 1" : : "r" (entry) : "memory");	// DCCMVAC
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{		  Waits for table entry writes to be seen by the table walker		}
+{--------------------------------------------------------------------------*/
+static inline void TablesSync (void)
+{
+#if __aarch64__ == 1
+	__asm volatile ("dsb ishst" : : : "memory");
+#else
+	__asm volatile ("dsb" : : : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Returns true if a leaf entry can be executed from at EL1. Another core	}
+{	may hold instructions fetched through it until it next synchronizes.	}
+{--------------------------------------------------------------------------*/
+static inline bool LeafExecutable (RegType_t e, unsigned int level)
+{
+#if __aarch64__ == 1
+	return ((e & ((uint64_t)1 << 53)) == 0);							// PXN clear
+#else
+	if (level == 0) return ((e & 0x10) == 0);							// Section XN clear
+	if ((e & 3) == 1) return ((e & 0x8000) == 0);						// Large page XN clear
+	return ((e & 1) == 0);												// Small page XN clear
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Adds a page to the batch of TLB invalidates. Once the batch is full		}
+{	a whole TLB flush at the end is cheaper than more single invalidates.	}
+{--------------------------------------------------------------------------*/
+static inline void TlbBatchAdd (struct TlbBatch* batch, uintptr_t va)
+{
+	if (batch->count < MMU_TLB_BATCH) batch->va[batch->count++] = va;
+		else batch->all = true;
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes the cleared entries seen by every walker then invalidates the		}
+{	batch with inner shareable broadcasts. The one dsb ish at the end		}
+{	waits for them to complete on all cores, no interrupt is needed. Only	}
+{	entries of the batch ASID go, so other address spaces keep theirs.		}
+{--------------------------------------------------------------------------*/
+static void TlbBatchFlush (struct TlbBatch* batch)
+{
+	if ((batch->count == 0) && !batch->all) return;						// Nothing to invalidate
+	TablesSync();
+#if __aarch64__ == 1
+	RegType_t tag = (RegType_t)batch->asid << 48;						// ASID goes in bits 63:48 of the operand
+	if (batch->all && batch->asid) __asm volatile ("tlbi aside1is, %0" : : "r" (tag) : "memory");
+		else if (batch->all) __asm volatile ("tlbi vmalle1is" : : : "memory");
+		else for (unsigned int i = 0; i < batch->count; i++)
+			__asm volatile ("tlbi vae1is, %0" : : "r" (tag | ((batch->va[i] >> 12) & 0xFFFFFFFFFFFul)) : "memory");
+	__asm volatile ("dsb ish\n\tisb" : : : "memory");
+#else
+	if (batch->all) __asm volatile ("mcr p15, 0, %0, c8, c3, 0" : : "r" (0) : "memory");	// TLBIALLIS
+		else for (unsigned int i = 0; i < batch->count; i++)
+			__asm volatile ("mcr p15, 0, %0, c8, c3, 1" : : "r" (batch->va[i] & ~(PAGE_SIZE - 1)) : "memory");	// TLBIMVAIS
+	__asm volatile ("dsb\n\tisb" : : : "memory");
+#endif
+	batch->count = 0;
+	batch->all = false;
+}
+
+/*--------------------------------------------------------------------------}
+{		   Takes a cleared table from the pool. MMU lock must be held.		}
+{--------------------------------------------------------------------------*/
+static RegType_t* AllocTable (void)
+{
+	uintptr_t pa = PageAlloc(0);
+	if (pa == 0) return 0;												// Pool is empty
+	RegType_t* table = (RegType_t*)pa;
+	for (unsigned int i = 0; i < PAGE_SIZE / sizeof(RegType_t); i++)
+		table[i] = 0;
+#if __aarch64__ != 1
+	cache_clean_range(table, PAGE_SIZE);								// Table walks do not look in the cache
+#endif
+	return table;
+}
+
+/*--------------------------------------------------------------------------}
+{				   Returns true if a table has no valid entry				}
+{--------------------------------------------------------------------------*/
+static bool TableEmpty (RegType_t* table, unsigned int level)
+{
+	for (unsigned int i = 0; i < levelEntries[level]; i++)
+		if (EntryKind(table[i], level) != ENTRY_INVALID) return false;
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{	Checks va to last (inclusive) has nothing mapped. Whole missing tables	}
+{	and invalid entries are stepped over at the level they are found.		}
+{--------------------------------------------------------------------------*/
+static bool RangeUnmapped (RegType_t* root, uintptr_t va, uintptr_t last)
+{
+	for (;;)
+	{
+		RegType_t* t = RootTable(root, va);
+		unsigned int level = 0;
+		int kind;
+		while ((kind = EntryKind(t[TableIndex(va, level)], level)) == ENTRY_TABLE)
+		{
+			t = EntryTable(t[TableIndex(va, level)]);
+			level++;
+		}
+		if (kind == ENTRY_LEAF) return false;							// Something is mapped here
+		uintptr_t end = va | (((uintptr_t)1 << levelShift[level]) - 1);	// Last address the invalid entry covers
+		if (end >= last) return true;
+		va = end + 1;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Checks every leaf in va to last (inclusive) lies wholly inside it so	}
+{	unmapping never has to split a block or contiguous run.					}
+{--------------------------------------------------------------------------*/
+static bool RangeUnmappable (RegType_t* root, uintptr_t va, uintptr_t last)
+{
+	uintptr_t first = va;
+	for (;;)
+	{
+		RegType_t* t = RootTable(root, va);
+		unsigned int level = 0;
+		int kind;
+		while ((kind = EntryKind(t[TableIndex(va, level)], level)) == ENTRY_TABLE)
+		{
+			t = EntryTable(t[TableIndex(va, level)]);
+			level++;
+		}
+		uintptr_t span = (kind == ENTRY_LEAF) ? LeafSpan(t[TableIndex(va, level)], level)
+			: (uintptr_t)1 << levelShift[level];
+		uintptr_t start = va & ~(span - 1);
+		if ((kind == ENTRY_LEAF) && ((start < first) || (last - start < span - 1)))
+			return false;												// Leaf runs past an end of the range
+		uintptr_t end = start + (span - 1);
+		if (end >= last) return true;
+		va = end + 1;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Maps va to last (inclusive) which must be unmapped. Each step uses the	}
+{	largest entry the alignment of va, pa and the size left allows, adding	}
+{	tables on the way down as needed. MMU lock must be held.				}
+{	RETURN: true for success, false if the pool ran out of tables			}
+{--------------------------------------------------------------------------*/
+static bool MapRange (RegType_t* root, uintptr_t va, uintptr_t pa, uintptr_t last, uint32_t attrs)
+{
+	for (;;)
+	{
+		RegType_t* t = RootTable(root, va);
+		unsigned int level = 0;
+		uintptr_t span;
+		for (;;)
+		{
+			span = (uintptr_t)1 << levelShift[level];
+			RegType_t* e = &t[TableIndex(va, level)];
+			if (level == MMU_LEVELS - 1) break;							// Last level is always pages
+			if (((int)level >= BLOCK_LEVEL) && (EntryKind(*e, level) == ENTRY_INVALID)
+				&& (((va | pa) & (span - 1)) == 0) && (last - va >= span - 1))
+				break;													// A whole block fits here
+			if (EntryKind(*e, level) != ENTRY_TABLE)
+			{
+				RegType_t* table = AllocTable();
+				if (table == 0) return false;							// Pool has no page for a table
+				EntryWrite(e, TableEntry(table));
+			}
+			t = EntryTable(*e);
+			level++;
+		}
+		unsigned int count = 1;
+		uintptr_t run = span * CONTIG_ENTRIES;
+		RegType_t* e = &t[TableIndex(va, level)];
+		if (LevelContiguous(level) && (((va | pa) & (run - 1)) == 0) && (last - va >= run - 1))
+		{
+			count = CONTIG_ENTRIES;										// Aligned run of 16 blocks or pages
+			for (unsigned int i = 0; i < CONTIG_ENTRIES; i++)
+				if (EntryKind(e[i], level) != ENTRY_INVALID) count = 1;	// An empty table sits in the run
+		}
+		for (unsigned int i = 0; i < count; i++)
+			EntryWrite(&e[i], LeafEntry(pa + i * span, attrs, level, (count > 1)));
+		if (last - va < count * span) return true;						// That was the end of the range
+		va += count * span;
+		pa += count * span;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Unmaps va to last (inclusive), batching a TLB invalidate for every		}
+{	entry removed. On leaving a table that is now empty, and came from the	}
+{	pool, it is unhooked and the batch flushed before it is given back so	}
+{	no core can still walk through it. MMU lock must be held.				}
+{--------------------------------------------------------------------------*/
+static void UnmapRange (RegType_t* root, uintptr_t va, uintptr_t last, struct TlbBatch* batch)
+{
+	for (;;)
+	{
+		RegType_t* path[MMU_LEVELS];
+		RegType_t* t = RootTable(root, va);
+		unsigned int level = 0;
+		int kind;
+		for (;;)
+		{
+			path[level] = &t[TableIndex(va, level)];
+			kind = EntryKind(*path[level], level);
+			if (kind != ENTRY_TABLE) break;
+			t = EntryTable(*path[level]);
+			level++;
+		}
+		uintptr_t span = (kind == ENTRY_LEAF) ? LeafSpan(*path[level], level)
+			: (uintptr_t)1 << levelShift[level];
+		uintptr_t start = va & ~(span - 1);
+		if (kind == ENTRY_LEAF)
+		{
+			unsigned int count = span >> levelShift[level];				// Entries in a contiguous run, else 1
+			RegType_t* e = &t[TableIndex(start, level)];
+			if (LeafExecutable(*e, level)) batch->exec = true;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				EntryWrite(&e[i], 0);
+				TlbBatchAdd(batch, start + ((uintptr_t)i << levelShift[level]));
+			}
+		}
+		uintptr_t end = start + (span - 1);
+		while ((level > 0) && ((end >= last) ||
+			(((end + 1) & (((uintptr_t)1 << levelShift[level - 1]) - 1)) == 0)))
+		{
+			RegType_t* table = EntryTable(*path[level - 1]);			// Table we are leaving
+			if (!InPagePool((uintptr_t)table) || !TableEmpty(table, level)) break;
+			EntryWrite(path[level - 1], 0);
+			TlbBatchAdd(batch, start);									// Drops any cached walk through it
+			TlbBatchFlush(batch);
+			PageFree((uintptr_t)table);
+			level--;
+		}
+		if (end >= last) break;
+		va = end + 1;
+	}
+	TlbBatchFlush(batch);
+}
 
+/*--------------------------------------------------------------------------}
+{	Checks a virtual range is 4K aligned, does not wrap and lies within		}
+{	the range of one translation table base register.						}
+{--------------------------------------------------------------------------*/
+static bool RangeValid (uintptr_t va, size_t size)
+{
+	if ((size == 0) || ((va | size) & (PAGE_SIZE - 1))) return false;
+	uintptr_t last = va + (size - 1);
+	if (last < va) return false;										// Wraps around
+#if __aarch64__ == 1
+	if (va >= TTBR1_VA_START) return true;
+	return (last < TTBR0_VA_END);
+#else
+	return ((va >= TTBR1_VA_START) == (last >= TTBR1_VA_START));
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Maps a checked range in an address space, all or nothing.				}
+{--------------------------------------------------------------------------*/
+static bool SpaceMap (uint16_t asid, uintptr_t va, uintptr_t pa, size_t size, uint32_t attrs)
+{
+	uintptr_t last = va + (size - 1);
+	struct TlbBatch batch = { .asid = asid };
+	RegType_t state = MmuLock();
+	RegType_t* root = SpaceRoot(asid);
+	bool ok = (root != 0) && RangeUnmapped(root, va, last);				// All or nothing so check first
+	if (ok && !MapRange(root, va, pa, last, attrs))
+	{
+		UnmapRange(root, va, last, &batch);								// Ran out of tables so undo what was done
+		ok = false;
+	}
+	TablesSync();														// New entries were invalid so no TLB invalidate
+	MmuUnlock(state);
+	if (batch.exec && coreSync) coreSync();								// Undone entries were executable
+	return ok;
+}
 
-/* Stage3 ... Virtual mapping stage3 (final) ... basic minimum of a single table */
-static __attribute__((aligned(TLB_ALIGNMENT))) VMSAv8_64_DESCRIPTOR Stage3virtual[512] = { 0 };
+/*--------------------------------------------------------------------------}
+{				Unmaps a checked range in an address space.					}
+{--------------------------------------------------------------------------*/
+static bool SpaceUnmap (uint16_t asid, uintptr_t va, size_t size)
+{
+	uintptr_t last = va + (size - 1);
+	struct TlbBatch batch = { .asid = asid };
+	RegType_t state = MmuLock();
+	RegType_t* root = SpaceRoot(asid);
+	bool ok = (root != 0) && RangeUnmappable(root, va, last);			// All or nothing so check first
+	if (ok) UnmapRange(root, va, last, &batch);
+	MmuUnlock(state);
+	if (batch.exec && coreSync) coreSync();								// Outside the lock as it waits on other cores
+	return ok;
+}
 
+/*--------------------------------------------------------------------------}
+{	Checks a virtual range for an address space. It must be 4K aligned in	}
+{	the TTBR0 range above the 2GB kernel map every space shares.			}
+{--------------------------------------------------------------------------*/
+static bool SpaceRangeValid (uint16_t asid, uintptr_t va, size_t size)
+{
+#if __aarch64__ == 1
+	if ((asid == 0) || (asid >= MMU_ASIDS) || !RangeValid(va, size)) return false;
+	return ((va >= SPACE_VA_START) && (va < TTBR0_VA_END));
+#else
+	(void)asid; (void)va; (void)size;
+	return false;														// No address spaces on AARCH32
+#endif
+}
+
+#if __aarch64__ == 1
+/*--------------------------------------------------------------------------}
+{	Marks each aligned run of 16 leaf entries in a table contiguous where	}
+{	they map one physically contiguous aligned range with the same			}
+{	attributes, so the whole run takes a single TLB entry.					}
+{--------------------------------------------------------------------------*/
+static void MarkContiguous (RegType_t* table, unsigned int entries, unsigned int level)
+{
+	uintptr_t span = (uintptr_t)1 << levelShift[level];
+	for (unsigned int i = 0; i + CONTIG_ENTRIES <= entries; i += CONTIG_ENTRIES)
+	{
+		RegType_t first = table[i];
+		if ((EntryKind(first, level) != ENTRY_LEAF) ||
+			((first & DESC_ADDR_MASK) & (span * CONTIG_ENTRIES - 1))) continue;
+		unsigned int j = 1;
+		while ((j < CONTIG_ENTRIES) && (table[i + j] == first + j * span)) j++;
+		if (j < CONTIG_ENTRIES) continue;								// Run breaks somewhere
+		for (j = 0; j < CONTIG_ENTRIES; j++)
+			table[i + j] |= DESC_CONTIGUOUS;
+	}
+}
 #endif
 
 /*-[ MMU_setup_pagetable ]--------------------------------------------------}
@@ -152,30 +846,21 @@ void MMU_setup_pagetable (void)
 		};
 	}
 
-	// 2 MB for mailboxes at 0x40000000
-	// shared device, never execute
-	Stage2map1to1[512] = (VMSAv8_64_DESCRIPTOR){
-		.Address = (uintptr_t)512 << (21 - 12),
+	// Aligned runs of 16 blocks with the same attributes share one TLB entry
+	MarkContiguous((RegType_t*)&Stage2map1to1[0], 512, 1);
+
+	// Level 1 has just 2 valid entries, the first 1GB through stage2 and
+	// the second 1GB holding the mailboxes at 0x40000000 as one device block
+	page_table_map1to1[0] = (0x8000000000000000) | (uintptr_t)&Stage2map1to1[0] | 3;
+	page_table_map1to1[1] = (VMSAv8_64_DESCRIPTOR){
+		.Address = (uintptr_t)1 << (30 - 12),
 		.AF = 1,
 		.MemAttr = MT_DEVICE_NGNRNE,
 		.EntryType = 1
-	};
+	}.Raw64;
 
-	// Level 1 has just 2 valid entries mapping the each 1GB in stage2 to cover the 2GB
-	page_table_map1to1[0] = (0x8000000000000000) | (uintptr_t)&Stage2map1to1[0] | 3;
-	page_table_map1to1[1] = (0x8000000000000000) | (uintptr_t)&Stage2map1to1[512] | 3;
-
-
-	// Initialize virtual mapping for TTBR1 .. basic 1 page  .. 512 entries x 4K pages
-	// 2MB of ram memory memory  0xFFFFFFFFFFE00000 to 0xFFFFFFFFFFFFFFFF
 
-	// Stage2 virtual has just 1 valid entry (the last) of the 512 entries pointing to the Stage3 virtual table
-	// Stage 3 starts as all invalid they will be added by mapping call
-	//Stage2virtual[511] = (VMSAv8_64_DESCRIPTOR){ .NSTable = 1,.Address = (uintptr_t)& Stage3virtual[0] >> 12,.EntryType = 3 };
-	Stage2virtual[511] = (0x8000000000000000) | (uintptr_t)& Stage3virtual[0] | 3;
-
-	// Stage1 virtual has just 1 valid entry (the last) of 512 entries pointing to the Stage2 virtual table
-	page_table_virtualmap[511] = (0x8000000000000000) | (uintptr_t)& Stage2virtual[0] | 3;
+	// Virtual mapping for TTBR1 starts empty, MMU_map adds tables from the page pool as needed
 
 #else
 
@@ -194,9 +879,7 @@ void MMU_setup_pagetable (void)
 		page_table_map1to1[base] = base << 20 | MT_DEVICE_NS;
 	}
 
-	// Stage1 virtual has just 2 valid entry (the last 2) of 512 entries pointing to the Stage2 virtual tables
-	page_table_virtualmap[4094] = (uintptr_t)&Stage2virtual[0] | (1 << 10);
-	page_table_virtualmap[4095] = (uintptr_t)& Stage2virtual[256] | (1 << 10);
+	// Virtual mapping for TTBR1 starts empty, MMU_map adds tables from the page pool as needed
 
 #endif
 
@@ -211,21 +894,313 @@ void MMU_enable (void)
 }
 
 
+/*-[ MMU_page_pool_init ]---------------------------------------------------}
+.  Sets up the page pool just below the VideoCore split reported by the
+.  GET_VC_MEMORY tag. Called by xRTOS_Init before any task is created, as
+.  task stacks come from the pool, so must not be called by user code.
+.  RETURN: true for success, false if there is no room for the pool
+.--------------------------------------------------------------------------*/
+bool MMU_page_pool_init (void)
+{
+	uint32_t msg[5] = { 0 };
+	if (pagePool.pages) return true;									// Already set up
+	if (!mailbox_tag_message(&msg[0], 5, MAILBOX_TAG_GET_VC_MEMORY, 8, 8, 0, 0))
+		return false;													// msg[3] has VC base addr msg[4] = VC memory size
+	PagePoolInit(msg[3]);												// Page pool sits just below the VC split
+	return (pagePool.pages != 0);
+}
+
+/*-[ MMU_page_alloc ]-------------------------------------------------------}
+.  Allocates 2^order physically contiguous 4K page frames from the page pool
+.  at the top of ARM RAM, aligned to their own size. Order 9 is 2MB which is
+.  the largest. The frames are not cleared. May be called from any core.
+.  RETURN: Physical address of the first frame, 0 if there is no free block
+.--------------------------------------------------------------------------*/
+uintptr_t MMU_page_alloc (unsigned int order)
+{
+	if (order > PAGE_MAX_ORDER) return 0;								// Bigger than any block
+	RegType_t state = MmuLock();
+	uintptr_t pa = PageAlloc(order);
+	MmuUnlock(state);
+	return pa;
+}
+
+/*-[ MMU_page_free ]--------------------------------------------------------}
+.  Frees a block from MMU_page_alloc, merging it with its free buddies.
+.  RETURN: true for success, false if pa is not an allocated block
+.--------------------------------------------------------------------------*/
+bool MMU_page_free (uintptr_t pa)
+{
+	RegType_t state = MmuLock();
+	bool ok = PageFree(pa);
+	MmuUnlock(state);
+	return ok;
+}
+
+/*-[ MMU_page_free_count ]--------------------------------------------------}
+.  RETURN: Number of 4K page frames free in the page pool
+.--------------------------------------------------------------------------*/
+unsigned int MMU_page_free_count (void)
+{
+	return pagePool.freePages;
+}
+
+/*-[ MMU_map ]--------------------------------------------------------------}
+.  Maps size bytes of physical memory at pa to the virtual address va with
+.  a memory type MT_xxx and optional MMU_READONLY and MMU_NOEXEC flags. The
+.  addresses and size must be 4K aligned and the whole range unmapped. Any
+.  tables needed are taken from the page pool, and the largest entries the
+.  alignment allows are used: blocks, then aligned runs of 16 pages marked
+.  contiguous, then single pages. On AARCH64 va may be in the TTBR0 range
+.  above the 1:1 map or in the top 512GB from TTBR1, on AARCH32 it must be
+.  at or above 2GB from TTBR1.
+.  RETURN: true for success, false for a bad or used range or no tables
+.--------------------------------------------------------------------------*/
+bool MMU_map (uintptr_t va, uintptr_t pa, size_t size, uint32_t attrs)
+{
+	if (!RangeValid(va, size) || (pa & (PAGE_SIZE - 1)) || (pa + (size - 1) < pa))
+		return false;													// Bad range
+	return SpaceMap(0, va, pa, size, attrs & ~ATTR_NOT_GLOBAL);
+}
+
+/*-[ MMU_unmap ]------------------------------------------------------------}
+.  Unmaps size bytes at the 4K aligned virtual address va and gives empty
+.  tables back to the pool. The TLB invalidates are batched and broadcast
+.  to every core, so on return no core can use the old mapping. If any of
+.  it was executable every other core is also made to synchronize, so that
+.  must be done from a task. A block or contiguous run MMU_map made must be
+.  unmapped whole, so map separately what will be unmapped separately.
+.  RETURN: true for success, false for a bad range or one that splits a run
+.--------------------------------------------------------------------------*/
+bool MMU_unmap (uintptr_t va, size_t size)
+{
+	if (!RangeValid(va, size)) return false;							// Bad range
+	return SpaceUnmap(0, va, size);
+}
+
+/*-[ MMU_space_create ]-----------------------------------------------------}
+.  Creates an address space with its own level 1 table from the page pool
+.  and a free 8 bit ASID. It shares the kernel 1:1 map of the bottom 2GB
+.  and the TTBR1 range, the rest of the TTBR0 range is private to it.
+.  Private entries are not global so are tagged in the TLB with the ASID,
+.  and switching spaces is a TTBR0 write with no TLB flush. Only AARCH64.
+.  RETURN: ASID of the new space, 0 if none is free or no table is left
+.--------------------------------------------------------------------------*/
+uint16_t MMU_space_create (void)
+{
+	uint16_t asid = 0;
 #if __aarch64__ == 1
-RegType_t virtualmap (uint32_t phys_addr, uint8_t memattrs) {
-	uint64_t addr = 0;
-	for (int i = 0; i < 512; i++)
+	RegType_t state = MmuLock();
+	for (asid = 1; (asid < MMU_ASIDS) && spaceRoot[asid]; asid++);		// Find a free ASID
+	RegType_t* root = (asid < MMU_ASIDS) ? AllocTable() : 0;
+	if (root)
 	{
-		if (Stage3virtual[i].Raw64 == 0) {							// Find the first vacant stage3 table slot
-			uint64_t offset;
-			Stage3virtual[i] = (VMSAv8_64_DESCRIPTOR) { .Address = (uintptr_t)phys_addr << (21 - 12), .AF = 1, .MemAttr = memattrs, .EntryType = 3 };
-			__asm volatile ("dmb sy" ::: "memory");
-			offset = ((512 - i) * 4096) - 1;
-			addr = 0xFFFFFFFFFFFFFFFFul;
-			addr = addr - offset;
-			return(addr);
-		}
+		for (unsigned int i = 0; i < (SPACE_VA_START >> levelShift[0]); i++)
+			root[i] = page_table_map1to1[i];							// Share the kernel 1:1 map
+		spaceRoot[asid] = root;
+	} else asid = 0;													// No ASID or table left
+	TablesSync();
+	MmuUnlock(state);
+#endif
+	return asid;
+}
+
+/*-[ MMU_space_destroy ]----------------------------------------------------}
+.  Unmaps all that is left in an address space, gives its tables back to
+.  the pool and invalidates its ASID on every core so it can be used again.
+.  No task may still be using the space.
+.  RETURN: true for success, false if there is no such space
+.--------------------------------------------------------------------------*/
+bool MMU_space_destroy (uint16_t asid)
+{
+#if __aarch64__ == 1
+	if ((asid == 0) || (asid >= MMU_ASIDS)) return false;				// Kernel map can not go
+	struct TlbBatch batch = { .asid = asid };
+	RegType_t state = MmuLock();
+	RegType_t* root = spaceRoot[asid];
+	if (root)
+	{
+		UnmapRange(root, SPACE_VA_START, TTBR0_VA_END - 1, &batch);	// Every leaf lies wholly in the private range
+		batch.all = true;
+		TlbBatchFlush(&batch);											// Drops anything still cached for the ASID
+		spaceRoot[asid] = 0;
+		PageFree((uintptr_t)root);
 	}
-	return (addr);													// error
+	MmuUnlock(state);
+	if (batch.exec && coreSync) coreSync();								// Outside the lock as it waits on other cores
+	return (root != 0);
+#else
+	(void)asid;
+	return false;
+#endif
 }
-#endif
\ No newline at end of file
+
+/*-[ MMU_space_map ]--------------------------------------------------------}
+.  As MMU_map for an address space. The 4K aligned va must be at or above
+.  2GB and below 512GB, the private range of the space. Kernel mappings
+.  MMU_map made in that range are not seen by the space, so map memory all
+.  tasks share in the TTBR1 range.
+.  RETURN: true for success, false for a bad or used range, no such space
+.		   or no tables
+.--------------------------------------------------------------------------*/
+bool MMU_space_map (uint16_t asid, uintptr_t va, uintptr_t pa, size_t size, uint32_t attrs)
+{
+	if (!SpaceRangeValid(asid, va, size) || (pa & (PAGE_SIZE - 1)) || (pa + (size - 1) < pa))
+		return false;													// Bad space or range
+	return SpaceMap(asid, va, pa, size, attrs | ATTR_NOT_GLOBAL);
+}
+
+/*-[ MMU_space_unmap ]------------------------------------------------------}
+.  As MMU_unmap for an address space. Only the TLB entries of its ASID are
+.  invalidated so the other spaces and the kernel map keep theirs.
+.  RETURN: true for success, false for a bad range or no such space
+.--------------------------------------------------------------------------*/
+bool MMU_space_unmap (uint16_t asid, uintptr_t va, size_t size)
+{
+	if (!SpaceRangeValid(asid, va, size)) return false;					// Bad space or range
+	return SpaceUnmap(asid, va, size);
+}
+
+/*-[ MMU_space_ttbr0 ]------------------------------------------------------}
+.  RETURN: The TTBR0 value for an address space, ASID in bits 63:48 over its
+.		   level 1 table, ASID 0 gives the kernel map, 0 if no such space
+.--------------------------------------------------------------------------*/
+RegType_t MMU_space_ttbr0 (uint16_t asid)
+{
+	RegType_t state = MmuLock();
+	RegType_t ttbr0 = (RegType_t)(uintptr_t)SpaceRoot(asid);
+#if __aarch64__ == 1
+	if (ttbr0) ttbr0 |= (RegType_t)asid << 48;
+#endif
+	MmuUnlock(state);
+	return ttbr0;
+}
+
+/*-[ MMU_set_ttbr0 ]--------------------------------------------------------}
+.  Switches this core to the address space of a TTBR0 value from
+.  MMU_space_ttbr0. The kernel does this as it switches tasks.
+.--------------------------------------------------------------------------*/
+void MMU_set_ttbr0 (RegType_t ttbr0)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr ttbr0_el1, %0\n\tisb" : : "r" (ttbr0) : "memory");
+#else
+	(void)ttbr0;														// AARCH32 keeps the kernel map
+#endif
+}
+
+/*-[ MMU_set_core_sync ]----------------------------------------------------}
+.  Sets the function MMU_unmap calls, outside the MMU lock, after removing
+.  an executable mapping. It must make every other running core take a
+.  context synchronization event and wait until they all have, as they may
+.  hold instructions fetched through the old mapping. The TLB broadcast
+.  cannot do that. The kernel sets it to a waited core call on each core.
+.--------------------------------------------------------------------------*/
+void MMU_set_core_sync (void (*sync) (void))
+{
+	coreSync = sync;
+}
+
+/*--------------------------------------------------------------------------}
+{	Starts PMU counter 0 on event 0x05, L1 data TLB refill, and the cycle	}
+{	counter, both from zero.												}
+{--------------------------------------------------------------------------*/
+static void PmuStart (void)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr pmcr_el0, %0" : : "r" ((RegType_t)0x7) : "memory");	// Enable, reset counters and cycle count
+	__asm volatile ("msr pmselr_el0, %0" : : "r" ((RegType_t)0) : "memory");
+	__asm volatile ("msr pmxevtyper_el0, %0" : : "r" ((RegType_t)0x05) : "memory");
+	__asm volatile ("msr pmcntenset_el0, %0" : : "r" ((RegType_t)0x80000001) : "memory");
+#else
+	__asm volatile ("mcr p15, 0, %0, c9, c12, 0" : : "r" (0x7) : "memory");	// PMCR enable, reset counters and cycle count
+	__asm volatile ("mcr p15, 0, %0, c9, c12, 5" : : "r" (0) : "memory");		// PMSELR
+	__asm volatile ("mcr p15, 0, %0, c9, c13, 1" : : "r" (0x05) : "memory");	// PMXEVTYPER
+	__asm volatile ("mcr p15, 0, %0, c9, c12, 1" : : "r" (0x80000001) : "memory");// PMCNTENSET
+#endif
+	__asm volatile ("isb" : : : "memory");
+}
+
+/*--------------------------------------------------------------------------}
+{			  Reads PMU counter 0 and the cycle counter						}
+{--------------------------------------------------------------------------*/
+static void PmuRead (uint32_t* events, uint32_t* cycles)
+{
+	RegType_t ev, cy;
+	__asm volatile ("isb" : : : "memory");
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, pmevcntr0_el0" : "=r" (ev));
+	__asm volatile ("mrs %0, pmccntr_el0" : "=r" (cy));
+#else
+	__asm volatile ("mrc p15, 0, %0, c9, c13, 2" : "=r" (ev));				// PMXEVCNTR of counter 0
+	__asm volatile ("mrc p15, 0, %0, c9, c13, 0" : "=r" (cy));				// PMCCNTR
+#endif
+	*events = ev;
+	*cycles = cy;
+}
+
+/*--------------------------------------------------------------------------}
+{	Flushes this core TLB, then times passes over the 2MB at va reading		}
+{	one word from each page. Interrupts are masked by the caller.			}
+{--------------------------------------------------------------------------*/
+static void TlbBenchRun (uintptr_t va, unsigned int passes, uint32_t* refills, uint32_t* cycles)
+{
+#if __aarch64__ == 1
+	__asm volatile ("dsb ish\n\ttlbi vmalle1\n\tdsb ish\n\tisb" : : : "memory");
+#else
+	__asm volatile ("dsb\n\tmcr p15, 0, %0, c8, c7, 0\n\tdsb\n\tisb" : : "r" (0) : "memory");	// TLBIALL
+#endif
+	uint32_t sum = 0;
+	PmuStart();
+	for (unsigned int p = 0; p < passes; p++)
+		for (uintptr_t off = 0; off < (PAGE_SIZE << PAGE_MAX_ORDER); off += PAGE_SIZE)
+			sum += *(volatile uint32_t*)(va + off);
+	PmuRead(refills, cycles);
+	(void)sum;
+}
+
+/*-[ MMU_tlb_benchmark ]----------------------------------------------------}
+.  Measures the L1 data TLB refills (PMU event 0x05) and cycles for passes
+.  over a 2MB buffer from the page pool, touching one word in every 4K page.
+.  The same frames are mapped three ways in TTBR1: as single 4K pages, as
+.  runs of 16 contiguous pages, and as one 2MB block. The TLB is flushed
+.  before each and interrupts are masked while it runs, which takes a few
+.  milliseconds. Call from a task once the scheduler is running.
+.  RETURN: true for success, false if the buffer could not be mapped
+.--------------------------------------------------------------------------*/
+bool MMU_tlb_benchmark (unsigned int passes, MmuTlbBench_t* result)
+{
+	const uintptr_t size = PAGE_SIZE << PAGE_MAX_ORDER;					// 2MB buffer
+	const uintptr_t va[MMU_BENCH_MAPS] = {
+		TTBR1_VA_START + PAGE_SIZE,										// Off 64K alignment so only single pages
+		TTBR1_VA_START + 2 * size + CONTIG_ENTRIES * PAGE_SIZE,			// 64K aligned so contiguous runs
+		TTBR1_VA_START + 4 * size,										// 2MB aligned so one block
+	};
+	if (result == 0) return false;
+	uintptr_t pa = MMU_page_alloc(PAGE_MAX_ORDER);
+	if (pa == 0) return false;											// Pool has no 2MB block
+	int mapped = 0;
+	while ((mapped < MMU_BENCH_MAPS) && MMU_map(va[mapped], pa, size, MT_NORMAL | MMU_NOEXEC))
+		mapped++;
+	if (mapped == MMU_BENCH_MAPS)
+	{
+		RegType_t state;
+#if __aarch64__ == 1
+		__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+		__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+		for (int i = 0; i < MMU_BENCH_MAPS; i++)
+			TlbBenchRun(va[i], passes, &result->refills[i], &result->cycles[i]);
+#if __aarch64__ == 1
+		__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+		__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+	}
+	for (int i = 0; i < mapped; i++)
+		MMU_unmap(va[i], size);
+	MMU_page_free(pa);
+	return (mapped == MMU_BENCH_MAPS);
+}
+
@@ -4,6 +4,8 @@
 #ifdef __cplusplus								// If we are including to a C++
 extern "C" {									// Put extern C directive wrapper around
 #endif
+#include <stdbool.h>							// Needed for bool
+#include <stddef.h>								// Needed for size_t
 #include <stdint.h>								// Needed for uint8_t, uint32_t, etc
 #include "rpi-SmartStart.h"						// Needed for RegType_t
 
@@ -13,6 +15,7 @@ extern "C" {									// Put extern C directive wrapper around
 #define MT_DEVICE_GRE		2
 #define MT_NORMAL_NC		3
 #define MT_NORMAL		    4
+#define MMU_MT_MASK			0x7					//	memory type bits of MMU_map attrs
 #else
 #define MT_DEVICE_NS  0x10412					//  device no share (strongly ordered)
 #define MT_DEVICE     0x10416                   //  device + shareable
@@ -22,6 +25,19 @@ extern "C" {									// Put extern C directive wrapper around
 
 #endif
 
+/* Flags that may be or'ed with a memory type above for MMU_map */
+#define MMU_READONLY		0x80000000			//  no write access
+#define MMU_NOEXEC			0x40000000			//  execute never, device memory is always execute never
+
+/* Physical RAM kept below the VideoCore split for the page frame allocator */
+#ifndef MMU_PAGE_POOL_SIZE
+#define MMU_PAGE_POOL_SIZE	0x1000000			//  16MB, must be a multiple of 2MB
+#endif
+#ifndef MMU_TLB_BATCH
+#define MMU_TLB_BATCH		32					//  pages invalidated singly by one call before the whole TLB is flushed instead
+#endif
+#define MMU_PAGE_POOL_BASE(vcBase)	(((uintptr_t)(vcBase) - MMU_PAGE_POOL_SIZE) & ~(uintptr_t)0x1FFFFF)
+
 /*-[ MMU_setup_pagetable ]--------------------------------------------------}
 .  Sets up a default TLB table. This needs to be called by only once by one 
 .  core on a multicore system. Each core can use the same default table.
@@ -34,10 +50,134 @@ void MMU_setup_pagetable (void);
 .--------------------------------------------------------------------------*/
 void MMU_enable(void);
 
+/*-[ MMU_page_pool_init ]---------------------------------------------------}
+.  Sets up the page pool just below the VideoCore split reported by the
+.  GET_VC_MEMORY tag. Called by xRTOS_Init before any task is created, as
+.  task stacks come from the pool, so must not be called by user code.
+.  RETURN: true for success, false if there is no room for the pool
+.--------------------------------------------------------------------------*/
+bool MMU_page_pool_init (void);
 
-#if __aarch64__ == 1
-RegType_t virtualmap (uint32_t phys_addr, uint8_t memattrs);
-#endif
+/*-[ MMU_page_alloc ]-------------------------------------------------------}
+.  Allocates 2^order physically contiguous 4K page frames from the page pool
+.  at the top of ARM RAM, aligned to their own size. Order 9 is 2MB which is
+.  the largest. The frames are not cleared. May be called from any core.
+.  RETURN: Physical address of the first frame, 0 if there is no free block
+.--------------------------------------------------------------------------*/
+uintptr_t MMU_page_alloc (unsigned int order);
+
+/*-[ MMU_page_free ]--------------------------------------------------------}
+.  Frees a block from MMU_page_alloc, merging it with its free buddies.
+.  RETURN: true for success, false if pa is not an allocated block
+.--------------------------------------------------------------------------*/
+bool MMU_page_free (uintptr_t pa);
+
+/*-[ MMU_page_free_count ]--------------------------------------------------}
+.  RETURN: Number of 4K page frames free in the page pool
+.--------------------------------------------------------------------------*/
+unsigned int MMU_page_free_count (void);
+
+/*-[ MMU_map ]--------------------------------------------------------------}
+.  Maps size bytes of physical memory at pa to the virtual address va with
+.  a memory type MT_xxx and optional MMU_READONLY and MMU_NOEXEC flags. The
+.  addresses and size must be 4K aligned and the whole range unmapped. Any
+.  tables needed are taken from the page pool, and the largest entries the
+.  alignment allows are used: blocks, then aligned runs of 16 pages marked
+.  contiguous, then single pages. On AARCH64 va may be in the TTBR0 range
+.  above the 1:1 map or in the top 512GB from TTBR1, on AARCH32 it must be
+.  at or above 2GB from TTBR1.
+.  RETURN: true for success, false for a bad or used range or no tables
+.--------------------------------------------------------------------------*/
+bool MMU_map (uintptr_t va, uintptr_t pa, size_t size, uint32_t attrs);
+
+/*-[ MMU_unmap ]------------------------------------------------------------}
+.  Unmaps size bytes at the 4K aligned virtual address va and gives empty
+.  tables back to the pool. The TLB invalidates are batched and broadcast
+.  to every core, so on return no core can use the old mapping. If any of
+.  it was executable every other core is also made to synchronize, so that
+.  must be done from a task. A block or contiguous run MMU_map made must be
+.  unmapped whole, so map separately what will be unmapped separately.
+.  RETURN: true for success, false for a bad range or one that splits a run
+.--------------------------------------------------------------------------*/
+bool MMU_unmap (uintptr_t va, size_t size);
+
+/*-[ MMU_space_create ]-----------------------------------------------------}
+.  Creates an address space with its own level 1 table from the page pool
+.  and a free 8 bit ASID. It shares the kernel 1:1 map of the bottom 2GB
+.  and the TTBR1 range, the rest of the TTBR0 range is private to it.
+.  Private entries are not global so are tagged in the TLB with the ASID,
+.  and switching spaces is a TTBR0 write with no TLB flush. Only AARCH64.
+.  RETURN: ASID of the new space, 0 if none is free or no table is left
+.--------------------------------------------------------------------------*/
+uint16_t MMU_space_create (void);
+
+/*-[ MMU_space_destroy ]----------------------------------------------------}
+.  Unmaps all that is left in an address space, gives its tables back to
+.  the pool and invalidates its ASID on every core so it can be used again.
+.  No task may still be using the space.
+.  RETURN: true for success, false if there is no such space
+.--------------------------------------------------------------------------*/
+bool MMU_space_destroy (uint16_t asid);
+
+/*-[ MMU_space_map ]--------------------------------------------------------}
+.  As MMU_map for an address space. The 4K aligned va must be at or above
+.  2GB and below 512GB, the private range of the space. Kernel mappings
+.  MMU_map made in that range are not seen by the space, so map memory all
+.  tasks share in the TTBR1 range.
+.  RETURN: true for success, false for a bad or used range, no such space
+.		   or no tables
+.--------------------------------------------------------------------------*/
+bool MMU_space_map (uint16_t asid, uintptr_t va, uintptr_t pa, size_t size, uint32_t attrs);
+
+/*-[ MMU_space_unmap ]------------------------------------------------------}
+.  As MMU_unmap for an address space. Only the TLB entries of its ASID are
+.  invalidated so the other spaces and the kernel map keep theirs.
+.  RETURN: true for success, false for a bad range or no such space
+.--------------------------------------------------------------------------*/
+bool MMU_space_unmap (uint16_t asid, uintptr_t va, size_t size);
+
+/*-[ MMU_space_ttbr0 ]------------------------------------------------------}
+.  RETURN: The TTBR0 value for an address space, ASID in bits 63:48 over its
+.		   level 1 table, ASID 0 gives the kernel map, 0 if no such space
+.--------------------------------------------------------------------------*/
+RegType_t MMU_space_ttbr0 (uint16_t asid);
+
+/*-[ MMU_set_ttbr0 ]--------------------------------------------------------}
+.  Switches this core to the address space of a TTBR0 value from
+.  MMU_space_ttbr0. The kernel does this as it switches tasks.
+.--------------------------------------------------------------------------*/
+void MMU_set_ttbr0 (RegType_t ttbr0);
+
+/*--------------------------------------------------------------------------}
+{					   TLB BENCHMARK RESULT STRUCTURE						}
+{--------------------------------------------------------------------------*/
+enum { MMU_BENCH_PAGES, MMU_BENCH_CONTIGUOUS, MMU_BENCH_BLOCK, MMU_BENCH_MAPS };
+
+typedef struct MmuTlbBench
+{
+	uint32_t refills[MMU_BENCH_MAPS];			// L1 data TLB refills with each mapping
+	uint32_t cycles[MMU_BENCH_MAPS];			// CPU cycles with each mapping
+} MmuTlbBench_t;
+
+/*-[ MMU_tlb_benchmark ]----------------------------------------------------}
+.  Measures the L1 data TLB refills (PMU event 0x05) and cycles for passes
+.  over a 2MB buffer from the page pool, touching one word in every 4K page.
+.  The same frames are mapped three ways in TTBR1: as single 4K pages, as
+.  runs of 16 contiguous pages, and as one 2MB block. The TLB is flushed
+.  before each and interrupts are masked while it runs, which takes a few
+.  milliseconds. Call from a task once the scheduler is running.
+.  RETURN: true for success, false if the buffer could not be mapped
+.--------------------------------------------------------------------------*/
+bool MMU_tlb_benchmark (unsigned int passes, MmuTlbBench_t* result);
+
+/*-[ MMU_set_core_sync ]----------------------------------------------------}
+.  Sets the function MMU_unmap calls, outside the MMU lock, after removing
+.  an executable mapping. It must make every other running core take a
+.  context synchronization event and wait until they all have, as they may
+.  hold instructions fetched through the old mapping. The TLB broadcast
+.  cannot do that. The kernel sets it to a waited core call on each core.
+.--------------------------------------------------------------------------*/
+void MMU_set_core_sync (void (*sync) (void));
 
 #ifdef __cplusplus								// If we are including to a C++ file
 }												// Close the extern C directive wrapper
@@ -870,6 +870,90 @@ uint64_t tick_difference (uint64_t us1, uint64_t us2)
 }
 
 
+/*==========================================================================}
+{	   PUBLIC CACHE MAINTENANCE ROUTINES PROVIDED BY RPi-SmartStart API		}
+{==========================================================================*/
+
+/*--------------------------------------------------------------------------}
+{	Returns the smallest data cache line size from DminLine in the cache	}
+{	type register, which holds log2 of the line size in words.				}
+{--------------------------------------------------------------------------*/
+static inline uintptr_t cache_line_size (void)
+{
+	RegType_t ctr;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, ctr_el0" : "=r" (ctr));
+#else
+	__asm volatile ("mrc p15, 0, %0, c0, c0, 1" : "=r" (ctr));		// CTR
+#endif
+	return (uintptr_t)4 << ((ctr >> 16) & 0xF);
+}
+
+/*-[cache_clean_range]------------------------------------------------------}
+. Cleans every data cache line the range touches out to the point of
+. coherency, so a DMA master or the GPU reading the memory sees what the
+. CPU wrote. The lines stay valid. Call before a device reads a buffer.
+.--------------------------------------------------------------------------*/
+void cache_clean_range (const void* start, size_t size)
+{
+	if (size == 0) return;											// Nothing to clean
+	uintptr_t line = cache_line_size();
+	uintptr_t end = (uintptr_t)start + size;
+	for (uintptr_t addr = (uintptr_t)start & ~(line - 1); addr < end; addr += line)
+#if __aarch64__ == 1
+		__asm volatile ("dc cvac, %0" : : "r" (addr) : "memory");	// Clean to point of coherency
+#else
+		__asm volatile ("mcr p15, 0, %0, c7, c10, 1" : : "r" (addr) : "memory");	// DCCMVAC
+#endif
+	__asm volatile ("dsb sy" : : : "memory");						// Complete before the device is started
+}
+
+/*-[cache_invalidate_range]-------------------------------------------------}
+. Invalidates every data cache line the range touches, so the CPU reads
+. what a DMA master or the GPU wrote to the memory. A line only partly in
+. the range is cleaned and invalidated so data around the range is kept,
+. buffers a device writes are best whole cache lines. Call after a device
+. has written a buffer and before the CPU reads it.
+.--------------------------------------------------------------------------*/
+void cache_invalidate_range (void* start, size_t size)
+{
+	if (size == 0) return;											// Nothing to invalidate
+	uintptr_t line = cache_line_size();
+	uintptr_t addr = (uintptr_t)start & ~(line - 1);
+	uintptr_t end = (uintptr_t)start + size;
+	for (; addr < end; addr += line)
+	{
+		if ((addr < (uintptr_t)start) || (addr + line > end))		// Line shared with data outside the range
+#if __aarch64__ == 1
+			__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");
+			else __asm volatile ("dc ivac, %0" : : "r" (addr) : "memory");
+#else
+			__asm volatile ("mcr p15, 0, %0, c7, c14, 1" : : "r" (addr) : "memory");	// DCCIMVAC
+			else __asm volatile ("mcr p15, 0, %0, c7, c6, 1" : : "r" (addr) : "memory");// DCIMVAC
+#endif
+	}
+	__asm volatile ("dsb sy" : : : "memory");						// Complete before the CPU reads the buffer
+}
+
+/*-[cache_flush_range]------------------------------------------------------}
+. Cleans and invalidates every data cache line the range touches. Use it on
+. a buffer a device both reads and writes, such as a mailbox message.
+.--------------------------------------------------------------------------*/
+void cache_flush_range (const void* start, size_t size)
+{
+	if (size == 0) return;											// Nothing to flush
+	uintptr_t line = cache_line_size();
+	uintptr_t end = (uintptr_t)start + size;
+	for (uintptr_t addr = (uintptr_t)start & ~(line - 1); addr < end; addr += line)
+#if __aarch64__ == 1
+		__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");	// Clean and invalidate to point of coherency
+#else
+		__asm volatile ("mcr p15, 0, %0, c7, c14, 1" : : "r" (addr) : "memory");	// DCCIMVAC
+#endif
+	__asm volatile ("dsb sy" : : : "memory");						// Complete before the device is started
+}
+
+
 /*==========================================================================}
 {		  PUBLIC PI MAILBOX ROUTINES PROVIDED BY RPi-SmartStart API			}
 {==========================================================================*/
@@ -914,12 +998,20 @@ uint32_t mailbox_read (MAILBOX_CHANNEL channel)
 	return 0xFEEDDEAD;												// Channel was invalid
 }
 
+static volatile uint32_t mailbox_lock = 0;							// Held over a tag message once the MMU is on
+static uint32_t __attribute__((aligned(64))) mailbox_message[(255 + 3 + 15) & ~15];// Largest tag message in whole 64 byte cache lines, in the 1:1 map
+
 /*-[mailbox_tag_message]----------------------------------------------------}
 . This will post and execute the given variadic data onto the tags channel
 . on the mailbox system. You must provide the correct number of response
 . uint32_t variables and a pointer to the response buffer. You nominate the
 . number of data uint32_t for the call and fill the variadic data in. If you
 . do not want the response data back the use NULL for response_buf pointer.
+. The message is built in one static buffer in the 1:1 map, never on the
+. stack, as task stacks are mapped in the TTBR1 range where the address is
+. not the one the GPU must be given. Once the MMU is on a spin lock is held
+. from filling the buffer to reading the reply out so tasks on any core may
+. use it, the reply can not go to the wrong caller.
 . RETURN: True for success and the response data will be set with data
 .         False for failure and the response buffer is untouched.
 .--------------------------------------------------------------------------*/
@@ -927,8 +1019,17 @@ bool mailbox_tag_message (uint32_t* response_buf,					// Pointer to response buf
 						  uint8_t data_count,						// Number of uint32_t variadic data following
 						  ...)										// Variadic uint32_t values for call
 {
-	uint32_t __attribute__((aligned(16))) message[data_count+3];
-	uint32_t addr = (uint32_t)(uintptr_t)&message[0];
+	uint32_t* message = &mailbox_message[0];
+	size_t size = ((data_count + 3 + 15) & ~15) * sizeof(uint32_t);	// Whole 64 byte cache lines in use
+	RegType_t sctlr;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, sctlr_el1" : "=r" (sctlr));
+#else
+	__asm volatile ("mrc p15, 0, %0, c1, c0, 0" : "=r" (sctlr));	// SCTLR
+#endif
+	bool locked = (sctlr & 1);										// Exclusives need the MMU on, before it only core 0 runs
+	if (locked) while (__atomic_exchange_n(&mailbox_lock, 1, __ATOMIC_ACQUIRE)) {}
+
 	va_list list;
 	va_start(list, data_count);										// Start variadic argument
 	message[0] = (data_count + 3) * 4;								// Size of message needed
@@ -939,29 +1040,22 @@ bool mailbox_tag_message (uint32_t* response_buf,					// Pointer to response buf
 	}
 	va_end(list);													// variadic cleanup	
 
-#if __aarch64__ == 1
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");		// Ensure coherence
-#else
-	__asm volatile ("mcr p15, 0, %0, c7, c14, 1" : : "r" (addr));	// Ensure coherence
-#endif
+	cache_clean_range(&message[0], size);							// GPU sees the whole message
 
+	uint32_t addr = (uint32_t)(uintptr_t)&message[0];				// Static buffer so its 1:1 address
 	mailbox_write(MB_CHANNEL_TAGS, ARMaddrToGPUaddr(addr));			// Write message to mailbox
 	mailbox_read(MB_CHANNEL_TAGS);									// Read the response
 
-#if __aarch64__ == 1
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");		// Ensure coherence
-#else 
-	__asm volatile ("mcr p15, 0, %0, c7, c14, 1" : : "r" (addr));	// Ensure coherence
-#endif
+	cache_invalidate_range(&message[0], size);						// CPU sees the whole response
 
-	if (message[1] == 0x80000000) {									// Check success flag
-		if (response_buf) {											// If buffer NULL used then don't want response
-			for (int i = 0; i < data_count; i++)
-				response_buf[i] = message[2 + i];					// Transfer out each response message
-		}
-		return true;												// message success
+	bool ok = (message[1] == 0x80000000);							// Check success flag
+	if (ok && response_buf) {										// If buffer NULL used then don't want response
+		for (int i = 0; i < data_count; i++)
+			response_buf[i] = message[2 + i];						// Transfer out each response message
 	}
-	return false;													// Message failed
+
+	if (locked) __atomic_store_n(&mailbox_lock, 0, __ATOMIC_RELEASE);// Let the next caller in
+	return ok;														// Message success or failure
 }
 
 
@@ -1262,6 +1356,47 @@ bool ARM_setmaxspeed (int(*prn_handler) (const char *fmt, ...)) {
 	return false;													// Max speed set failed
 }
 
+/*-[ARM_getclockrate]-------------------------------------------------------}
+. Reads an ARM clock rate via the mailbox property tag given, which would be
+. one of MAILBOX_TAG_GET_CLOCK_RATE, MAILBOX_TAG_GET_MIN_CLOCK_RATE or
+. MAILBOX_TAG_GET_MAX_CLOCK_RATE.
+. RETURN: The clock rate in Hz, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t ARM_getclockrate (TAG_CHANNEL_COMMAND tag) {
+	uint32_t Buffer[5] = { 0 };
+	if (mailbox_tag_message(&Buffer[0], 5, tag, 8, 8, CLK_ARM_ID, 0)
+		&& (Buffer[2] & 0x80000000))								// Firmware answered this tag
+		return Buffer[4];											// Return the clock rate
+	return 0;														// Clock rate read failed
+}
+
+/*-[ARM_setclockrate]-------------------------------------------------------}
+. Sets the ARM clock rate in Hz, the firmware will pick the nearest rate it
+. can make and clamps the rate to its limits. Like the reads below it is
+. safe from a task, the tag message is built in the 1:1 mapped buffer.
+. RETURN: The clock rate actually set in Hz, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t ARM_setclockrate (uint32_t rate) {
+	uint32_t Buffer[6] = { 0 };
+	if (mailbox_tag_message(&Buffer[0], 6, MAILBOX_TAG_SET_CLOCK_RATE, 12, 12, CLK_ARM_ID, rate, 0)
+		&& (Buffer[2] & 0x80000000))								// Firmware answered this tag
+		return Buffer[4];											// Return the rate set
+	return 0;														// Clock rate set failed
+}
+
+/*-[SOC_gettemperature]-----------------------------------------------------}
+. Reads the SoC temperature via the mailbox property tag given, which would
+. be MAILBOX_TAG_GET_TEMPERATURE or MAILBOX_TAG_GET_MAX_TEMPERATURE.
+. RETURN: The temperature in thousandths of a degree C, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t SOC_gettemperature (TAG_CHANNEL_COMMAND tag) {
+	uint32_t Buffer[5] = { 0 };
+	if (mailbox_tag_message(&Buffer[0], 5, tag, 8, 8, 0, 0)			// Temperature id 0 is the SoC
+		&& (Buffer[2] & 0x80000000))								// Firmware answered this tag
+		return Buffer[4];											// Return the temperature
+	return 0;														// Temperature read failed
+}
+
 
 /*==========================================================================}
 {				      SMARTSTART DISPLAY ROUTINES							}
@@ -38,9 +38,12 @@ extern "C" {									// Put extern C directive wrapper around
 {  2.12 New FIQ, DAIF flag support added									}
 {  2.13	Graphics routines relocated to there own unit						}
 {  2.14 Multicore task switcher support Added								}
+{  2.15 Cache maintenance by address range added							}
+{  2.16 Property mailbox locked so any core may use it						}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #include <stdbool.h>		// C standard unit needed for bool and true/false
+#include <stddef.h>			// C standard unit needed for size_t
 #include <stdint.h>			// C standard unit needed for uint8_t, uint32_t, etc
 #include <stdarg.h>			// C standard unit needed for variadic functions
 
@@ -213,6 +216,7 @@ typedef enum {
 	MAILBOX_TAG_GET_VIRTUAL_OFFSET			= 0x00040009,			// Get screen virtual offset
 	MAILBOX_TAG_GET_OVERSCAN				= 0x0004000A,			// Get screen overscan value
 	MAILBOX_TAG_GET_PALETTE					= 0x0004000B,			// Get screen palette
+	MAILBOX_TAG_WAIT_FOR_VSYNC				= 0x0004000E,			// Wait for screen vertical sync
 
 	MAILBOX_TAG_RELEASE_FRAMEBUFFER			= 0x00048001,			// Release Framebuffer address
 	MAILBOX_TAG_SET_PHYSICAL_WIDTH_HEIGHT	= 0x00048003,			// Set physical screen width/heigh
@@ -622,6 +626,32 @@ void timer_wait (uint64_t usec);
 .--------------------------------------------------------------------------*/
 uint64_t tick_difference (uint64_t us1, uint64_t us2);
 
+/*==========================================================================}
+{	   PUBLIC CACHE MAINTENANCE ROUTINES PROVIDED BY RPi-SmartStart API		}
+{==========================================================================*/
+
+/*-[cache_clean_range]------------------------------------------------------}
+. Cleans every data cache line the range touches out to the point of
+. coherency, so a DMA master or the GPU reading the memory sees what the
+. CPU wrote. The lines stay valid. Call before a device reads a buffer.
+.--------------------------------------------------------------------------*/
+void cache_clean_range (const void* start, size_t size);
+
+/*-[cache_invalidate_range]-------------------------------------------------}
+. Invalidates every data cache line the range touches, so the CPU reads
+. what a DMA master or the GPU wrote to the memory. A line only partly in
+. the range is cleaned and invalidated so data around the range is kept,
+. buffers a device writes are best whole cache lines. Call after a device
+. has written a buffer and before the CPU reads it.
+.--------------------------------------------------------------------------*/
+void cache_invalidate_range (void* start, size_t size);
+
+/*-[cache_flush_range]------------------------------------------------------}
+. Cleans and invalidates every data cache line the range touches. Use it on
+. a buffer a device both reads and writes, such as a mailbox message.
+.--------------------------------------------------------------------------*/
+void cache_flush_range (const void* start, size_t size);
+
 /*==========================================================================}
 {		  PUBLIC PI MAILBOX ROUTINES PROVIDED BY RPi-SmartStart API			}
 {==========================================================================*/
@@ -646,6 +676,8 @@ uint32_t mailbox_read (MAILBOX_CHANNEL channel);
 . uint32_t variables and a pointer to the response buffer. You nominate the
 . number of data uint32_t for the call and fill the variadic data in. If you
 . do not want the response data back the use NULL for response_buffer.
+. Once the MMU is on a spin lock is held over the call so tasks on any core
+. may use it, the reply can not go to the wrong caller.
 . RETURN: True for success and the response data will be set with data
 .         False for failure and the response buffer is untouched.
 .--------------------------------------------------------------------------*/
@@ -758,6 +790,28 @@ bool set_Activity_LED (bool on);
 .--------------------------------------------------------------------------*/
 bool ARM_setmaxspeed (int (*prn_handler) (const char *fmt, ...) );
 
+/*-[ARM_getclockrate]-------------------------------------------------------}
+. Reads an ARM clock rate via the mailbox property tag given, which would be
+. one of MAILBOX_TAG_GET_CLOCK_RATE, MAILBOX_TAG_GET_MIN_CLOCK_RATE or
+. MAILBOX_TAG_GET_MAX_CLOCK_RATE.
+. RETURN: The clock rate in Hz, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t ARM_getclockrate (TAG_CHANNEL_COMMAND tag);
+
+/*-[ARM_setclockrate]-------------------------------------------------------}
+. Sets the ARM clock rate in Hz, the firmware will pick the nearest rate it
+. can make and clamps the rate to its limits.
+. RETURN: The clock rate actually set in Hz, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t ARM_setclockrate (uint32_t rate);
+
+/*-[SOC_gettemperature]-----------------------------------------------------}
+. Reads the SoC temperature via the mailbox property tag given, which would
+. be MAILBOX_TAG_GET_TEMPERATURE or MAILBOX_TAG_GET_MAX_TEMPERATURE.
+. RETURN: The temperature in thousandths of a degree C, 0 for failure
+.--------------------------------------------------------------------------*/
+uint32_t SOC_gettemperature (TAG_CHANNEL_COMMAND tag);
+
 /*==========================================================================}
 {				      SMARTSTART DISPLAY ROUTINES							}
 {==========================================================================*/
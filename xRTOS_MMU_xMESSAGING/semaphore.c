@@ -1,20 +1,22 @@
 #include <stdint.h>
 #include <stdatomic.h>
 #include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "slab.h"
 #include "semaphore.h"
-
-#define MAX_SEMAPHORE  50
+#include "task.h"
 
 struct __attribute__((__packed__, aligned(4))) Semaphore_t 
 {
 	uint32_t count;
+	volatile uint32_t waiters[MAX_CPU_CORES];						// Tasks blocked in xSemaphoreTakeTimeout on each core
 	struct {
 		uint32_t inUse : 1;
 		uint32_t _reserved : 31;
 	};
 };
 
-static struct Semaphore_t SemBlock [MAX_SEMAPHORE] = { 0 };
+static SlabCache_t semCache = SLAB_CACHE_INIT("SEM", sizeof(struct Semaphore_t));// Each semaphore gets its own cache line
 
 
 /*-[ xSemaphoreCreateBinary ]-----------------------------------------------}
@@ -22,16 +24,25 @@ static struct Semaphore_t SemBlock [MAX_SEMAPHORE] = { 0 };
 .--------------------------------------------------------------------------*/
 SemaphoreHandle_t xSemaphoreCreateBinary(void)
 {
-	for (unsigned int i = 0; i < MAX_SEMAPHORE; i++)
+	struct Semaphore_t* sem = pvSlabAlloc(&semCache);
+	if (sem)
+	{
+		sem->inUse = 1;
+		sem->count = 0;
+	}
+	return sem;
+}
+
+/*-[ vSemaphoreDelete ]-----------------------------------------------------}
+.  Delete a Binary Semaphore, no task may be using it
+.--------------------------------------------------------------------------*/
+void vSemaphoreDelete (SemaphoreHandle_t sem)
+{
+	if (sem && sem->inUse)
 	{
-		if (SemBlock[i].inUse == 0)
-		{
-			SemBlock[i].inUse = 1;
-			SemBlock[i].count = 0;
-			return &SemBlock[i];
-		}
+		sem->inUse = 0;
+		vSlabFree(&semCache, sem);
 	}
-	return 0;
 }
 
 /*-[ xSemaphoreTake ]-------------------------------------------------------}
@@ -45,6 +56,20 @@ void xSemaphoreTake (SemaphoreHandle_t sem)
 	}
 }
 
+/*-[ xSemaphoreTakeTimeout ]------------------------------------------------}
+.  Take a Binary Semaphore waiting at most time_wait ticks for it. The
+.  task blocks while it waits and is made ready by the give or timeout.
+.  RETURN: true if the semaphore was taken, false if timed out
+.--------------------------------------------------------------------------*/
+bool xSemaphoreTakeTimeout (SemaphoreHandle_t sem, unsigned int time_wait)
+{
+	if (sem && sem->inUse)
+	{
+		return xTaskWaitOnSemaphore(&sem->count, &sem->waiters[0], time_wait);
+	}
+	return false;
+}
+
 /*-[ xSemaphoreGive ]-------------------------------------------------------}
 .  Give a Binary Semaphore
 .--------------------------------------------------------------------------*/
@@ -53,5 +78,6 @@ void xSemaphoreGive (SemaphoreHandle_t sem)
 	if (sem && sem->inUse)
 	{
 		semaphore_give(&sem->count);
+		xTaskReleaseSemaphore(&sem->waiters[0]);					// Wake any task blocked in a timed take
 	}
 }
\ No newline at end of file
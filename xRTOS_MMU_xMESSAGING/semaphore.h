@@ -14,11 +14,23 @@ typedef	struct Semaphore_t* SemaphoreHandle_t;
 .--------------------------------------------------------------------------*/
 SemaphoreHandle_t xSemaphoreCreateBinary (void);
 
+/*-[ vSemaphoreDelete ]-----------------------------------------------------}
+.  Delete a Binary Semaphore, no task may be using it
+.--------------------------------------------------------------------------*/
+void vSemaphoreDelete (SemaphoreHandle_t sem);
+
 /*-[ xSemaphoreTake ]-------------------------------------------------------}
 .  Take a Binary Semaphore
 .--------------------------------------------------------------------------*/
 void xSemaphoreTake (SemaphoreHandle_t sem);
 
+/*-[ xSemaphoreTakeTimeout ]------------------------------------------------}
+.  Take a Binary Semaphore waiting at most time_wait ticks for it. The
+.  task blocks while it waits and is made ready by the give or timeout.
+.  RETURN: true if the semaphore was taken, false if timed out
+.--------------------------------------------------------------------------*/
+bool xSemaphoreTakeTimeout (SemaphoreHandle_t sem, unsigned int time_wait);
+
 /*-[ xSemaphoreGive ]-------------------------------------------------------}
 .  Give a Binary Semaphore
 .--------------------------------------------------------------------------*/
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "heap.h"
+#include "slab.h"
+
+#define SLAB_PTR_MASK		(((uint64_t)1 << 48) - 1)				// Pointer bits of the depot head
+#define SLAB_TAG_ONE		((uint64_t)1 << 48)						// Tag increment of the depot head
+
+/* Free objects are linked through their first word */
+#define SLAB_NEXT(obj)		(*(void**)(obj))
+
+#if (configSLAB_MAGAZINE_SIZE < 2)
+	#error configSLAB_MAGAZINE_SIZE must be at least 2
+#endif
+
+/*--------------------------------------------------------------------------}
+{	  Masks IRQ and FIQ on the core returning the previous mask state		}
+{--------------------------------------------------------------------------*/
+static inline RegType_t SlabMaskInterrupts (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	return state;
+}
+
+/*--------------------------------------------------------------------------}
+{		Restores the IRQ and FIQ mask state from SlabMaskInterrupts			}
+{--------------------------------------------------------------------------*/
+static inline void SlabRestoreInterrupts (RegType_t state)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Pushes a linked chain of objects on the depot. Before the scheduler		}
+{	runs only core 0 runs so no atomics are used, which matters as			}
+{	exclusives need the MMU on.												}
+{--------------------------------------------------------------------------*/
+static void DepotPush (SlabCache_t* cache, void* first, void* last)
+{
+	uint64_t head = cache->depot;
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+	{
+		SLAB_NEXT(last) = (void*)(uintptr_t)(head & SLAB_PTR_MASK);
+		cache->depot = (uint64_t)(uintptr_t)first | ((head & ~SLAB_PTR_MASK) + SLAB_TAG_ONE);
+		return;
+	}
+	uint64_t newHead;
+	do {
+		SLAB_NEXT(last) = (void*)(uintptr_t)(head & SLAB_PTR_MASK);	// Chain goes on top of current list
+		newHead = (uint64_t)(uintptr_t)first | ((head & ~SLAB_PTR_MASK) + SLAB_TAG_ONE);
+	} while (!__atomic_compare_exchange_n(&cache->depot, &head, newHead,
+		true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*--------------------------------------------------------------------------}
+{	Pops one object off the depot. The tag changes on every push and pop	}
+{	so a head that was popped and pushed back in between fails the swap.	}
+{	Slabs are never given back to the heap so reading the link of an		}
+{	object another core just took is always safe.							}
+{--------------------------------------------------------------------------*/
+static void* DepotPop (SlabCache_t* cache)
+{
+	uint64_t head = cache->depot;
+	void* obj = (void*)(uintptr_t)(head & SLAB_PTR_MASK);
+	if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+	{
+		if (obj) cache->depot = (uint64_t)(uintptr_t)SLAB_NEXT(obj) | ((head & ~SLAB_PTR_MASK) + SLAB_TAG_ONE);
+		return obj;
+	}
+	head = __atomic_load_n(&cache->depot, __ATOMIC_ACQUIRE);
+	do {
+		obj = (void*)(uintptr_t)(head & SLAB_PTR_MASK);
+		if (obj == 0) return 0;										// Depot is empty
+	} while (!__atomic_compare_exchange_n(&cache->depot, &head,
+		(uint64_t)(uintptr_t)SLAB_NEXT(obj) | ((head & ~SLAB_PTR_MASK) + SLAB_TAG_ONE),
+		true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	return obj;
+}
+
+/*--------------------------------------------------------------------------}
+{	Fills half the magazine from the depot. If the depot is empty a new		}
+{	slab is taken from the heap, half of it goes in the magazine and the	}
+{	rest is pushed on the depot in one swap for the other cores.			}
+{--------------------------------------------------------------------------*/
+static void MagazineRefill (SlabCache_t* cache, struct SlabMagazine* mag)
+{
+	while (mag->count < configSLAB_MAGAZINE_SIZE / 2)
+	{
+		void* obj = DepotPop(cache);
+		if (obj == 0) break;										// Depot is empty
+		mag->objects[mag->count++] = obj;
+	}
+	if (mag->count) return;											// Got some
+	uint8_t* slab = pvPortMalloc(configSLAB_OBJECTS_PER_SLAB * cache->objectSize + SLAB_LINE_SIZE);
+	if (slab == 0) return;											// Heap is full
+	slab = (uint8_t*)(((uintptr_t)slab + SLAB_LINE_SIZE - 1) & ~(uintptr_t)(SLAB_LINE_SIZE - 1));
+	__atomic_fetch_add(&cache->slabs, 1, __ATOMIC_RELAXED);
+	unsigned int i = 0;
+	for (; (i < configSLAB_OBJECTS_PER_SLAB) && (mag->count < configSLAB_MAGAZINE_SIZE / 2); i++)
+		mag->objects[mag->count++] = slab + i * cache->objectSize;	// Half a magazine for us
+	if (i < configSLAB_OBJECTS_PER_SLAB)
+	{
+		void* first = slab + i * cache->objectSize;
+		for (; i < configSLAB_OBJECTS_PER_SLAB - 1; i++)
+			SLAB_NEXT(slab + i * cache->objectSize) = slab + (i + 1) * cache->objectSize;
+		DepotPush(cache, first, slab + i * cache->objectSize);		// Rest to the depot in one go
+	}
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ pvSlabAlloc ]----------------------------------------------------------}
+.  Takes an object from the cache, normally straight from the magazine of
+.  the calling core in constant time. The object is cache line aligned and
+.  cleared to zero. May be called from a task, IRQ or FIQ on any core.
+.  RETURN: Pointer to the object, NULL if the heap has no room for a slab
+.--------------------------------------------------------------------------*/
+void* pvSlabAlloc (SlabCache_t* cache)
+{
+	void* obj = 0;
+	if (cache == 0) return 0;
+	RegType_t state = SlabMaskInterrupts();							// Magazine is also used by IRQ and FIQ
+	struct SlabMagazine* mag = &cache->magazine[xTaskGetCoreID()];	// Magazine of this core, read masked
+	if (mag->count == 0) MagazineRefill(cache, mag);				// Empty so refill it
+	if (mag->count) obj = mag->objects[--mag->count];				// Take from the magazine
+	SlabRestoreInterrupts(state);									// Restore interrupt state
+	if (obj)
+	{
+		uint64_t* p = obj;
+		for (size_t i = 0; i < cache->objectSize / sizeof(uint64_t); i++)
+			p[i] = 0;												// Clear the object
+	}
+	return obj;
+}
+
+/*-[ vSlabFree ]------------------------------------------------------------}
+.  Gives an object back to the cache. It goes in the magazine of the calling
+.  core whichever core allocated it. May be called from a task, IRQ or FIQ.
+.--------------------------------------------------------------------------*/
+void vSlabFree (SlabCache_t* cache, void* object)
+{
+	if ((cache == 0) || (object == 0)) return;
+	RegType_t state = SlabMaskInterrupts();							// Magazine is also used by IRQ and FIQ
+	struct SlabMagazine* mag = &cache->magazine[xTaskGetCoreID()];	// Magazine of this core, read masked
+	if (mag->count == configSLAB_MAGAZINE_SIZE)						// Full so spill the top half to the depot
+	{
+		void* first = mag->objects[configSLAB_MAGAZINE_SIZE / 2];
+		for (unsigned int i = configSLAB_MAGAZINE_SIZE / 2; i < configSLAB_MAGAZINE_SIZE - 1; i++)
+			SLAB_NEXT(mag->objects[i]) = mag->objects[i + 1];
+		DepotPush(cache, first, mag->objects[configSLAB_MAGAZINE_SIZE - 1]);
+		mag->count = configSLAB_MAGAZINE_SIZE / 2;
+	}
+	mag->objects[mag->count++] = object;							// Into the magazine
+	SlabRestoreInterrupts(state);									// Restore interrupt state
+}
@@ -0,0 +1,59 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stddef.h>								// Needed for size_t
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+#include "xRTOS.h"								// Needed for MAX_CPU_CORES and slab config
+
+#define SLAB_LINE_SIZE		64					// Objects are whole cache lines so cores never share a line
+
+/*--------------------------------------------------------------------------}
+{						  SLAB CACHE STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  A cache hands out objects of one size. Each core has a magazine of free
+.  objects it alone uses, so most allocations and frees touch nothing any
+.  other core touches. Magazines refill from and spill to the depot, a
+.  lock free list shared by all cores, and the depot grows a slab at a time
+.  from the heap. Declare a cache statically with SLAB_CACHE_INIT.
+.--------------------------------------------------------------------------*/
+struct SlabMagazine
+{
+	void* objects[configSLAB_MAGAZINE_SIZE];	// Free objects for this core
+	uint32_t count;								// Number of objects in the magazine
+} __attribute__((aligned(SLAB_LINE_SIZE)));
+
+typedef struct SlabCache
+{
+	const char* name;							// Name of the cache, debugging only
+	size_t objectSize;							// Object size rounded up to whole cache lines
+	volatile uint64_t depot;					// Depot free list head, 16 bit ABA tag above the 48 bit pointer
+	volatile uint32_t slabs;					// Slabs taken from the heap
+	struct SlabMagazine magazine[MAX_CPU_CORES];// Magazine for each core
+} SlabCache_t;
+
+#define SLAB_CACHE_INIT(cacheName, size) {									\
+	.name = (cacheName),													\
+	.objectSize = (((size) + SLAB_LINE_SIZE - 1) & ~(size_t)(SLAB_LINE_SIZE - 1)) }
+
+/*-[ pvSlabAlloc ]----------------------------------------------------------}
+.  Takes an object from the cache, normally straight from the magazine of
+.  the calling core in constant time. The object is cache line aligned and
+.  cleared to zero. May be called from a task, IRQ or FIQ on any core.
+.  RETURN: Pointer to the object, NULL if the heap has no room for a slab
+.--------------------------------------------------------------------------*/
+void* pvSlabAlloc (SlabCache_t* cache);
+
+/*-[ vSlabFree ]------------------------------------------------------------}
+.  Gives an object back to the cache. It goes in the magazine of the calling
+.  core whichever core allocated it. May be called from a task, IRQ or FIQ.
+.--------------------------------------------------------------------------*/
+void vSlabFree (SlabCache_t* cache, void* object);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
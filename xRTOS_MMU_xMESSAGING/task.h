@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "rpi-smartstart.h"
+#include "semaphore.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +15,39 @@ extern "C" {
 struct TaskControlBlock;
 typedef struct TaskControlBlock* TaskHandle_t;
 
+/*--------------------------------------------------------------------------}
+{						  EVENT GROUP HANDLE DEFINED						}
+{--------------------------------------------------------------------------*/
+struct EventGroup;
+typedef struct EventGroup* EventGroupHandle_t;
+
+/*--------------------------------------------------------------------------}
+{						CORE CALL FUNCTION DEFINED							}
+{--------------------------------------------------------------------------*/
+typedef void (*CoreCallFunction_t) (void* pvArg);
+
+/*--------------------------------------------------------------------------}
+{					  TASK NOTIFY ACTIONS DEFINED							}
+{--------------------------------------------------------------------------*/
+typedef enum {
+	eSetBits = 0,													// Value is OR'ed into the task notification value
+	eIncrement = 1,													// Task notification value is incremented (value is ignored)
+	eSetValueWithOverwrite = 2,										// Task notification value is overwritten by value
+} eNotifyAction;
+
+/*--------------------------------------------------------------------------}
+{					CYCLIC EXECUTIVE SCHEDULE SLOT DEFINED					}
+{---------------------------------------------------------------------------}
+.  A schedule table is an array of these slots making up one major frame.
+.  Each slot is a minor frame that dispatches the task for slotTimeUs. A
+.  NULL task in a slot simply idles the core for that slot time.
+.--------------------------------------------------------------------------*/
+typedef struct ScheduleSlot
+{
+	TaskHandle_t task;												// Task dispatched in this slot (NULL = core idles)
+	uint32_t slotTimeUs;											// Slot (minor frame) time in microseconds
+} ScheduleSlot_t;
+
 /***************************************************************************}
 {					    PUBLIC INTERFACE ROUTINES						    }
 ****************************************************************************/
@@ -47,10 +81,21 @@ void xTaskDelay (const unsigned int time_wait);
 .  Moves an xRTOS task from the ready task list into wait on message task
 .  list. This effectively stalls any task processing at that time until a
 .  message arrives to release. The caller must provide a unique message ID
-.  that will release this task.
+.  that will release this task, non zero and below 0x80000000 as the top
+.  bit flags release all in the mailbox message. Other IDs are ignored.
 .--------------------------------------------------------------------------*/
 void xTaskWaitOnMessage (const RegType_t userMessageID);
 
+/*-[ xTaskWaitOnMessageTimeout ]--------------------------------------------}
+.  As xTaskWaitOnMessage but the task is also placed in the delayed list so
+.  it is released after time_wait ticks if no message arrives. Whichever of
+.  the message or timeout does not fire has the task cleanly removed from
+.  its list. A time_wait of zero returns false at once.
+.  RETURN: true if released by the message, false if timed out
+.--------------------------------------------------------------------------*/
+bool xTaskWaitOnMessageTimeout (const RegType_t userMessageID,		// Unique message ID that will release the task
+								const unsigned int time_wait);		// Maximum ticks to wait for the message
+
 /*-[ xTaskReleaseMessage ]--------------------------------------------------}
 .  Moves an xRTOS task from the wait on message task to the ready task list
 .  This effectively resumes task processing at that time. It is valid to go
@@ -59,11 +104,164 @@ void xTaskWaitOnMessage (const RegType_t userMessageID);
 .--------------------------------------------------------------------------*/
 void xTaskReleaseMessage(const RegType_t userMessageID);
 
+/*-[ xTaskReleaseMessageAll ]-----------------------------------------------}
+.  Moves every xRTOS task waiting on the message ID, on all cores, from the
+.  wait on message task list to the ready task list. Each core releases all
+.  its waiters in one pass, the current core directly and each other core
+.  from a single mailbox message.
+.--------------------------------------------------------------------------*/
+void xTaskReleaseMessageAll (const RegType_t userMessageID);
+
+/*-[ xTaskConditionWait ]---------------------------------------------------}
+.  Condition variable wait. The caller must hold the semaphore, which is
+.  given and the task put to wait on the message ID as one step so no
+.  release can be lost in between. The semaphore is taken again before the
+.  call returns. Signal with xTaskReleaseMessage or broadcast to all the
+.  waiters with xTaskReleaseMessageAll.
+.--------------------------------------------------------------------------*/
+void xTaskConditionWait (const RegType_t userMessageID,				// Message ID being the condition
+						 SemaphoreHandle_t sem);					// Semaphore held by caller protecting the condition
+
+/*-[ xTaskNotify ]----------------------------------------------------------}
+.  Updates the 32 bit notification value of the given task by the action
+.  and marks a notification pending. If the task is blocked in a call to
+.  xTaskNotifyWait it is made ready. No list is searched, if the task is on
+.  another core a single mailbox doorbell is sent to that core only. It is
+.  valid to call this from tasks or interrupts on any core.
+.  RETURN: true for success, false for an invalid task handle
+.--------------------------------------------------------------------------*/
+bool xTaskNotify (TaskHandle_t xTaskToNotify,						// Handle of the task to notify
+				  uint32_t ulValue,									// Value used by the action
+				  eNotifyAction eAction);							// Action to perform on notification value
+
+/*-[ xTaskNotifyWait ]------------------------------------------------------}
+.  Blocks the calling task until a notification is pending, returning at
+.  once if one already is. The bits in ulBitsToClearOnEntry are cleared in
+.  the notification value if no notification was pending on entry and the
+.  bits in ulBitsToClearOnExit are cleared before the call returns.
+.  RETURN: The notification value before the exit bits were cleared
+.--------------------------------------------------------------------------*/
+uint32_t xTaskNotifyWait (uint32_t ulBitsToClearOnEntry,			// Notification bits to clear on entry
+						  uint32_t ulBitsToClearOnExit);			// Notification bits to clear on exit
+
+/*-[ xEventGroupCreate ]----------------------------------------------------}
+.  Creates an event group of 32 event bits all initially clear.
+.  RETURN: The event group handle, NULL if no event group is available
+.--------------------------------------------------------------------------*/
+EventGroupHandle_t xEventGroupCreate (void);
+
+/*-[ xEventGroupSetBits ]---------------------------------------------------}
+.  Sets the bits in the event group and makes ready only those tasks, on
+.  any core, whose wait condition is now met. Cores with no task waiting on
+.  the group are not interrupted. It is valid to call this from tasks or
+.  interrupts on any core.
+.  RETURN: The event group bits after the bits were set
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupSetBits (EventGroupHandle_t xEventGroup,		// The event group
+							 uint32_t uxBitsToSet);					// The bits to set
+
+/*-[ xEventGroupClearBits ]-------------------------------------------------}
+.  Clears the bits in the event group.
+.  RETURN: The event group bits before the bits were cleared
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupClearBits (EventGroupHandle_t xEventGroup,		// The event group
+							   uint32_t uxBitsToClear);				// The bits to clear
+
+/*-[ xEventGroupGetBits ]---------------------------------------------------}
+.  RETURN: The current event group bits
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupGetBits (EventGroupHandle_t xEventGroup);		// The event group
+
+/*-[ xEventGroupWaitBits ]--------------------------------------------------}
+.  Blocks the calling task until any (xWaitForAllBits false) or all of the
+.  bits in uxBitsToWaitFor are set in the event group, returning at once if
+.  they already are. If xClearOnExit is true the bits waited for are cleared
+.  in the same atomic operation that satisfies the wait.
+.  RETURN: The event group bits at the time the wait was satisfied
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupWaitBits (EventGroupHandle_t xEventGroup,		// The event group
+							  uint32_t uxBitsToWaitFor,				// The bits to wait for
+							  bool xClearOnExit,					// Clear the bits waited for on exit
+							  bool xWaitForAllBits);				// Wait for all bits rather than any bit
+
+/*-[ xTaskWaitOnSemaphore ]------------------------------------------------}
+.  Used by xSemaphoreTakeTimeout and not meant for user code. Blocks the
+.  calling task until the binary semaphore count word is taken or time_wait
+.  ticks pass. waiters counts the waiting tasks on each core.
+.  RETURN: true if the semaphore was taken, false if timed out
+.--------------------------------------------------------------------------*/
+bool xTaskWaitOnSemaphore (volatile uint32_t* count,				// Count word of the semaphore, 0 = free
+						   volatile uint32_t* waiters,				// Count of waiting tasks on each core
+						   const unsigned int time_wait);			// Maximum ticks to wait for the semaphore
+
+/*-[ xTaskReleaseSemaphore ]-----------------------------------------------}
+.  Used by xSemaphoreGive and not meant for user code. Makes ready the tasks
+.  waiting on the semaphore, only interrupting cores that have one.
+.--------------------------------------------------------------------------*/
+void xTaskReleaseSemaphore (volatile uint32_t* waiters);			// Count of waiting tasks on each core
+
+/*-[ xCoreCall ]------------------------------------------------------------}
+.  Runs the function with the argument on the given core. The call is made
+.  from the mailbox 2 FIQ of that core, so it runs with interrupts masked
+.  and must be short and must not block. If the core is the calling core
+.  the function is simply called. With xWait true the call returns after
+.  the function has completed, which must not be asked from an interrupt.
+.  With xWait false it returns once the call is queued. Only valid once the
+.  scheduler is started.
+.  RETURN: true for success, false for invalid core or no async call available
+.--------------------------------------------------------------------------*/
+bool xCoreCall (uint8_t corenum,									// The core to run the function on
+				CoreCallFunction_t pxFunction,						// The function to run
+				void* pvArg,										// Argument passed to the function
+				bool xWait);										// Wait for the function to complete
+
+/*-[ xCoreCallBroadcast ]---------------------------------------------------}
+.  As xCoreCall but runs the function on every core set in the core mask,
+.  bit 0 being core 0. With xWait true it returns once all have completed.
+.  RETURN: true for success, false if any of the calls could not be made
+.--------------------------------------------------------------------------*/
+bool xCoreCallBroadcast (uint32_t coreMask,							// Bit mask of cores to run function on
+						 CoreCallFunction_t pxFunction,				// The function to run
+						 void* pvArg,								// Argument passed to the function
+						 bool xWait);								// Wait for all the functions to complete
+
 /*-[ xTaskStartScheduler ]--------------------------------------------------}
 .  starts the xRTOS task scheduler effectively starting the whole system
 .--------------------------------------------------------------------------*/
 void xTaskStartScheduler (void);
 
+/*-[ xTaskGetTickCount ]---------------------------------------------------}
+.  Returns the tick count of the core this is called from
+.--------------------------------------------------------------------------*/
+RegType_t xTaskGetTickCount (void);
+
+/*-[ xTaskGetCoreTickCount ]-----------------------------------------------}
+.  Returns the tick count of the given core, for work timed on that core
+.  from another. Core tick counts are not kept in step with each other.
+.--------------------------------------------------------------------------*/
+RegType_t xTaskGetCoreTickCount (uint8_t corenum);
+
+/*-[ xTaskGetSchedulerState ]----------------------------------------------}
+.  Returns if the scheduler is running on the core this is called from
+.  RETURN: taskSCHEDULER_RUNNING or taskSCHEDULER_NOT_STARTED
+.--------------------------------------------------------------------------*/
+#define taskSCHEDULER_NOT_STARTED	( 0 )
+#define taskSCHEDULER_RUNNING		( 1 )
+unsigned int xTaskGetSchedulerState (void);
+
+/*-[ xTaskGetCoreID ]-------------------------------------------------------}
+.  Returns the core number of the calling core through TPIDR, for per core
+.  data outside the task code. Only valid once xRTOS_Init has run on the
+.  core, and the caller must have interrupts masked if it may be moved.
+.--------------------------------------------------------------------------*/
+unsigned int xTaskGetCoreID (void);
+
+/*-[ xTaskGetCurrentTaskHandle ]--------------------------------------------}
+.  Returns the handle of the task calling, for passing to a driver that
+.  notifies it when an operation it started completes
+.--------------------------------------------------------------------------*/
+TaskHandle_t xTaskGetCurrentTaskHandle (void);
+
 /*-[ xTaskGetNumberOfTasks ]------------------------------------------------}
 .  Returns the number of xRTOS tasks assigned to the core this is called
 .--------------------------------------------------------------------------*/
@@ -74,6 +272,109 @@ unsigned int xTaskGetNumberOfTasks (void);
 .--------------------------------------------------------------------------*/
 unsigned int xLoadPercentCPU(void);
 
+/*-[ xLoadPercentCore ]----------------------------------------------------}
+.  Returns the load on the given core in percent (0 - 100)
+.--------------------------------------------------------------------------*/
+unsigned int xLoadPercentCore (uint8_t corenum);
+
+/*-[ xIdleResidencyPercent ]-----------------------------------------------}
+.  Returns the percent of the last analysis frame (0 - 100) that the core
+.  this is called from spent asleep in WFI in the idle task.
+.--------------------------------------------------------------------------*/
+unsigned int xIdleResidencyPercent (void);
+
+/*-[ xTaskSetBestEffort ]---------------------------------------------------}
+.  Marks a task as best effort, a task with no real time need that may be
+.  moved to another core, or back to real time which keeps it on its core.
+.  Tasks are created real time.
+.  RETURN: true for success, false for an invalid task
+.--------------------------------------------------------------------------*/
+bool xTaskSetBestEffort (TaskHandle_t xTask, bool xBestEffort);
+
+/*-[ xTaskMigrate ]---------------------------------------------------------}
+.  Requests the task be moved to the given core. The core the task is on
+.  moves it at its next tick once the task is ready and not running, so a
+.  blocked task moves once it is made ready. Idle tasks and tasks on, or to
+.  a core with, a cyclic executive table can not be moved. May be called
+.  from any core once the scheduler is running.
+.  RETURN: true if the move was requested, false if it can not be moved
+.--------------------------------------------------------------------------*/
+bool xTaskMigrate (TaskHandle_t xTask, uint8_t corenum);
+
+/*-[ xTaskSetAddressSpace ]------------------------------------------------}
+.  Puts a task in an address space from MMU_space_create, or back in the
+.  kernel map with ASID 0. The core switches TTBR0 as it switches the task
+.  in, which is all isolation costs as TLB entries are ASID tagged. The
+.  calling task switches at once, a task running on another core at its
+.  next switch in. Tasks are created in the kernel map. Only AARCH64.
+.  RETURN: true for success, false for an invalid task or space
+.--------------------------------------------------------------------------*/
+bool xTaskSetAddressSpace (TaskHandle_t xTask, uint16_t asid);
+
+/*-[ xTaskSetFaultHook ]----------------------------------------------------}
+.  Sets a function called when a task faults, stackOverflow being true if
+.  it ran off the bottom of its stack into the guard page below it. It is
+.  called from the exception with interrupts masked on a stack of its own,
+.  so it should only record or print. The task is then stopped for good and
+.  the core goes on with its other tasks.
+.--------------------------------------------------------------------------*/
+void xTaskSetFaultHook (void (*hook) (TaskHandle_t xTask, const char* pcTaskName, bool stackOverflow, RegType_t faultAddress));
+
+/*-[ xTaskSetGpuIrqHandler ]------------------------------------------------}
+.  Sets a function the core IRQ handler calls when the GPU peripheral
+.  interrupt is pending, before it looks at the timer tick. It is called in
+.  the IRQ on the core the GPU interrupt is routed to, core 0 by default,
+.  so it must clear the source and may only use calls safe from an IRQ.
+.--------------------------------------------------------------------------*/
+void xTaskSetGpuIrqHandler (void (*handler) (void));
+
+/*-[ xTaskPackBestEffort ]--------------------------------------------------}
+.  Requests every best effort task be moved to the given core, leaving the
+.  other cores with only their real time tasks so they can sit in WFI.
+.  RETURN: Number of tasks asked to move
+.--------------------------------------------------------------------------*/
+unsigned int xTaskPackBestEffort (uint8_t corenum);
+
+/*-[ xTaskUnpackBestEffort ]------------------------------------------------}
+.  Requests every best effort task be moved back to the core it was created
+.  on, undoing xTaskPackBestEffort.
+.  RETURN: Number of tasks asked to move
+.--------------------------------------------------------------------------*/
+unsigned int xTaskUnpackBestEffort (void);
+
+/*-[ xTaskSetScheduleTable ]------------------------------------------------}
+.  Sets the static cyclic executive schedule table (major frame) for a core.
+.  Each slot dispatches its task until the slot time expires at which point
+.  the next slot is dispatched, after the last slot the table repeats. Only
+.  active when configSCHEDULER_MODE is configSCHEDULER_CYCLIC and it must be
+.  called before xTaskStartScheduler. The table must stay valid (static).
+.  A core with no table set continues to round robin on the timer tick.
+.  On a core with a table the kernel tick keeps its own period and every
+.  tick due is run at the next slot boundary. Tick based calls such as
+.  xTaskDelay and software timers therefore stay in ticks, but only take
+.  effect at a slot boundary.
+.  RETURN: true for success, false for invalid core or table size
+.--------------------------------------------------------------------------*/
+bool xTaskSetScheduleTable (uint8_t corenum,						// The core number the table is for
+							const ScheduleSlot_t* table,			// The schedule table of slots
+							unsigned int slotCount);				// Number of slots in the table
+
+/*-[ xTaskEndSlot ]---------------------------------------------------------}
+.  Called by a cyclic executive task when its work for the current slot is
+.  complete. The core idles for the rest of the slot and the call returns
+.  at the start of the next slot assigned to the task. A task that has not
+.  called this by the end of its slot, and is still ready to run then, is
+.  counted as a slot overrun. A task blocked or delayed at the end of its
+.  slot is not.
+.--------------------------------------------------------------------------*/
+void xTaskEndSlot (void);
+
+/*-[ xTaskGetOverrunCount ]-------------------------------------------------}
+.  Returns the number of cyclic executive slot overruns detected on the
+.  core this is called from.
+.--------------------------------------------------------------------------*/
+unsigned int xTaskGetOverrunCount (void);
+
 #ifdef __cplusplus
 }
 #endif
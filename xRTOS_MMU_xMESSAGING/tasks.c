@@ -5,6 +5,9 @@
 #include "mmu.h"
 #include "semaphore.h"
 #include "task.h"
+#include "timers.h"
+#include "heap.h"
+#include "slab.h"
 
 /*
  * Macros used by vListTask to indicate which state a task is in.
@@ -26,6 +29,32 @@
 #define CoreExitCritical EnableInterrupts
 #define ImmediateYield __asm volatile ("svc 0")
 
+/* Core mailbox allocation */
+#define MAILBOX_MESSAGE		0						// Mailbox 0 carries the release message IDs
+#define MAILBOX_DOORBELL	1						// Mailbox 1 carries kernel doorbell bits
+#define MAILBOX_CALL		2						// Mailbox 2 signals core calls queued on the core call stack
+#define MAILBOX_RESCHEDULE	3						// Mailbox 3 is routed to the IRQ as a reschedule interrupt
+
+/* Doorbell bits on the kernel doorbell mailbox */
+#define DOORBELL_WAKE		0x00000001				// Tasks have been pushed on the core wake stack
+#define DOORBELL_EVENT		0x00000002				// Event group bits have been set that core tasks wait on
+#define DOORBELL_SEM		0x00000004				// A semaphore has been given that core tasks wait on
+
+/* Release message flag bits on the message mailbox */
+#define MSG_RELEASE_ALL		0x80000000				// Release every task waiting on the message ID not just the first
+
+/* Message IDs are non zero and leave the release all flag bit clear, others are ignored */
+#define MSG_ID_VALID(id)	(((id) != 0) && ((id) < MSG_RELEASE_ALL))
+
+/* Task stacks are mapped in the TTBR1 range, each above an unmapped guard page */
+#if __aarch64__ == 1
+#define STACK_REGION_BASE	((uintptr_t)0xFFFFFFC000000000)	// Top 256GB of the TTBR1 range
+#else
+#define STACK_REGION_BASE	((uintptr_t)0xC0000000)			// Top 1GB of the TTBR1 range
+#define STACK_FRAME_R13		14						// Saved r13 slot in the first frame, above the SPSR and r0-r12
+#endif
+#define STACK_PAGE_SIZE		4096					// Stacks and guards are whole pages
+
 typedef struct TaskControlBlock* task_ptr;
 
 /*--------------------------------------------------------------------------}
@@ -64,21 +93,54 @@ typedef struct TaskControlBlock
 	}	pxTaskFlags;											/*< Task flags ... these flags will be save FPU, nested count etc in future
 																	THIS MUST BE THE SECOND MEMBER OF THE TCB STRUCT AND MUST BE VOLATILE.
 																	It changes each task switch and the optimizer needs to know that */
+	RegType_t ttbr0;											/*< TTBR0 value of the task address space, loaded as the task is switched in.
+																	THIS MUST BE THE THIRD MEMBER OF THE TCB STRUCT */
 
 	RegType_t* pxStack;											/*< Points to the start of the stack allocated when task created */
+	uintptr_t stackGuard;										/*< Virtual address of the unmapped guard page below the stack */
 
 	/* These form the task state double link list system */
 	struct TaskControlBlock* next;								/*< Next task in list */
 	struct TaskControlBlock* prev;								/*< Prev task in list */
 	RegType_t ReleaseTime;										/*< Core OSTickCounter at which task will be released from delay ... only valid if task in delayed list */
+	struct TaskControlBlock* delayNext;							/*< Next task in delayed list, separate so a task can also be in a wait list */
+	struct TaskControlBlock* delayPrev;							/*< Prev task in delayed list */
+	TASK_LIST_t* waitList;										/*< Wait list the task is blocked on with a timeout, NULL if none */
 	RegType_t waitMessageID;									/*< When in the wait on message list this is the unique message ID that will release it */
 
 	SemaphoreHandle_t taskSem;									/*< Task semaphore */
 
+	/* Direct to task notification, accessed atomically from any core */
+	volatile uint32_t notifyValue;								/*< 32 bit task notification value */
+	volatile uint32_t notifyPending;							/*< Set when a notification has been sent and not yet taken by a wait */
+	volatile uint32_t notifyWaiting;							/*< Set while task is blocked (or blocking) in xTaskNotifyWait */
+	volatile uint32_t wakeQueued;								/*< Set while task is on its core wake stack */
+	struct TaskControlBlock* volatile wakeNext;					/*< Next task on the core wake stack */
+	struct TaskControlBlock* registryNext;						/*< Next task in the registry of every task created */
+
+	/* Core placement, migration may be requested from any core */
+	volatile uint32_t bestEffort;								/*< Task has no real time need so may be moved between cores */
+	volatile uint32_t migrateTo;								/*< Core number + 1 the task is to be moved to, 0 = none */
+
+	/* Event group wait, only valid if task in wait event list */
+	struct EventGroup* eventGroup;								/*< Event group the task is waiting on */
+	uint32_t eventWaitBits;										/*< Event bits the task is waiting on */
+	uint32_t eventResult;										/*< Event group bits at the time the wait was satisfied */
+
+	/* Semaphore wait, only valid if task in wait semaphore list */
+	volatile uint32_t* semCount;								/*< Count word of the semaphore the task is waiting on */
+
 	struct {
 		RegType_t		uxPriority : 8;							/*< The priority of the task.  0 is the lowest priority. */
 		RegType_t		taskState : 8;							/*< Task state running, delayed, blocked etc */
-		RegType_t		_reserved : (sizeof(RegType_t)*8) - 20;
+		RegType_t		_reserved : (sizeof(RegType_t)*8) - 29;
+		RegType_t		homeCore : 3;							/*< Core the task was created on */
+		RegType_t		migrating : 1;							/*< Task is on a wake stack being moved to its new core */
+		RegType_t		inDelayList : 1;						/*< Task is in the delayed list */
+		RegType_t		timedOut : 1;							/*< Timed wait was released by the timeout not the event */
+		RegType_t		eventWaitAll : 1;						/*< Event wait needs all the wait bits rather than any */
+		RegType_t		eventClearOnExit : 1;					/*< Event wait clears the wait bits when satisfied */
+		RegType_t		slotDone : 1;							/*< Cyclic executive task has completed its work for the current slot */
 		RegType_t		assignedCore : 3;						/*< Core this task is assigned to on a multicore, always 0 on single core */
 		RegType_t		inUse : 1;								/*< This task is in use field */
 	};
@@ -91,37 +153,130 @@ typedef struct TaskControlBlock
 {				 CORE CONTROL BLOCK STRUCTURE DEFINED						}
 {---------------------------------------------------------------------------}
 .  A CPU control block (coreCB) is allocated for each CPU core and stores 
-.  information, specific to the tasks being run on that CPU core.
+.  information, specific to the tasks being run on that CPU core. Each is
+.  padded to whole cache lines in the per core data section and the core
+.  finds its own through TPIDR_EL1 (TPIDRPRW on AArch32) with this_cpu().
 .--------------------------------------------------------------------------*/
-static struct CoreControlBlock
+static struct __attribute__((aligned(PER_CPU_LINE))) CoreControlBlock
 {
 	volatile TCB_t* pxCurrentTCB;							/*< Points to the current task that is running on this CPU core.
 																THIS MUST BE THE FIRST MEMBER OF THE CORE CONTROL BLOCK STRUCT AND MUST BE VOLATILE.
 																It changes each task switch and the optimizer needs to know that */
+	volatile TCB_t* pxPreemptTCB;							/*< Higher priority task made ready that the reschedule interrupt will switch to */
 	TaskHandle_t xIdleTaskHandle;							/*< Holds the handle of the core idle task. The idle task is created automatically when the scheduler is started. */
 	TASK_LIST_t	readyTasks;									/*< List of tasks that are ready to run */
 	TASK_LIST_t delayedTasks;								/*< List of tasks that are in delayed state */
 	TASK_LIST_t waitMsgTasks;								/*< List of tasks that are waiting on messages */
+	TASK_LIST_t waitEventTasks;								/*< List of tasks that are waiting on event group bits */
+	TASK_LIST_t waitSemTasks;								/*< List of tasks that are waiting on a semaphore with a timeout */
 	RegType_t OSTickCounter;								/*< Incremented each tick timer - Used in delay and timeout functions */
-	struct TaskControlBlock coreTCB[MAX_TASKS_PER_CORE];	/*< This cores list of tasks on the core */
+	volatile uint64_t idleEnterCount;						/*< EL0 counter value idle task entered WFI, 0 if not in WFI */
+	uint64_t idleCounts;									/*< EL0 counts spent in WFI in the current 1 sec analysis frame */
+	uint64_t idleFrameStart;								/*< EL0 counter value the current analysis frame started */
+	struct TaskControlBlock* volatile wakeStack;			/*< Lock free stack of tasks other cores have asked this core to make ready */
+	struct CoreCall* volatile callStack;					/*< Lock free stack of calls other cores have asked this core to run */
+	volatile uint32_t migratePending;						/*< Count of migration requests outstanding for tasks on this core */
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	const ScheduleSlot_t* scheduleTable;					/*< Cyclic executive schedule table (major frame), NULL = round robin on this core */
+	unsigned int scheduleSlots;								/*< Number of slots (minor frames) in the schedule table */
+	unsigned int scheduleIndex;								/*< Index of the slot currently being dispatched */
+	unsigned int slotOverruns;								/*< Count of slots where the task did not complete its work */
+	RegType_t slotTimerCount[configMAX_SCHEDULE_SLOTS];		/*< Each slot time precalculated in EL0 timer counts */
+	uint64_t slotBoundary;									/*< EL0 counter value of the next slot boundary */
+	uint64_t tickBoundary;									/*< EL0 counter value of the next kernel tick, caught up at slot boundaries */
+#endif
 	struct {
 		volatile unsigned uxCurrentNumberOfTasks : 16;		/*< Current number of task running on this core */
 		volatile unsigned uxPercentLoadCPU : 16;			/*< Last CPU load calculated = uxIdleTickCount/configTICK_RATE_HZ * 100 in percent for last 1 sec frame   */
 		volatile unsigned uxIdleTickCount : 16;			    /*< Current ticks in 1 sec analysis frame that idle was current task */
 		volatile unsigned uxCPULoadCount: 16;				/*< Current count in 1 sec analysis frame .. one sec =  configTICK_RATE_HZ ticks */
 		volatile unsigned uxSchedulerSuspended : 16;		/*< Context switches are held pending while the scheduler is suspended.  */
+		volatile unsigned uxIdleResidency : 16;				/*< Last idle residency calculated = percent of last analysis frame core was asleep in WFI */
 		unsigned xSchedulerRunning : 1;						/*< Set to 1 if the scheduler is running on this core */
 		unsigned xCoreBlockInitialized : 1;					/*< Set to 1 if the core block has been initialized */
 	};
-} coreCB[MAX_CPU_CORES] = { 0 };
+} coreCB[MAX_CPU_CORES] PER_CPU = { 0 };
+
+/*--------------------------------------------------------------------------}
+{	Returns the core control block of the calling core from TPIDR_EL1 (or	}
+{	TPIDRPRW), one register read with no MPIDR decode or array index. It	}
+{	is volatile so it is read again after anything that may move a task.	}
+{--------------------------------------------------------------------------*/
+static inline struct CoreControlBlock* this_cpu (void)
+{
+	struct CoreControlBlock* cb;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, tpidr_el1" : "=r" (cb));
+#else
+	__asm volatile ("mrc p15, 0, %0, c13, c0, 4" : "=r" (cb));
+#endif
+	return cb;
+}
+
+/*--------------------------------------------------------------------------}
+{			 Sets the core control block this_cpu() returns on the core		}
+{--------------------------------------------------------------------------*/
+static inline void SetThisCpu (struct CoreControlBlock* cb)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr tpidr_el1, %0" : : "r" (cb) : "memory");
+#else
+	__asm volatile ("mcr p15, 0, %0, c13, c0, 4" : : "r" (cb) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Core number of a core control block, so a core block read through		}
+{	this_cpu() inside a masked section also gives the core it belongs to	}
+{--------------------------------------------------------------------------*/
+static inline unsigned int CoreIndex (struct CoreControlBlock* cb)
+{
+	return (unsigned int)(cb - &coreCB[0]);
+}
+
+/*--------------------------------------------------------------------------}
+{					  EVENT GROUP STRUCTURE DEFINED							}
+{---------------------------------------------------------------------------}
+.  An event group is 32 event bits set and cleared atomically from any core.
+.  The waiters count for each core lets a set skip cores that have no task
+.  waiting on the group, so only cores with a possible waiter are rung.
+.--------------------------------------------------------------------------*/
+struct EventGroup
+{
+	volatile uint32_t bits;										/*< The event bits */
+	volatile uint32_t waiters[MAX_CPU_CORES];					/*< Count of tasks waiting on the group on each core */
+	volatile uint32_t inUse;									/*< This event group is in use field */
+};
+
+/*--------------------------------------------------------------------------}
+{						CORE CALL STRUCTURE DEFINED							}
+{---------------------------------------------------------------------------}
+.  A call to run on another core. A waiting caller provides it on its own
+.  stack and spins on done, an asynchronous call takes one from the call
+.  cache, one cache shared by all cores, which the target core frees once
+.  the function has run.
+.--------------------------------------------------------------------------*/
+struct CoreCall
+{
+	struct CoreCall* next;										/*< Next call on the core call stack */
+	CoreCallFunction_t function;								/*< Function to run */
+	void* arg;													/*< Argument for the function */
+	volatile uint32_t done;										/*< Set by target core when waited call completes */
+	uint32_t pooled;											/*< Call is from the call cache and the target frees it */
+};
 
 /***************************************************************************}
 {					   PRIVATE INTERNAL DATA STORAGE					    }
 ****************************************************************************/
+static SlabCache_t tcbCache = SLAB_CACHE_INIT("TCB", sizeof(struct TaskControlBlock));// Task control blocks
+static SlabCache_t callCache = SLAB_CACHE_INIT("CALL", sizeof(struct CoreCall));	// Async core call messages
+static struct TaskControlBlock* volatile taskRegistry = 0;			// Every task created, tasks are never deleted
+static struct EventGroup eventGroups[configMAX_EVENT_GROUPS] = { 0 };	// Event group storage
 static SemaphoreHandle_t mailbox0_semaphore[4] = { 0 };				// Mailbox semaphore for each core mailbox 0
 
-static RegType_t TestStack[16384] __attribute__((aligned(16)));
-static RegType_t* TestStackTop = &TestStack[16384];
+static uintptr_t stackRegionNext = STACK_REGION_BASE;				// Next free virtual address in the stack region
+static void (*taskFaultHook) (TaskHandle_t, const char*, bool, RegType_t) = 0;	// Reports a task fault
+static void (*gpuIrqHandler) (void) = 0;							// Services GPU peripheral interrupts
 
 static uint64_t m_nClockTicksPerHZTick = 0;							// Divisor to generat tick frequency
 
@@ -182,7 +337,384 @@ static void RemoveTaskFromList (TASK_LIST_t* list, struct TaskControlBlock* task
 }
 
 /*--------------------------------------------------------------------------}
-{				The default idle task .. that does nothing :-)				}
+{		Adds the task into the delayed list using the delay links			}
+{--------------------------------------------------------------------------*/
+static void AddTaskToDelayList (TASK_LIST_t* list, struct TaskControlBlock* task)
+{
+	task->delayNext = 0;											// Task will be the list tail
+	task->delayPrev = list->tail;									// Prev is current list tail (NULL if empty)
+	if (list->tail != 0) list->tail->delayNext = task;				// Add task to current list tail
+		else list->head = task;										// No existing tasks so task is also head
+	list->tail = task;												// Now task becomes the list tail
+	task->inDelayList = 1;											// Task is now in delayed list
+}
+
+/*--------------------------------------------------------------------------}
+{		Removes the task from the delayed list using the delay links		}
+{--------------------------------------------------------------------------*/
+static void RemoveTaskFromDelayList (TASK_LIST_t* list, struct TaskControlBlock* task)
+{
+	if (task->delayPrev) task->delayPrev->delayNext = task->delayNext;// Our prev next will point to our next
+		else list->head = task->delayNext;							// Task was head so next moves up to head
+	if (task->delayNext) task->delayNext->delayPrev = task->delayPrev;// Our next prev will point to our prev
+		else list->tail = task->delayPrev;							// Task was tail so prev becomes tail
+	task->inDelayList = 0;											// Task no longer in delayed list
+}
+
+/*--------------------------------------------------------------------------}
+{	If a task just made ready on this core has a higher priority than the	}
+{	current task raise the reschedule interrupt so the switch happens as	}
+{	soon as interrupts allow rather than at the next timer tick.			}
+{--------------------------------------------------------------------------*/
+static void RequestPreempt (struct CoreControlBlock* cb, struct TaskControlBlock* task)
+{
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	if (cb->scheduleTable) return;									// Cyclic executive only switches at slot boundaries
+#endif
+	if ((cb->xSchedulerRunning) && (cb->pxCurrentTCB)
+		&& (task->uxPriority > cb->pxCurrentTCB->uxPriority)		// Task beats current task
+		&& ((cb->pxPreemptTCB == 0) || (task->uxPriority > cb->pxPreemptTCB->uxPriority)))
+	{
+		if (cb->pxPreemptTCB == 0)									// No reschedule interrupt raised yet
+			SendCoreMessage(1, task->assignedCore, MAILBOX_RESCHEDULE);
+		cb->pxPreemptTCB = task;									// Hold task to switch to
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes a blocked task ready removing it from the wait list it is on and	}
+{	the delayed list if it was also waiting with a timeout					}
+{--------------------------------------------------------------------------*/
+static void ReadyBlockedTask (struct CoreControlBlock* cb, TASK_LIST_t* list, struct TaskControlBlock* task)
+{
+	if (list) RemoveTaskFromList(list, task);						// Remove the task from the wait list
+	if (task->inDelayList)											// Task was waiting with a timeout
+		RemoveTaskFromDelayList(&cb->delayedTasks, task);			// Timeout no longer needed
+	task->waitList = 0;												// No longer on any wait list
+	task->taskState = tskREADY_CHAR;								// Set the read char state
+	AddTaskToList(&cb->readyTasks, task);							// Add the task to the ready list
+	RequestPreempt(cb, task);										// Switch now if task should preempt
+}
+
+/*--------------------------------------------------------------------------}
+{	  Masks IRQ and FIQ on the core returning the previous mask state		}
+{--------------------------------------------------------------------------*/
+static inline RegType_t CoreMaskInterrupts (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	return state;
+}
+
+/*--------------------------------------------------------------------------}
+{		Restores the IRQ and FIQ mask state from CoreMaskInterrupts			}
+{--------------------------------------------------------------------------*/
+static inline void CoreRestoreInterrupts (RegType_t state)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	 Makes a task blocked in xTaskNotifyWait ready, must run on its core	}
+{--------------------------------------------------------------------------*/
+static void ReadyNotifiedTask (struct CoreControlBlock* cb, struct TaskControlBlock* task)
+{
+	if (__atomic_exchange_n(&task->notifyWaiting, 0, __ATOMIC_SEQ_CST)	// Only the first waker readies the task
+		&& (task->taskState == tskBLOCKED_CHAR))					// Task did actually block
+		ReadyBlockedTask(cb, 0, task);								// Make the task ready
+}
+
+/*--------------------------------------------------------------------------}
+{	 Pushes a task on the wake stack of a core and rings the core doorbell	}
+{--------------------------------------------------------------------------*/
+static void PushWakeTask (unsigned int corenum, struct TaskControlBlock* task)
+{
+	struct CoreControlBlock* cb = &coreCB[corenum];					// Set pointer to the core block
+	struct TaskControlBlock* head = cb->wakeStack;
+	do {
+		task->wakeNext = head;										// Task goes on top of current stack
+	} while (!__atomic_compare_exchange_n(&cb->wakeStack, &head, task,
+		true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));					// Push task on the core wake stack
+	SendCoreMessage(DOORBELL_WAKE, corenum, MAILBOX_DOORBELL);		// Ring that core doorbell, bits merge if already rung
+}
+
+/*--------------------------------------------------------------------------}
+{	Wakes a task blocked in xTaskNotifyWait. A task on this core is made	}
+{	ready directly, a task on another core is pushed on its wake stack.		}
+{--------------------------------------------------------------------------*/
+static void WakeNotifiedTask (struct TaskControlBlock* task)
+{
+	unsigned int corenum = task->assignedCore;						// Core the task runs on
+	RegType_t state = CoreMaskInterrupts();							// Lists are also changed by IRQ and FIQ
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so caller can not be moved
+	if (cb == &coreCB[corenum])										// Task is on this core
+		ReadyNotifiedTask(cb, task);								// Make the task ready directly
+	else if (__atomic_exchange_n(&task->wakeQueued, 1, __ATOMIC_ACQ_REL) == 0)
+		PushWakeTask(corenum, task);								// Other core makes it ready
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+}
+
+/*--------------------------------------------------------------------------}
+{	 Makes ready all the tasks other cores pushed on this core wake stack	}
+{--------------------------------------------------------------------------*/
+static void DrainWakeStack (struct CoreControlBlock* cb)
+{
+	struct TaskControlBlock* task = __atomic_exchange_n(&cb->wakeStack, 0, __ATOMIC_ACQUIRE);
+	while (task != 0)
+	{
+		struct TaskControlBlock* next = task->wakeNext;				// Hold next before task can be queued again
+		if (task->migrating)										// Task is being moved to this core
+		{
+			task->migrating = 0;									// Move is complete
+			task->taskState = tskREADY_CHAR;						// Set the read char state
+			AddTaskToList(&cb->readyTasks, task);					// Task now runs on this core
+			cb->uxCurrentNumberOfTasks++;							// Increment task count on core
+			__atomic_store_n(&task->wakeQueued, 0, __ATOMIC_RELEASE);// Task may be pushed again from here
+			RequestPreempt(cb, task);								// Switch now if task should preempt
+		}
+		else {
+			__atomic_store_n(&task->wakeQueued, 0, __ATOMIC_RELEASE);// Task may be pushed again from here
+			ReadyNotifiedTask(cb, task);							// Make the task ready
+		}
+		task = next;												// Next woken task
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Moves ready tasks with a migration request off this core. Each is taken	}
+{	off the ready list and pushed on the wake stack of its new core, which	}
+{	adds it to its own ready list. The task being switched to and a task	}
+{	that is blocked stay until a later tick finds them ready and not run.	}
+{--------------------------------------------------------------------------*/
+static void MigrateTasks (struct CoreControlBlock* cb)
+{
+	struct TaskControlBlock* task = cb->readyTasks.head;
+	while (task != 0)
+	{
+		struct TaskControlBlock* next = task->next;					// Hold next before task leaves the list
+		uint32_t to = task->migrateTo;
+		if (to == task->assignedCore + 1)							// Already on the core asked for
+		{
+			task->migrateTo = 0;									// Request is done
+			__atomic_fetch_sub(&cb->migratePending, 1, __ATOMIC_RELAXED);
+		}
+		else if ((to != 0) && (task != cb->pxCurrentTCB) && (task != cb->xIdleTaskHandle)
+			&& (__atomic_exchange_n(&task->wakeQueued, 1, __ATOMIC_ACQ_REL) == 0))
+		{
+			RemoveTaskFromList(&cb->readyTasks, task);				// Task leaves this core
+			cb->uxCurrentNumberOfTasks--;							// Decrement task count on core
+			if (cb->pxPreemptTCB == task) cb->pxPreemptTCB = 0;		// Can not switch to it here now
+			task->taskState = tskBLOCKED_CHAR;						// Not ready on any core while it moves
+			task->migrating = 1;									// New core adds it to its ready list
+			task->assignedCore = to - 1;							// Task now belongs to the new core
+			task->migrateTo = 0;									// Request is done
+			__atomic_fetch_sub(&cb->migratePending, 1, __ATOMIC_RELAXED);
+			PushWakeTask(to - 1, task);								// Hand the task to the new core
+		}
+		task = next;												// Next ready task
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	Atomically checks the event group bits against a task wait condition.	}
+{	If met the bits are cleared as requested and true is returned with the	}
+{	bits at the time the condition was met held in the task eventResult		}
+{--------------------------------------------------------------------------*/
+static bool TryEventWait (struct TaskControlBlock* task)
+{
+	struct EventGroup* eg = task->eventGroup;
+	uint32_t bits = __atomic_load_n(&eg->bits, __ATOMIC_SEQ_CST);
+	do {
+		uint32_t match = bits & task->eventWaitBits;				// Bits of interest set
+		if ((task->eventWaitAll) ? (match != task->eventWaitBits) : (match == 0))
+			return false;											// Condition not met
+		if (task->eventClearOnExit == 0) break;						// Nothing to clear
+	} while (!__atomic_compare_exchange_n(&eg->bits, &bits, bits & ~task->eventWaitBits,
+		true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));					// Clear the wait bits in same atomic step
+	task->eventResult = bits;										// Hold bits that satisfied the wait
+	return true;													// Condition met
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes ready any task on this core whose event wait condition is met		}
+{--------------------------------------------------------------------------*/
+static void ScanEventWaiters (struct CoreControlBlock* cb, unsigned int corenum)
+{
+	RegType_t state = CoreMaskInterrupts();							// Lists are also changed by IRQ and FIQ
+	struct TaskControlBlock* task = cb->waitEventTasks.head;		// Set task to wait for event head
+	while (task != 0)
+	{
+		struct TaskControlBlock* next = task->next;					// Hold next as task may move list
+		if (TryEventWait(task))										// Wait condition is now met
+		{
+			__atomic_fetch_sub(&task->eventGroup->waiters[corenum], 1, __ATOMIC_SEQ_CST);
+			ReadyBlockedTask(cb, &cb->waitEventTasks, task);		// Move the task from wait event list to ready
+		}
+		task = next;												// Next event task
+	}
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes ready every task on this core waiting on a semaphore that is now	}
+{	free. They race to take it and those that lose wait again.				}
+{--------------------------------------------------------------------------*/
+static void ScanSemaphoreWaiters (struct CoreControlBlock* cb)
+{
+	RegType_t state = CoreMaskInterrupts();							// Lists are also changed by IRQ and FIQ
+	struct TaskControlBlock* task = cb->waitSemTasks.head;			// Set task to wait for semaphore head
+	while (task != 0)
+	{
+		struct TaskControlBlock* next = task->next;					// Hold next as task may move list
+		if (__atomic_load_n(task->semCount, __ATOMIC_SEQ_CST) == 0)	// Semaphore is free
+			ReadyBlockedTask(cb, &cb->waitSemTasks, task);			// Move the task from wait semaphore list to ready
+		task = next;												// Next semaphore task
+	}
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+}
+
+/*--------------------------------------------------------------------------}
+{	Makes ready the first, or all, tasks on this core waiting on message	}
+{--------------------------------------------------------------------------*/
+static void ReleaseMessageTasks (struct CoreControlBlock* cb, uint32_t msgId, bool all)
+{
+	struct TaskControlBlock* task = cb->waitMsgTasks.head;			// Set task to wait for message head
+	while (task != 0)
+	{
+		struct TaskControlBlock* next = task->next;					// Hold next as task may move list
+		if (msgId == task->waitMessageID)							// Check if message matches
+		{
+			ReadyBlockedTask(cb, &cb->waitMsgTasks, task);			// Move the task from wait for message list to ready
+			if (!all) return;										// Only one task release per message
+		}
+		task = next;												// Next message task
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	 Pushes a call on the core call stack and signals that core mailbox		}
+{--------------------------------------------------------------------------*/
+static void PushCoreCall (unsigned int corenum, struct CoreCall* call)
+{
+	struct CoreControlBlock* cb = &coreCB[corenum];					// Set pointer to the target core block
+	struct CoreCall* head = cb->callStack;
+	do {
+		call->next = head;											// Call goes on top of current stack
+	} while (!__atomic_compare_exchange_n(&cb->callStack, &head, call,
+		true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));					// Push call on the core call stack
+	SendCoreMessage(1, corenum, MAILBOX_CALL);						// Signal that core, bits merge if already signalled
+}
+
+/*--------------------------------------------------------------------------}
+{	 Runs in order all the calls other cores pushed on this core call stack	}
+{--------------------------------------------------------------------------*/
+static void RunCoreCalls (struct CoreControlBlock* cb)
+{
+	struct CoreCall* call = __atomic_exchange_n(&cb->callStack, 0, __ATOMIC_ACQUIRE);
+	struct CoreCall* fifo = 0;
+	while (call != 0)												// Stack is newest first so reverse it
+	{
+		struct CoreCall* next = call->next;
+		call->next = fifo;
+		fifo = call;
+		call = next;
+	}
+	while (fifo != 0)
+	{
+		struct CoreCall* next = fifo->next;							// Hold next as a waited call is gone once done
+		fifo->function(fifo->arg);									// Run the call
+		if (fifo->pooled) vSlabFree(&callCache, fifo);				// Free async call back to the cache
+			else __atomic_store_n(&fifo->done, 1, __ATOMIC_RELEASE);// Tell waiting caller it is complete
+		fifo = next;
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	 Takes a call from the shared call cache, NULL if the heap is empty		}
+{--------------------------------------------------------------------------*/
+static struct CoreCall* AllocAsyncCall (void)
+{
+	struct CoreCall* call = pvSlabAlloc(&callCache);				// Take a call from the cache
+	if (call) call->pooled = 1;										// Target frees it
+	return call;
+}
+
+/*--------------------------------------------------------------------------}
+{	Core call run on the other cores after an executable mapping is gone.	}
+{	Taking the FIQ and returning from it is itself a context synchronize,	}
+{	the isb just makes it plain.											}
+{--------------------------------------------------------------------------*/
+static void CoreSyncContext (void* arg)
+{
+	(void)arg;
+	__asm volatile ("isb" : : : "memory");
+}
+
+/*--------------------------------------------------------------------------}
+{	The MMU core sync, waits until every other core running the scheduler	}
+{	has synchronized. Cores not yet running have not fetched through any	}
+{	mapping MMU_map made.													}
+{--------------------------------------------------------------------------*/
+static void MmuSyncCores (void)
+{
+	uint32_t mask = 0;
+	for (int i = 0; i < MAX_CPU_CORES; i++)
+		if (coreCB[i].xSchedulerRunning) mask |= (1 << i);
+	mask &= ~(1u << getCoreID());									// This core synchronized in MMU_unmap
+	if (mask) xCoreCallBroadcast(mask, CoreSyncContext, 0, true);
+}
+
+/*--------------------------------------------------------------------------}
+{				 Reads the EL0 physical counter of the core					}
+{--------------------------------------------------------------------------*/
+static inline uint64_t ReadCoreCounter (void)
+{
+	uint64_t count;
+#if __aarch64__ == 1
+	__asm volatile ("isb\n\tmrs %0, cntpct_el0" : "=r" (count) : : "memory");
+#else
+	__asm volatile ("isb\n\tmrrc p15, 0, %Q0, %R0, c14" : "=r" (count) : : "memory");
+#endif
+	return count;
+}
+
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+/*--------------------------------------------------------------------------}
+{	Sets the absolute EL0 counter value the core timer next fires at, so	}
+{	slot boundaries do not move with the interrupt entry latency.			}
+{--------------------------------------------------------------------------*/
+static inline void WriteCoreCompare (uint64_t compare)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr cntp_cval_el0, %0\n\tisb" : : "r" (compare) : "memory");
+#else
+	__asm volatile ("mcrr p15, 2, %Q0, %R0, c14\n\tisb" : : "r" (compare) : "memory");
+#endif
+}
+#endif
+
+/*--------------------------------------------------------------------------}
+{	 Called on interrupt entry, if core was asleep in WFI add the time		}
+{--------------------------------------------------------------------------*/
+static void IdleExit (struct CoreControlBlock* cb)
+{
+	if (cb->idleEnterCount)											// Core was asleep in WFI
+	{
+		cb->idleCounts += ReadCoreCounter() - cb->idleEnterCount;	// Add time asleep
+		cb->idleEnterCount = 0;										// No longer asleep
+	}
+}
+
+/*--------------------------------------------------------------------------}
+{	The default idle task .. sleeps the core in WFI until an interrupt		}
 {--------------------------------------------------------------------------*/
 static void prvIdleTask(void* pvParameters)
 {
@@ -191,9 +723,16 @@ static void prvIdleTask(void* pvParameters)
 
 	/** THIS IS THE RTOS IDLE TASK - WHICH IS CREATED AUTOMATICALLY WHEN THE
 	SCHEDULER IS STARTED. **/
+	struct CoreControlBlock* cb = this_cpu();						// Set pointer to core block
 	for (;; )
 	{
-
+		/* Interrupts are masked so none can be taken between marking the
+		   sleep and the WFI, a pending interrupt still wakes the WFI and is
+		   then taken when interrupts are restored which adds the sleep time */
+		RegType_t state = CoreMaskInterrupts();						// Mask IRQ and FIQ
+		cb->idleEnterCount = ReadCoreCounter();						// Mark the time we went to sleep
+		__asm volatile ("dsb sy\n\twfi" : : : "memory");			// Sleep until an interrupt (tick or mailbox)
+		CoreRestoreInterrupts(state);								// Interrupt is taken here
 	}
 }
 
@@ -204,34 +743,62 @@ void coreFIQHandler (void)
 {
 	uint32_t msgId;
 	unsigned int corenum = getCoreID();								// Get the core ID
-	if (ReadCoreMessage(&msgId, corenum, 0))						// Read the message
+	struct CoreControlBlock* cb = this_cpu();						// Set pointer to core block
+	IdleExit(cb);													// Mailbox may have woken core from WFI
+	if (ReadCoreMessage(&msgId, corenum, MAILBOX_DOORBELL))			// Read the kernel doorbell
 	{
-		struct TaskControlBlock* task;
-		struct CoreControlBlock* cb = &coreCB[corenum];				// Set pointer to core block
-		/* Check current core */
-		task = cb->waitMsgTasks.head;								// Set task to wait for message head
-		while (task != 0)
-		{
-			if (msgId == task->waitMessageID)						// Check if message matches
-			{
-				RemoveTaskFromList(&cb->waitMsgTasks, task);		// Remove the task from wait for messsage list
-				task->taskState = tskREADY_CHAR;					// Set the read char state
-				AddTaskToList(&cb->readyTasks, task);				// Add the task to the ready list
-				xSemaphoreGive(mailbox0_semaphore[corenum]);		// Give the semaphore back before return
-				return;												// Only one task release per message
-			}
-			task = task->next;										// Next message task
-		}
+		if (msgId & DOORBELL_WAKE) DrainWakeStack(cb);				// Other cores have tasks for us to make ready
+		if (msgId & DOORBELL_EVENT) ScanEventWaiters(cb, corenum);	// Event bits set that our tasks may wait on
+		if (msgId & DOORBELL_SEM) ScanSemaphoreWaiters(cb);			// Semaphore given that our tasks may wait on
+	}
+	if (ReadCoreMessage(&msgId, corenum, MAILBOX_CALL))				// Read the core call signal
+	{
+		RunCoreCalls(cb);											// Other cores have calls for us to run
+	}
+	if (ReadCoreMessage(&msgId, corenum, MAILBOX_MESSAGE))			// Read the message
+	{
+		ReleaseMessageTasks(cb, msgId & ~MSG_RELEASE_ALL,
+			(msgId & MSG_RELEASE_ALL) != 0);						// Release first or all waiters on this core
+		xSemaphoreGive(mailbox0_semaphore[corenum]);				// Give the semaphore back before return
 	}
-	xSemaphoreGive(mailbox0_semaphore[corenum]);					// Message no on this core give semaphore back
 }
 
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+/*--------------------------------------------------------------------------}
+{	 Selects the task for the current slot, the idle task if it has none	}
+{--------------------------------------------------------------------------*/
+static void SelectSlotTask (struct CoreControlBlock* ccb)
+{
+	struct TaskControlBlock* task = ccb->scheduleTable[ccb->scheduleIndex].task;
+	if (task && (task->slotDone == 0) && (task->taskState == tskREADY_CHAR))
+		ccb->pxCurrentTCB = task;									// Slot task is ready and has work left in the slot
+		else ccb->pxCurrentTCB = ccb->xIdleTaskHandle;				// Nothing to dispatch so core idles rest of the slot
+}
+
+#endif
+
 /*--------------------------------------------------------------------------}
 {			Starts the tasks running on the core just as it says			}
 {--------------------------------------------------------------------------*/
 static void StartTasksOnCore(void)
 {
 	MMU_enable();													// Enable MMU											
+	SetThisCpu(&coreCB[getCoreID()]);								// This core finds its core block through TPIDR
+	this_cpu()->xSchedulerRunning = 1;								// Scheduler is now running on this core
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	struct CoreControlBlock* ccb = this_cpu();						// Pointer to core control block
+	if (ccb->scheduleTable)											// Core is running a cyclic executive
+	{
+		struct TaskControlBlock* task = ccb->scheduleTable[0].task;
+		if (task) task->slotDone = 0;								// First slot task has work to do
+		SelectSlotTask(ccb);										// First slot task becomes current
+		uint64_t start = ReadCoreCounter();							// Slots and ticks both count from here
+		ccb->slotBoundary = start + ccb->slotTimerCount[0];
+		ccb->tickBoundary = start + m_nClockTicksPerHZTick;			// Ticks keep their own period
+		WriteCoreCompare(ccb->slotBoundary);						// Set the EL0 timer to the first slot boundary
+	}
+	else
+#endif
 	EL0_Timer_Set(m_nClockTicksPerHZTick);							// Set the EL0 timer
 	EL0_Timer_Irq_Setup();											// Setup the EL0 timer interrupt
 	xStartFirstTask();												// Restore context starting the first task
@@ -246,16 +813,61 @@ static void StartTasksOnCore(void)
 .--------------------------------------------------------------------------*/
 void xRTOS_Init (void)
 {
+	SetThisCpu(&coreCB[getCoreID()]);								// Boot core finds its core block through TPIDR
+	xHeapInit();													// Per core heap arenas over the free RAM, slab caches grow from it
+	MMU_page_pool_init();											// Page pool above the heap, task stacks come from it
 	for (int i = 0; i < MAX_CPU_CORES; i++)
 	{
-		RPi_coreCB_PTR[i] = &coreCB[i];								// Set the core block pointers in the smartstart system needed by irq and swi vectors
+		RPi_coreCB_PTR[i] = &coreCB[i];								// Set the core block pointers in the smartstart system, vectors now use TPIDR
 		coreCB[i].xCoreBlockInitialized = 1;						// Set the core block initialzied flag to state this has been done
 		mailbox0_semaphore[i] = xSemaphoreCreateBinary();			// Create core mailbox 0 semaphore
 	}
 }
 
+/*--------------------------------------------------------------------------}
+{	Maps a stack of depth registers for the task at the next free place in	}
+{	the stack region, leaving the page below it unmapped as a guard. The	}
+{	frames are one block from the MMU page pool, so the size rounds up to	}
+{	a power of two pages. The first frame is written through the 1:1 map	}
+{	as the MMU is still off on core 0 when the first tasks are created,		}
+{	and on AARCH32 the r13 it saves is then moved to the stack region.		}
+{	RETURN: true for success, false if the pool has no block				}
+{--------------------------------------------------------------------------*/
+static bool StackCreate (struct TaskControlBlock* task, unsigned int depth,
+						 void (*pxTaskCode) (void* pxParam), void* pvParameters)
+{
+	unsigned int order = 0;
+	while (((uintptr_t)STACK_PAGE_SIZE << order) < (uintptr_t)depth * sizeof(RegType_t)) order++;
+	uintptr_t size = (uintptr_t)STACK_PAGE_SIZE << order;
+	uintptr_t pa = MMU_page_alloc(order);
+	if (pa == 0) return false;										// Pool has no block that big
+	uintptr_t guard;
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		guard = __atomic_fetch_add(&stackRegionNext, size + STACK_PAGE_SIZE, __ATOMIC_RELAXED);
+	else {
+		guard = stackRegionNext;									// Only core 0 runs before the scheduler
+		stackRegionNext += size + STACK_PAGE_SIZE;
+	}
+	uintptr_t va = guard + STACK_PAGE_SIZE;							// Stack sits on top of the guard
+	if (!MMU_map(va, pa, size, MT_NORMAL | MMU_NOEXEC))
+	{
+		MMU_page_free(pa);											// No tables left so give the frames back
+		return false;
+	}
+	RegType_t* sp = taskInitialiseStack((RegType_t*)(pa + size), pxTaskCode, pvParameters);
+#if __aarch64__ != 1
+	sp[STACK_FRAME_R13] = (RegType_t)(va + size);					// Task must run on the stack region so the guard is hit
+#endif
+	task->pxTopOfStack = (RegType_t*)(va + ((uintptr_t)sp - pa));	// Same place seen through the stack region
+	task->pxStack = (RegType_t*)(va + size);						// Hold the top of task stack
+	task->stackGuard = guard;
+	return true;
+}
+
 /*-[ xTaskCreate ]----------------------------------------------------------}
-.  Creates an xRTOS task on the given core.
+.  Creates an xRTOS task on the given core. The stack is mapped above an
+.  unmapped guard page, so running off the bottom of it faults the task.
+.  If no stack can be mapped no task is created.
 .--------------------------------------------------------------------------*/
 void xTaskCreate (uint8_t corenum,									// The core number to run task on
 				  void (*pxTaskCode) (void* pxParam),				// The code for the task
@@ -265,22 +877,33 @@ void xTaskCreate (uint8_t corenum,									// The core number to run task on
 				  uint8_t uxPriority,								// Priority of the task
 				  TaskHandle_t* const pxCreatedTask)				// A pointer to return the task handle (NULL if not required)
 {
-	int i;
-	for (i = 0; (i < MAX_TASKS_PER_CORE) && (coreCB[corenum].coreTCB[i].inUse != 0); i++) {};
-	if (i < MAX_TASKS_PER_CORE)
+	struct TaskControlBlock* task = 0;
+	if (corenum < MAX_CPU_CORES) task = pvSlabAlloc(&tcbCache);		// Cleared cache line aligned TCB
+	if (task && !StackCreate(task, usStackDepth, pxTaskCode, pvParameters))
+	{
+		vSlabFree(&tcbCache, task);									// No stack so no task
+		task = 0;
+	}
+	if (pxCreatedTask) (*pxCreatedTask) = 0;						// Preset no task
+	if (task)
 	{
 		struct CoreControlBlock* cb;
-		struct TaskControlBlock* task;
 		CoreEnterCritical();										// Entering core critical area	
 		cb = &coreCB[corenum];										// Set pointer to core block
-		task = &cb->coreTCB[i];										// This is the task we are talking about
-		task->pxStack = TestStackTop;								// Hold the top of task stack
-		task->pxTopOfStack = taskInitialiseStack(TestStackTop, pxTaskCode, pvParameters);
 		task->pxTaskFlags = (struct pxTaskFlags_t){ 0 };			// Make sure the task flags are clear
-		TestStackTop -= usStackDepth;								// Set stack size
+		task->ttbr0 = MMU_space_ttbr0(0);							// Tasks start in the kernel map
 		task->uxPriority = uxPriority;								// Hold the task priority
 		task->inUse = 1;											// Set the task is in use flag
 		task->assignedCore = corenum;								// Hold the core number task assigned to 
+		task->homeCore = corenum;									// Hold the core task was created on
+		task->bestEffort = 0;										// Real time until told otherwise
+		task->migrateTo = 0;										// No move requested
+		task->migrating = 0;										// Not being moved
+		task->notifyValue = 0;										// No notification value
+		task->notifyPending = 0;									// No notification pending
+		task->notifyWaiting = 0;									// Not waiting on a notification
+		task->wakeQueued = 0;										// Not on a wake stack
+		task->wakeNext = 0;											// No next task on wake stack
 		if (pcName) {
 			int j;
 			for (j = 0; (j < configMAX_TASK_NAME_LEN - 1) && (pcName[j] != 0); j++)
@@ -293,6 +916,18 @@ void xTaskCreate (uint8_t corenum,									// The core number to run task on
 		AddTaskToList(&cb->readyTasks, task);						// Add task to read task lits
 		if (pxCreatedTask) (*pxCreatedTask) = task;
 		CoreExitCritical();											// Exiting core critical area
+		if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		{
+			struct TaskControlBlock* head = taskRegistry;
+			do {
+				task->registryNext = head;							// Task goes on front of registry
+			} while (!__atomic_compare_exchange_n(&taskRegistry, &head, task,
+				true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+		}
+		else {
+			task->registryNext = taskRegistry;						// Only core 0 runs before the scheduler
+			taskRegistry = task;
+		}
 	}
 }
 
@@ -306,15 +941,15 @@ void xTaskDelay (const unsigned int time_wait)
 	if (time_wait)													// Non zero wait time requested
 	{
 		struct TaskControlBlock* task;
-		unsigned int corenum = getCoreID();							// Get the core ID
-		struct CoreControlBlock* cb = &coreCB[corenum];				// Set pointer to core block
+		RegType_t state = CoreMaskInterrupts();						// Delayed list is also changed by the tick IRQ
+		struct CoreControlBlock* cb = this_cpu();					// Core block read masked so task can not be moved
 		task = (struct TaskControlBlock*) cb->pxCurrentTCB;			// Set temp task pointer .. typecast is to stop volatile dropped warning
-		xSemaphoreTake(task->taskSem);								// We are going to play with list lock the task semaphore
 		task->ReleaseTime = cb->OSTickCounter + time_wait;			// Calculate release tick value
 		RemoveTaskFromList(&cb->readyTasks, task);					// Remove task from ready list
+		task->next = 0;												// Not in a task list while only delayed
 		task->taskState = tskBLOCKED_CHAR;							// Change task state to blocked
-		AddTaskToList(&cb->delayedTasks, task);						// Add the task to delay list
-		xSemaphoreGive(task->taskSem);								// Okay clear to release task semaphore
+		AddTaskToDelayList(&cb->delayedTasks, task);				// Add the task to delay list
+		CoreRestoreInterrupts(state);								// Restore interrupt state
 		ImmediateYield;												// Immediate yield ... store task context, reschedule new current task and switch to it
 	}
 }
@@ -323,26 +958,54 @@ void xTaskDelay (const unsigned int time_wait)
 .  Moves an xRTOS task from the ready task list into wait on message task 
 .  list. This effectively stalls any task processing at that time until a
 .  message arrives to release. The caller must provide a unique message ID
-.  that will release this task.
+.  that will release this task, non zero and below 0x80000000 as the top
+.  bit flags release all in the mailbox message. Other IDs are ignored.
 .--------------------------------------------------------------------------*/
 void xTaskWaitOnMessage (const RegType_t userMessageID)
 {
-	if (userMessageID)												// Non zero user Message ID must be used
+	if (MSG_ID_VALID(userMessageID))								// Valid user Message ID must be used
 	{
 		struct TaskControlBlock* task;
-		unsigned int corenum = getCoreID();							// Get the core ID
-		struct CoreControlBlock* cb = &coreCB[corenum];				// Set pointer to core block
+		RegType_t state = CoreMaskInterrupts();						// Lists are also changed by IRQ and FIQ
+		struct CoreControlBlock* cb = this_cpu();					// Core block read masked so task can not be moved
 		task = (struct TaskControlBlock*) cb->pxCurrentTCB;			// Set temp task pointer .. typecast is to stop volatile dropped warning
-		xSemaphoreTake(task->taskSem);								// We are going to play with list lock the task semaphore
 		RemoveTaskFromList(&cb->readyTasks, task);					// Remove task from ready list
 		task->waitMessageID = userMessageID;						// Set wait on message ID
 		task->taskState = tskBLOCKED_CHAR;							// Change task state to blocked
 		AddTaskToList(&cb->waitMsgTasks, task);						// Add the task to wait message task list
-		xSemaphoreGive(task->taskSem);								// Okay clear to release task semaphore
+		CoreRestoreInterrupts(state);								// Restore interrupt state
 		ImmediateYield;												// Immediate yield ... store task context, reschedule new current task and switch to it
 	}
 }
 
+/*-[ xTaskWaitOnMessageTimeout ]--------------------------------------------}
+.  As xTaskWaitOnMessage but the task is also placed in the delayed list so
+.  it is released after time_wait ticks if no message arrives. Whichever of
+.  the message or timeout does not fire has the task cleanly removed from
+.  its list. A time_wait of zero returns false at once.
+.  RETURN: true if released by the message, false if timed out
+.--------------------------------------------------------------------------*/
+bool xTaskWaitOnMessageTimeout (const RegType_t userMessageID,		// Unique message ID that will release the task
+								const unsigned int time_wait)		// Maximum ticks to wait for the message
+{
+	if (!MSG_ID_VALID(userMessageID) || (time_wait == 0)) return false;// Valid user Message ID and non zero wait must be used
+	struct TaskControlBlock* task;
+	RegType_t state = CoreMaskInterrupts();							// Lists are also changed by IRQ and FIQ
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so task can not be moved
+	task = (struct TaskControlBlock*) cb->pxCurrentTCB;				// Set temp task pointer .. typecast is to stop volatile dropped warning
+	RemoveTaskFromList(&cb->readyTasks, task);						// Remove task from ready list
+	task->waitMessageID = userMessageID;							// Set wait on message ID
+	task->taskState = tskBLOCKED_CHAR;								// Change task state to blocked
+	task->timedOut = 0;												// Not timed out yet
+	AddTaskToList(&cb->waitMsgTasks, task);							// Add the task to wait message task list
+	task->waitList = &cb->waitMsgTasks;								// Hold the wait list so timeout can remove task
+	task->ReleaseTime = cb->OSTickCounter + time_wait;				// Calculate release tick value
+	AddTaskToDelayList(&cb->delayedTasks, task);					// Add the task to delay list as well
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	ImmediateYield;													// Immediate yield ... returns on message or timeout
+	return (task->timedOut == 0);									// Return if message released task
+}
+
 /*-[ xTaskReleaseMessage ]--------------------------------------------------}
 .  Moves an xRTOS task from the wait on message task to the ready task list
 .  This effectively resumes task processing at that time. It is valid to go 
@@ -351,7 +1014,7 @@ void xTaskWaitOnMessage (const RegType_t userMessageID)
 .--------------------------------------------------------------------------*/
 void xTaskReleaseMessage (const RegType_t userMessageID)
 {
-	if (userMessageID)												// Non zero user Message ID must be used
+	if (MSG_ID_VALID(userMessageID))								// Valid user Message ID must be used
 	{
 		for (int i = 0; i < MAX_CPU_CORES; i++)
 		{	
@@ -361,6 +1024,377 @@ void xTaskReleaseMessage (const RegType_t userMessageID)
 	}
 }
 
+/*-[ xTaskReleaseMessageAll ]-----------------------------------------------}
+.  Moves every xRTOS task waiting on the message ID, on all cores, from the
+.  wait on message task list to the ready task list. Each core releases all
+.  its waiters in one pass, the current core directly and each other core
+.  from a single mailbox message.
+.--------------------------------------------------------------------------*/
+void xTaskReleaseMessageAll (const RegType_t userMessageID)
+{
+	if (MSG_ID_VALID(userMessageID))								// Valid user Message ID must be used
+	{
+		RegType_t state = CoreMaskInterrupts();						// Lists are also changed by IRQ and FIQ
+		struct CoreControlBlock* cb = this_cpu();					// Core block read masked so caller can not be moved
+		unsigned int corenum = CoreIndex(cb);						// Core released directly
+		ReleaseMessageTasks(cb, userMessageID, true);				// Release all waiters on this core
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		for (unsigned int i = 0; i < MAX_CPU_CORES; i++)
+		{
+			if (i != corenum)										// Every other core even if we have since moved to it
+			{
+				xSemaphoreTake(mailbox0_semaphore[i]);				// Lock the mailbox0 semaphore for core
+				SendCoreMessage(userMessageID | MSG_RELEASE_ALL, i, MAILBOX_MESSAGE);// One message releases all on core
+			}
+		}
+	}
+}
+
+/*-[ xTaskConditionWait ]---------------------------------------------------}
+.  Condition variable wait. The caller must hold the semaphore, which is
+.  given and the task put to wait on the message ID as one step so no
+.  release can be lost in between. The semaphore is taken again before the
+.  call returns. Signal with xTaskReleaseMessage or broadcast to all the
+.  waiters with xTaskReleaseMessageAll.
+.--------------------------------------------------------------------------*/
+void xTaskConditionWait (const RegType_t userMessageID,				// Message ID being the condition
+						 SemaphoreHandle_t sem)						// Semaphore held by caller protecting the condition
+{
+	if (MSG_ID_VALID(userMessageID))								// Valid user Message ID must be used
+	{
+		RegType_t state = CoreMaskInterrupts();						// No release can get in until we are waiting
+		struct CoreControlBlock* cb = this_cpu();					// Core block read masked so task can not be moved
+		struct TaskControlBlock* task = (struct TaskControlBlock*) cb->pxCurrentTCB;
+		RemoveTaskFromList(&cb->readyTasks, task);					// Remove task from ready list
+		task->waitMessageID = userMessageID;						// Set wait on message ID
+		task->taskState = tskBLOCKED_CHAR;							// Change task state to blocked
+		AddTaskToList(&cb->waitMsgTasks, task);						// Add the task to wait message task list
+		xSemaphoreGive(sem);										// Release the condition semaphore
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		ImmediateYield;												// Immediate yield ... returns when released
+		xSemaphoreTake(sem);										// Take the condition semaphore again
+	}
+}
+
+/*-[ xTaskNotify ]----------------------------------------------------------}
+.  Updates the 32 bit notification value of the given task by the action
+.  and marks a notification pending. If the task is blocked in a call to
+.  xTaskNotifyWait it is made ready. No list is searched, if the task is on
+.  another core a single mailbox doorbell is sent to that core only. It is
+.  valid to call this from tasks or interrupts on any core.
+.  RETURN: true for success, false for an invalid task handle
+.--------------------------------------------------------------------------*/
+bool xTaskNotify (TaskHandle_t xTaskToNotify,						// Handle of the task to notify
+				  uint32_t ulValue,									// Value used by the action
+				  eNotifyAction eAction)							// Action to perform on notification value
+{
+	struct TaskControlBlock* task = xTaskToNotify;
+	if ((task == 0) || (task->inUse == 0)) return false;			// Invalid task handle
+	switch (eAction)
+	{
+		case eSetBits:
+			__atomic_fetch_or(&task->notifyValue, ulValue, __ATOMIC_RELAXED);
+			break;
+		case eIncrement:
+			__atomic_fetch_add(&task->notifyValue, 1, __ATOMIC_RELAXED);
+			break;
+		case eSetValueWithOverwrite:
+			__atomic_store_n(&task->notifyValue, ulValue, __ATOMIC_RELAXED);
+			break;
+		default:
+			return false;											// Invalid action
+	}
+	__atomic_store_n(&task->notifyPending, 1, __ATOMIC_SEQ_CST);	// Notification now pending
+	if (__atomic_load_n(&task->notifyWaiting, __ATOMIC_SEQ_CST))	// Task is blocked (or blocking) waiting on it
+		WakeNotifiedTask(task);										// Wake the task
+	return true;													// Return success
+}
+
+/*-[ xTaskNotifyWait ]------------------------------------------------------}
+.  Blocks the calling task until a notification is pending, returning at
+.  once if one already is. The bits in ulBitsToClearOnEntry are cleared in
+.  the notification value if no notification was pending on entry and the
+.  bits in ulBitsToClearOnExit are cleared before the call returns.
+.  RETURN: The notification value before the exit bits were cleared
+.--------------------------------------------------------------------------*/
+uint32_t xTaskNotifyWait (uint32_t ulBitsToClearOnEntry,			// Notification bits to clear on entry
+						  uint32_t ulBitsToClearOnExit)				// Notification bits to clear on exit
+{
+	RegType_t state = CoreMaskInterrupts();							// Task can not be moved while we read it
+	struct TaskControlBlock* task = (struct TaskControlBlock*) this_cpu()->pxCurrentTCB;
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	if (__atomic_load_n(&task->notifyPending, __ATOMIC_ACQUIRE) == 0)// Nothing pending on entry
+		__atomic_fetch_and(&task->notifyValue, ~ulBitsToClearOnEntry, __ATOMIC_RELAXED);
+	while (__atomic_load_n(&task->notifyPending, __ATOMIC_ACQUIRE) == 0)
+	{
+		state = CoreMaskInterrupts();								// Wake may come from IRQ or FIQ on this core
+		struct CoreControlBlock* cb = this_cpu();					// Core block read masked so task can not be moved
+		__atomic_store_n(&task->notifyWaiting, 1, __ATOMIC_SEQ_CST);// We are about to block
+		if (__atomic_load_n(&task->notifyPending, __ATOMIC_SEQ_CST))// Notifier got in first
+		{
+			__atomic_store_n(&task->notifyWaiting, 0, __ATOMIC_RELAXED);
+			CoreRestoreInterrupts(state);							// Restore interrupt state
+			break;
+		}
+		RemoveTaskFromList(&cb->readyTasks, task);					// Remove task from ready list
+		task->taskState = tskBLOCKED_CHAR;							// Change task state to blocked
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		ImmediateYield;												// Immediate yield ... returns when notified
+	}
+	__atomic_store_n(&task->notifyPending, 0, __ATOMIC_SEQ_CST);	// Notification taken
+	return __atomic_fetch_and(&task->notifyValue, ~ulBitsToClearOnExit, __ATOMIC_RELAXED);
+}
+
+/*-[ xEventGroupCreate ]----------------------------------------------------}
+.  Creates an event group of 32 event bits all initially clear.
+.  RETURN: The event group handle, NULL if no event group is available
+.--------------------------------------------------------------------------*/
+EventGroupHandle_t xEventGroupCreate (void)
+{
+	for (int i = 0; i < configMAX_EVENT_GROUPS; i++)
+	{
+		if (__atomic_exchange_n(&eventGroups[i].inUse, 1, __ATOMIC_ACQ_REL) == 0)
+		{
+			eventGroups[i].bits = 0;								// All event bits clear
+			for (int j = 0; j < MAX_CPU_CORES; j++)
+				eventGroups[i].waiters[j] = 0;						// No waiters on any core
+			return &eventGroups[i];									// Return the event group
+		}
+	}
+	return 0;														// No event group available
+}
+
+/*-[ xEventGroupSetBits ]---------------------------------------------------}
+.  Sets the bits in the event group and makes ready only those tasks, on
+.  any core, whose wait condition is now met. Cores with no task waiting on
+.  the group are not interrupted. It is valid to call this from tasks or
+.  interrupts on any core.
+.  RETURN: The event group bits after the bits were set
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupSetBits (EventGroupHandle_t xEventGroup,		// The event group
+							 uint32_t uxBitsToSet)					// The bits to set
+{
+	if ((xEventGroup == 0) || (xEventGroup->inUse == 0)) return 0;	// Invalid event group
+	uint32_t bits = __atomic_or_fetch(&xEventGroup->bits, uxBitsToSet, __ATOMIC_SEQ_CST);
+	RegType_t state = CoreMaskInterrupts();							// Stay on this core while checking it
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so caller can not be moved
+	unsigned int corenum = CoreIndex(cb);							// Core checked directly
+	for (unsigned int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		if (__atomic_load_n(&xEventGroup->waiters[i], __ATOMIC_SEQ_CST))// Core has tasks waiting on the group
+		{
+			if (i == corenum) ScanEventWaiters(cb, i);				// Our core so check waiters directly
+				else SendCoreMessage(DOORBELL_EVENT, i, MAILBOX_DOORBELL);// Ring that core doorbell to check its waiters
+		}
+	}
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	return bits;													// Return bits after set
+}
+
+/*-[ xEventGroupClearBits ]-------------------------------------------------}
+.  Clears the bits in the event group.
+.  RETURN: The event group bits before the bits were cleared
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupClearBits (EventGroupHandle_t xEventGroup,		// The event group
+							   uint32_t uxBitsToClear)				// The bits to clear
+{
+	if ((xEventGroup == 0) || (xEventGroup->inUse == 0)) return 0;	// Invalid event group
+	return __atomic_fetch_and(&xEventGroup->bits, ~uxBitsToClear, __ATOMIC_SEQ_CST);
+}
+
+/*-[ xEventGroupGetBits ]---------------------------------------------------}
+.  RETURN: The current event group bits
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupGetBits (EventGroupHandle_t xEventGroup)		// The event group
+{
+	if ((xEventGroup == 0) || (xEventGroup->inUse == 0)) return 0;	// Invalid event group
+	return __atomic_load_n(&xEventGroup->bits, __ATOMIC_SEQ_CST);
+}
+
+/*-[ xEventGroupWaitBits ]--------------------------------------------------}
+.  Blocks the calling task until any (xWaitForAllBits false) or all of the
+.  bits in uxBitsToWaitFor are set in the event group, returning at once if
+.  they already are. If xClearOnExit is true the bits waited for are cleared
+.  in the same atomic operation that satisfies the wait.
+.  RETURN: The event group bits at the time the wait was satisfied
+.--------------------------------------------------------------------------*/
+uint32_t xEventGroupWaitBits (EventGroupHandle_t xEventGroup,		// The event group
+							  uint32_t uxBitsToWaitFor,				// The bits to wait for
+							  bool xClearOnExit,					// Clear the bits waited for on exit
+							  bool xWaitForAllBits)					// Wait for all bits rather than any bit
+{
+	if ((xEventGroup == 0) || (xEventGroup->inUse == 0) || (uxBitsToWaitFor == 0))
+		return 0;													// Invalid event group or no bits
+	RegType_t state = CoreMaskInterrupts();							// Lists are also changed by IRQ and FIQ
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so task can not be moved
+	unsigned int corenum = CoreIndex(cb);							// Core the task waits on
+	struct TaskControlBlock* task = (struct TaskControlBlock*) cb->pxCurrentTCB;
+	task->eventGroup = xEventGroup;									// Hold the event group
+	task->eventWaitBits = uxBitsToWaitFor;							// Hold the wait bits
+	task->eventWaitAll = (xWaitForAllBits) ? 1 : 0;					// Hold wait any or all
+	task->eventClearOnExit = (xClearOnExit) ? 1 : 0;				// Hold clear on exit
+	__atomic_fetch_add(&xEventGroup->waiters[corenum], 1, __ATOMIC_SEQ_CST);// Setters must now check this core
+	if (TryEventWait(task))											// Condition already met
+	{
+		__atomic_fetch_sub(&xEventGroup->waiters[corenum], 1, __ATOMIC_SEQ_CST);
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		return task->eventResult;									// Return bits that satisfied wait
+	}
+	RemoveTaskFromList(&cb->readyTasks, task);						// Remove task from ready list
+	task->taskState = tskBLOCKED_CHAR;								// Change task state to blocked
+	AddTaskToList(&cb->waitEventTasks, task);						// Add the task to wait event task list
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	ImmediateYield;													// Immediate yield ... returns when condition met
+	return task->eventResult;										// Return bits that satisfied wait
+}
+
+/*-[ xTaskWaitOnSemaphore ]------------------------------------------------}
+.  Blocks the calling task until the binary semaphore count word is taken
+.  or time_wait ticks pass. The task is counted in waiters for its core and
+.  put in the wait semaphore and delayed lists, then tries the take once
+.  more with interrupts masked, so a give in between is never missed.
+.  RETURN: true if the semaphore was taken, false if timed out
+.--------------------------------------------------------------------------*/
+bool xTaskWaitOnSemaphore (volatile uint32_t* count,				// Count word of the semaphore, 0 = free
+						   volatile uint32_t* waiters,				// Count of waiting tasks on each core
+						   const unsigned int time_wait)			// Maximum ticks to wait for the semaphore
+{
+	RegType_t state = CoreMaskInterrupts();							// Task can not be moved while we read it
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so task can not be moved
+	bool running = cb->xSchedulerRunning;							// No task to block before the scheduler starts
+	RegType_t releaseTime = cb->OSTickCounter + time_wait;			// Calculate release tick value
+	struct TaskControlBlock* task = (struct TaskControlBlock*) cb->pxCurrentTCB;
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	while (1)
+	{
+		uint32_t expected = 0;
+		state = CoreMaskInterrupts();								// Lists are also changed by IRQ and FIQ
+		cb = this_cpu();											// Core block read masked so task can not be moved
+		unsigned int corenum = CoreIndex(cb);						// Core the task waits on
+		__atomic_fetch_add(&waiters[corenum], 1, __ATOMIC_SEQ_CST);	// Givers must now check this core
+		if (__atomic_compare_exchange_n(count, &expected, 1,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)				// Semaphore taken
+			|| !running || (cb->OSTickCounter >= releaseTime))		// Or no time left to wait
+		{
+			__atomic_fetch_sub(&waiters[corenum], 1, __ATOMIC_SEQ_CST);
+			CoreRestoreInterrupts(state);							// Restore interrupt state
+			return (expected == 0);									// Return if the semaphore was taken
+		}
+		RemoveTaskFromList(&cb->readyTasks, task);					// Remove task from ready list
+		task->taskState = tskBLOCKED_CHAR;							// Change task state to blocked
+		task->timedOut = 0;											// Not timed out yet
+		task->semCount = count;										// Hold the semaphore waited on
+		AddTaskToList(&cb->waitSemTasks, task);						// Add the task to wait semaphore task list
+		task->waitList = &cb->waitSemTasks;							// Hold the wait list so timeout can remove task
+		task->ReleaseTime = releaseTime;							// Release tick value
+		AddTaskToDelayList(&cb->delayedTasks, task);				// Add the task to delay list as well
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		ImmediateYield;												// Immediate yield ... returns on give or timeout
+		__atomic_fetch_sub(&waiters[corenum], 1, __ATOMIC_SEQ_CST);	// Try again, a timeout gets one last try
+	}
+}
+
+/*-[ xTaskReleaseSemaphore ]-----------------------------------------------}
+.  Called after the binary semaphore count word has been cleared by a give.
+.  Makes ready the tasks waiting on it, directly on this core and by a
+.  doorbell on the other cores, only on cores that have a waiting task.
+.--------------------------------------------------------------------------*/
+void xTaskReleaseSemaphore (volatile uint32_t* waiters)				// Count of waiting tasks on each core
+{
+	RegType_t state = CoreMaskInterrupts();							// Stay on this core while checking it
+	struct CoreControlBlock* cb = this_cpu();						// Core block read masked so caller can not be moved
+	unsigned int corenum = CoreIndex(cb);							// Core checked directly
+	for (unsigned int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		if (__atomic_load_n(&waiters[i], __ATOMIC_SEQ_CST))			// Core has tasks waiting on the semaphore
+		{
+			if (i == corenum) ScanSemaphoreWaiters(cb);				// Our core so check waiters directly
+				else SendCoreMessage(DOORBELL_SEM, i, MAILBOX_DOORBELL);// Ring that core doorbell to check its waiters
+		}
+	}
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+}
+
+/*-[ xCoreCall ]------------------------------------------------------------}
+.  Runs the function with the argument on the given core. The call is made
+.  from the mailbox 2 FIQ of that core, so it runs with interrupts masked
+.  and must be short and must not block. If the core is the calling core
+.  the function is simply called. With xWait true the call returns after
+.  the function has completed, which must not be asked from an interrupt.
+.  With xWait false it returns once the call is queued. Only valid once the
+.  scheduler is started.
+.  RETURN: true for success, false for invalid core or no async call available
+.--------------------------------------------------------------------------*/
+bool xCoreCall (uint8_t corenum,									// The core to run the function on
+				CoreCallFunction_t pxFunction,						// The function to run
+				void* pvArg,										// Argument passed to the function
+				bool xWait)											// Wait for the function to complete
+{
+	if ((corenum >= MAX_CPU_CORES) || (pxFunction == 0)) return false;// Invalid core or function
+	RegType_t state = CoreMaskInterrupts();							// Stay on this core while checking it
+	if (&coreCB[corenum] == this_cpu())								// Our own core so just call it
+	{
+		pxFunction(pvArg);											// Masked as it would be from the FIQ
+		CoreRestoreInterrupts(state);								// Restore interrupt state
+		return true;
+	}
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	if (xWait)
+	{
+		struct CoreCall call = { .function = pxFunction, .arg = pvArg };
+		PushCoreCall(corenum, &call);								// Queue call to the core
+		while (__atomic_load_n(&call.done, __ATOMIC_ACQUIRE) == 0) {};// Wait for it to complete
+		return true;
+	}
+	struct CoreCall* call = AllocAsyncCall();						// Take a call from the cache
+	if (call == 0) return false;									// None free
+	call->function = pxFunction;
+	call->arg = pvArg;
+	PushCoreCall(corenum, call);									// Queue call to the core
+	return true;
+}
+
+/*-[ xCoreCallBroadcast ]---------------------------------------------------}
+.  As xCoreCall but runs the function on every core set in the core mask,
+.  bit 0 being core 0. With xWait true it returns once all have completed.
+.  RETURN: true for success, false if any of the calls could not be made
+.--------------------------------------------------------------------------*/
+bool xCoreCallBroadcast (uint32_t coreMask,							// Bit mask of cores to run function on
+						 CoreCallFunction_t pxFunction,				// The function to run
+						 void* pvArg,								// Argument passed to the function
+						 bool xWait)								// Wait for all the functions to complete
+{
+	struct CoreCall calls[MAX_CPU_CORES] = { 0 };
+	bool result = true;
+	if (pxFunction == 0) return false;								// Invalid function
+	RegType_t state = CoreMaskInterrupts();							// Stay on this core until our own call is made
+	unsigned int corenum = CoreIndex(this_cpu());					// Core read masked so caller can not be moved
+	for (unsigned int i = 0; i < MAX_CPU_CORES; i++)				// Queue to all other cores first
+	{
+		if ((coreMask & (1 << i)) && (i != corenum))
+		{
+			if (xWait)
+			{
+				calls[i].function = pxFunction;
+				calls[i].arg = pvArg;
+				PushCoreCall(i, &calls[i]);							// Queue waited call to the core
+			}
+			else result &= xCoreCall(i, pxFunction, pvArg, false);	// Queue async call to the core
+		}
+	}
+	if (coreMask & (1 << corenum)) pxFunction(pvArg);				// Our own core runs it while the others do
+	CoreRestoreInterrupts(state);									// Restore interrupt state, waits run unmasked
+	if (xWait)
+	{
+		for (unsigned int i = 0; i < MAX_CPU_CORES; i++)
+		{
+			if ((coreMask & (1 << i)) && (i != corenum))
+				while (__atomic_load_n(&calls[i].done, __ATOMIC_ACQUIRE) == 0) {};// Wait for it to complete
+		}
+	}
+	return result;
+}
+
 /*-[ xTaskStartScheduler ]--------------------------------------------------}
 .  starts the xRTOS task scheduler effectively starting the whole system
 .--------------------------------------------------------------------------*/
@@ -377,8 +1411,18 @@ void xTaskStartScheduler( void )
 	/* Calculate divisor to create Timer Tick frequency on EL0 timer */
 	m_nClockTicksPerHZTick = (EL0_Timer_Frequency() / configTICK_RATE_HZ);
 
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	/* Precalculate each schedule table slot time in EL0 timer counts */
+	for (int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		for (unsigned int j = 0; j < coreCB[i].scheduleSlots; j++)
+			coreCB[i].slotTimerCount[j] = ((uint64_t)EL0_Timer_Frequency() * coreCB[i].scheduleTable[j].slotTimeUs) / 1000000;
+	}
+#endif
+
 	/* MMU table setup done by core 0 */
 	MMU_setup_pagetable();
+	MMU_set_core_sync(MmuSyncCores);								// Unmapping executable memory waits on a core call
 
 	/* Set each CORE FIQ to the basic mailbox handler */
 	CoreMailboxFiqSetup(coreFIQHandler, 0, 0);
@@ -386,6 +1430,14 @@ void xTaskStartScheduler( void )
 	CoreMailboxFiqSetup(coreFIQHandler, 2, 0);
 	CoreMailboxFiqSetup(coreFIQHandler, 3, 0);
 
+	/* Route each CORE kernel doorbell and call mailbox to the same FIQ handler */
+	for (int i = 0; i < MAX_CPU_CORES; i++)
+	{
+		CoreMailboxFiqSetup(coreFIQHandler, i, MAILBOX_DOORBELL);
+		CoreMailboxFiqSetup(coreFIQHandler, i, MAILBOX_CALL);
+		CoreMailboxIrqSetup(i, MAILBOX_RESCHEDULE);					// Reschedule interrupt goes to IRQ to switch tasks
+	}
+
 	/* Start each core in reverse order because core0 is running this code  */
 	CoreExecute(3, StartTasksOnCore);								// Start tasks on core3
 	CoreExecute(2, StartTasksOnCore);								// Start tasks on core2
@@ -393,12 +1445,66 @@ void xTaskStartScheduler( void )
 	StartTasksOnCore();												// Start tasks on core0
 }
 
+/*-[ xTaskGetTickCount ]---------------------------------------------------}
+.  Returns the tick count of the core this is called from
+.--------------------------------------------------------------------------*/
+RegType_t xTaskGetTickCount (void)
+{
+	return this_cpu()->OSTickCounter;								// Return tick count on current core
+}
+
+/*-[ xTaskGetCoreTickCount ]-----------------------------------------------}
+.  Returns the tick count of the given core, for work timed on that core
+.  from another. Core tick counts are not kept in step with each other.
+.--------------------------------------------------------------------------*/
+RegType_t xTaskGetCoreTickCount (uint8_t corenum)
+{
+	if (corenum >= MAX_CPU_CORES) return 0;							// Invalid core
+	return __atomic_load_n(&coreCB[corenum].OSTickCounter, __ATOMIC_RELAXED);// Return tick count of that core
+}
+
+/*-[ xTaskGetSchedulerState ]----------------------------------------------}
+.  Returns if the scheduler is running on the core this is called from.
+.  It is used before xRTOS_Init has set TPIDR, so the core number is read
+.  from MPIDR, but masked so the caller can not be moved between the two.
+.  RETURN: taskSCHEDULER_RUNNING or taskSCHEDULER_NOT_STARTED
+.--------------------------------------------------------------------------*/
+unsigned int xTaskGetSchedulerState (void)
+{
+	RegType_t state = CoreMaskInterrupts();							// Stay on this core while reading it
+	unsigned int running = coreCB[getCoreID()].xSchedulerRunning;
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	return (running) ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+/*-[ xTaskGetCoreID ]-------------------------------------------------------}
+.  Returns the core number of the calling core through TPIDR, for per core
+.  data outside the task code. Only valid once xRTOS_Init has run on the
+.  core, and the caller must have interrupts masked if it may be moved.
+.--------------------------------------------------------------------------*/
+unsigned int xTaskGetCoreID (void)
+{
+	return CoreIndex(this_cpu());									// Core of the core block in TPIDR
+}
+
+/*-[ xTaskGetCurrentTaskHandle ]--------------------------------------------}
+.  Returns the handle of the task calling, for passing to a driver that
+.  notifies it when an operation it started completes
+.--------------------------------------------------------------------------*/
+TaskHandle_t xTaskGetCurrentTaskHandle (void)
+{
+	RegType_t state = CoreMaskInterrupts();							// Task can not be moved while we read it
+	TaskHandle_t task = (TaskHandle_t) this_cpu()->pxCurrentTCB;
+	CoreRestoreInterrupts(state);									// Restore interrupt state
+	return task;
+}
+
 /*-[ xTaskGetNumberOfTasks ]------------------------------------------------}
 .  Returns the number of xRTOS tasks assigned to the core this is called
 .--------------------------------------------------------------------------*/
 unsigned int xTaskGetNumberOfTasks (void )
 {
-	return coreCB[getCoreID()].uxCurrentNumberOfTasks;				// Return number of tasks on current core
+	return this_cpu()->uxCurrentNumberOfTasks;						// Return number of tasks on current core
 }
 
 /*-[ xLoadPercentCPU ]------------------------------------------------------}
@@ -406,7 +1512,192 @@ unsigned int xTaskGetNumberOfTasks (void )
 .--------------------------------------------------------------------------*/
 unsigned int xLoadPercentCPU (void)
 {
-	return (((configTICK_RATE_HZ - coreCB[getCoreID()].uxPercentLoadCPU) * 100) / configTICK_RATE_HZ);
+	return (((configTICK_RATE_HZ - this_cpu()->uxPercentLoadCPU) * 100) / configTICK_RATE_HZ);
+}
+
+/*-[ xLoadPercentCore ]----------------------------------------------------}
+.  Returns the load on the given core in percent (0 - 100)
+.--------------------------------------------------------------------------*/
+unsigned int xLoadPercentCore (uint8_t corenum)
+{
+	if (corenum >= MAX_CPU_CORES) return 0;							// Invalid core
+	return (((configTICK_RATE_HZ - coreCB[corenum].uxPercentLoadCPU) * 100) / configTICK_RATE_HZ);
+}
+
+/*-[ xIdleResidencyPercent ]-----------------------------------------------}
+.  Returns the percent of the last analysis frame (0 - 100) that the core
+.  this is called from spent asleep in WFI in the idle task.
+.--------------------------------------------------------------------------*/
+unsigned int xIdleResidencyPercent (void)
+{
+	return this_cpu()->uxIdleResidency;								// Return idle residency on current core
+}
+
+/*-[ xTaskSetBestEffort ]---------------------------------------------------}
+.  Marks a task as best effort, a task with no real time need that may be
+.  moved to another core, or back to real time which keeps it on its core.
+.  Tasks are created real time.
+.  RETURN: true for success, false for an invalid task
+.--------------------------------------------------------------------------*/
+bool xTaskSetBestEffort (TaskHandle_t xTask, bool xBestEffort)
+{
+	if ((xTask == 0) || (xTask->inUse == 0)) return false;			// Invalid task
+	xTask->bestEffort = (xBestEffort) ? 1 : 0;						// Set the best effort flag
+	return true;
+}
+
+/*-[ xTaskMigrate ]---------------------------------------------------------}
+.  Requests the task be moved to the given core. The core the task is on
+.  moves it at its next tick once the task is ready and not running, so a
+.  blocked task moves once it is made ready. Idle tasks and tasks on, or to
+.  a core with, a cyclic executive table can not be moved. May be called
+.  from any core once the scheduler is running.
+.  RETURN: true if the move was requested, false if it can not be moved
+.--------------------------------------------------------------------------*/
+bool xTaskMigrate (TaskHandle_t xTask, uint8_t corenum)
+{
+	if ((xTask == 0) || (xTask->inUse == 0) || (corenum >= MAX_CPU_CORES)
+		|| (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+		return false;												// Invalid task or core or too early
+	unsigned int from = xTask->assignedCore;						// Core the task is on now
+	if ((xTask == coreCB[from].xIdleTaskHandle)
+		|| (coreCB[corenum].xSchedulerRunning == 0))
+		return false;												// Idle task or core not running
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	if (coreCB[from].scheduleTable || coreCB[corenum].scheduleTable)
+		return false;												// Cyclic executive cores keep their tasks
+#endif
+	if (__atomic_exchange_n(&xTask->migrateTo, corenum + 1, __ATOMIC_ACQ_REL) == 0)
+		__atomic_fetch_add(&coreCB[from].migratePending, 1, __ATOMIC_RELEASE);// New request for that core
+	return true;
+}
+
+/*-[ xTaskSetAddressSpace ]------------------------------------------------}
+.  Puts a task in an address space from MMU_space_create, or back in the
+.  kernel map with ASID 0. The core switches TTBR0 as it switches the task
+.  in, which is all isolation costs as TLB entries are ASID tagged. The
+.  calling task switches at once, a task running on another core at its
+.  next switch in. Tasks are created in the kernel map. Only AARCH64.
+.  RETURN: true for success, false for an invalid task or space
+.--------------------------------------------------------------------------*/
+bool xTaskSetAddressSpace (TaskHandle_t xTask, uint16_t asid)
+{
+	RegType_t ttbr0 = MMU_space_ttbr0(asid);						// TTBR0 value of the space
+	if ((xTask == 0) || (xTask->inUse == 0) || (ttbr0 == 0)) return false;// Invalid task or space
+	CoreEnterCritical();											// Current task can not change
+	xTask->ttbr0 = ttbr0;											// Loaded as the task is switched in
+	if (this_cpu()->pxCurrentTCB == xTask) MMU_set_ttbr0(ttbr0);	// Calling task switches now
+	CoreExitCritical();
+	return true;
+}
+
+/*-[ xTaskSetFaultHook ]----------------------------------------------------}
+.  Sets a function called when a task faults, stackOverflow being true if
+.  it ran off the bottom of its stack into the guard page below it. It is
+.  called from the exception with interrupts masked on a stack of its own,
+.  so it should only record or print. The task is then stopped for good and
+.  the core goes on with its other tasks.
+.--------------------------------------------------------------------------*/
+void xTaskSetFaultHook (void (*hook) (TaskHandle_t xTask, const char* pcTaskName, bool stackOverflow, RegType_t faultAddress))
+{
+	taskFaultHook = hook;
+}
+
+/*-[ xTaskSetGpuIrqHandler ]------------------------------------------------}
+.  Sets a function the core IRQ handler calls when the GPU peripheral
+.  interrupt is pending, before it looks at the timer tick. It is called in
+.  the IRQ on the core the GPU interrupt is routed to, core 0 by default,
+.  so it must clear the source and may only use calls safe from an IRQ.
+.--------------------------------------------------------------------------*/
+void xTaskSetGpuIrqHandler (void (*handler) (void))
+{
+	gpuIrqHandler = handler;
+}
+
+/*-[ xTaskPackBestEffort ]--------------------------------------------------}
+.  Requests every best effort task be moved to the given core, leaving the
+.  other cores with only their real time tasks so they can sit in WFI.
+.  RETURN: Number of tasks asked to move
+.--------------------------------------------------------------------------*/
+unsigned int xTaskPackBestEffort (uint8_t corenum)
+{
+	unsigned int count = 0;
+	struct TaskControlBlock* task = __atomic_load_n(&taskRegistry, __ATOMIC_ACQUIRE);
+	for (; task != 0; task = task->registryNext)
+		if (task->bestEffort && xTaskMigrate(task, corenum))
+			count++;
+	return count;
+}
+
+/*-[ xTaskUnpackBestEffort ]------------------------------------------------}
+.  Requests every best effort task be moved back to the core it was created
+.  on, undoing xTaskPackBestEffort.
+.  RETURN: Number of tasks asked to move
+.--------------------------------------------------------------------------*/
+unsigned int xTaskUnpackBestEffort (void)
+{
+	unsigned int count = 0;
+	struct TaskControlBlock* task = __atomic_load_n(&taskRegistry, __ATOMIC_ACQUIRE);
+	for (; task != 0; task = task->registryNext)
+		if (task->bestEffort && xTaskMigrate(task, task->homeCore))
+			count++;
+	return count;
+}
+
+/*-[ xTaskSetScheduleTable ]------------------------------------------------}
+.  Sets the static cyclic executive schedule table (major frame) for a core.
+.  Each slot dispatches its task until the slot time expires at which point
+.  the next slot is dispatched, after the last slot the table repeats. Only
+.  active when configSCHEDULER_MODE is configSCHEDULER_CYCLIC and it must be
+.  called before xTaskStartScheduler. The table must stay valid (static).
+.  A core with no table set continues to round robin on the timer tick.
+.  RETURN: true for success, false for invalid core or table size
+.--------------------------------------------------------------------------*/
+bool xTaskSetScheduleTable (uint8_t corenum,						// The core number the table is for
+							const ScheduleSlot_t* table,			// The schedule table of slots
+							unsigned int slotCount)					// Number of slots in the table
+{
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	if ((corenum < MAX_CPU_CORES) && table && (slotCount > 0) && (slotCount <= configMAX_SCHEDULE_SLOTS))
+	{
+		coreCB[corenum].scheduleSlots = slotCount;					// Hold the number of slots
+		coreCB[corenum].scheduleIndex = 0;							// Start at the first slot
+		coreCB[corenum].scheduleTable = table;						// Hold the schedule table
+		return true;												// Return success
+	}
+#endif
+	return false;													// Return failure
+}
+
+/*-[ xTaskEndSlot ]---------------------------------------------------------}
+.  Called by a cyclic executive task when its work for the current slot is
+.  complete. The core idles for the rest of the slot and the call returns
+.  at the start of the next slot assigned to the task. A task that has not
+.  called this by the end of its slot is counted as a slot overrun.
+.--------------------------------------------------------------------------*/
+void xTaskEndSlot (void)
+{
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	struct CoreControlBlock* cb = this_cpu();						// Set pointer to core block
+	if (cb->scheduleTable)											// Core is running a cyclic executive
+	{
+		cb->pxCurrentTCB->slotDone = 1;								// Task work for this slot is done
+		ImmediateYield;												// Immediate yield ... core idles until next slot for task
+	}
+#endif
+}
+
+/*-[ xTaskGetOverrunCount ]-------------------------------------------------}
+.  Returns the number of cyclic executive slot overruns detected on the
+.  core this is called from.
+.--------------------------------------------------------------------------*/
+unsigned int xTaskGetOverrunCount (void)
+{
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	return this_cpu()->slotOverruns;								// Return slot overruns on current core
+#else
+	return 0;														// No slots so never an overrun
+#endif
 }
 
 
@@ -417,7 +1708,7 @@ unsigned int xLoadPercentCPU (void)
  */
 void xTaskIncrementTick (void)
 {
-	struct CoreControlBlock* ccb = &coreCB[getCoreID()];
+	struct CoreControlBlock* ccb = this_cpu();
 
 	if (ccb->xCoreBlockInitialized == 1)							// Check the core block is initialized  
 	{
@@ -434,22 +1725,31 @@ void xTaskIncrementTick (void)
 				ccb->uxCPULoadCount = 0;							// Zero the config count for next analysis process period to start again
 				ccb->uxPercentLoadCPU = ccb->uxIdleTickCount;		// Transfer the idletickcount to uxPercentLoadCPU we will only do calc when asked
 				ccb->uxIdleTickCount = 0;							// Zero the idle tick count
+				uint64_t now = ReadCoreCounter();					// Frame measured in counts so also right for cyclic slots
+				if (ccb->idleFrameStart && (now > ccb->idleFrameStart))
+					ccb->uxIdleResidency = (ccb->idleCounts * 100) / (now - ccb->idleFrameStart);
+				ccb->idleFrameStart = now;							// Start next analysis frame
+				ccb->idleCounts = 0;								// Zero the idle counts
 			}
 			else ccb->uxCPULoadCount++;								// Increment the process tick count
 
 			/* Increment timer tick and check delaytasks for timeout */
 			ccb->OSTickCounter++;									// Increment OS tick counter
+			RegType_t state = CoreMaskInterrupts();					// FIQ may also change the lists
 			struct TaskControlBlock* task = ccb->delayedTasks.head;	// Set task to delay head
 			while (task != 0)
 			{
+				struct TaskControlBlock* next = task->delayNext;	// Hold next as task may leave list
 				if (ccb->OSTickCounter >= task->ReleaseTime)		// Check if release time is up
 				{
-					RemoveTaskFromList(&ccb->delayedTasks, task);	// Remove the task from delay list
-					task->taskState = tskREADY_CHAR;				// Set the read char state
-					AddTaskToList(&ccb->readyTasks, task);			// Add the task to the ready list
+					if (task->waitList) task->timedOut = 1;			// Timed wait so it timed out
+					ReadyBlockedTask(ccb, task->waitList, task);	// Remove from delay and any wait list to ready
 				}
-				task = task->next;									// Next delayed task
+				task = next;										// Next delayed task
 			}
+			CoreRestoreInterrupts(state);							// Restore interrupt state
+
+			xTimerTickCheck(ccb->OSTickCounter);					// Defer timer expiry if a timer is due
 		}
 	}
 }
@@ -460,27 +1760,122 @@ void xTaskIncrementTick (void)
  */
 void xSchedule (void)
 {
-	struct CoreControlBlock* ccb = &coreCB[getCoreID()];			// Pointer to core control block
+	struct CoreControlBlock* ccb = this_cpu();						// Pointer to core control block
 	if (ccb->xCoreBlockInitialized == 1)							// Check the core block is initialized  
 	{
 		if (ccb->uxSchedulerSuspended == 0)							// Core scheduler not suspended
 		{
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+			if (ccb->scheduleTable)									// Core is running a cyclic executive
+			{
+				SelectSlotTask(ccb);								// Only ever the slot task or idle
+				return;
+			}
+#endif
 			struct TaskControlBlock* next = ccb->pxCurrentTCB->next;
 			if (next)												// Check current task has a next ready task
 				ccb->pxCurrentTCB = next;							// Simply load next ready
 				else ccb->pxCurrentTCB = ccb->readyTasks.head;		// No next ready so load readyTasks head
+			if (__atomic_load_n(&ccb->migratePending, __ATOMIC_ACQUIRE))
+				MigrateTasks(ccb);									// Move tasks asked to change core
 		}
 	}
 }
 
+/*
+ *	Called from the exception stubs, on a stack of their own, for a fault in
+ *	a task. The task can not go on so it is reported, taken off the ready
+ *	list for good and the next task picked. A fault with nothing else to run
+ *	stops the core.
+ */
+void xTaskFault (RegType_t status, RegType_t address)
+{
+	struct CoreControlBlock* ccb = this_cpu();						// Pointer to core control block
+	struct TaskControlBlock* task = (struct TaskControlBlock*) ccb->pxCurrentTCB;
+#if __aarch64__ == 1
+	bool abort = ((status >> 26) == 0x25);							// Data abort at EL1, address is FAR_EL1
+#else
+	bool abort = true;												// Only data aborts get here, address is DFAR
+	(void)status;
+#endif
+	bool overflow = abort && task && (address - task->stackGuard < STACK_PAGE_SIZE);
+	if (taskFaultHook) taskFaultHook(task, (task) ? &task->pcTaskName[0] : 0, overflow, address);
+	if ((task == 0) || (task == ccb->xIdleTaskHandle) || (ccb->xSchedulerRunning == 0)
+		|| ccb->uxSchedulerSuspended)
+		for (;;) __asm volatile ("wfe");							// Nothing else may run so stop the core
+	RemoveTaskFromList(&ccb->readyTasks, task);						// Never ready again
+	task->taskState = tskSUSPENDED_CHAR;
+	xSchedule();													// Pick the next task, its next link still holds
+}
+
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+/*--------------------------------------------------------------------------}
+{	At each slot boundary check for overrun and dispatch the next slot.		}
+{	The kernel tick keeps its own period. Every tick due by this boundary	}
+{	is run here, so tick counts stay in 1/configTICK_RATE_HZ seconds and	}
+{	only the moment a tick takes effect is rounded up to the boundary.		}
+{--------------------------------------------------------------------------*/
+static void CyclicSlotBoundary (struct CoreControlBlock* ccb)
+{
+	struct TaskControlBlock* task = ccb->scheduleTable[ccb->scheduleIndex].task;
+	if (task && (task->slotDone == 0)								// Task still had work at end of its slot
+		&& ((task->taskState == tskREADY_CHAR) || (task->taskState == tskRUNNING_CHAR)))
+		ccb->slotOverruns++;										// and was still able to run so it overran, a blocked task did not
+	if (++ccb->scheduleIndex >= ccb->scheduleSlots)					// Next slot
+		ccb->scheduleIndex = 0;										// End of major frame so repeat table
+	uint64_t boundary = ccb->slotBoundary;							// Time of the boundary being handled
+	ccb->slotBoundary += ccb->slotTimerCount[ccb->scheduleIndex];	// Boundaries follow on from the last, not the ISR entry time
+	WriteCoreCompare(ccb->slotBoundary);							// Timer to next slot boundary first to keep jitter down
+	task = ccb->scheduleTable[ccb->scheduleIndex].task;
+	if (task) task->slotDone = 0;									// New slot so task has new work to do
+	while (ccb->tickBoundary <= boundary)							// Ticks due by this boundary, after the overrun check
+	{
+		xTaskIncrementTick();										// Catch up the kernel tick
+		ccb->tickBoundary += m_nClockTicksPerHZTick;				// Next tick on its own timebase
+	}
+	SelectSlotTask(ccb);											// Dispatch the slot task
+}
+#endif
+
 /*
  *	This is the TICK interrupt service routine, note. no SAVE/RESTORE_CONTEXT here
- *	as thats done in the bottom-half of the ISR in assembler.
+ *	as thats done in the bottom-half of the ISR in assembler. The reschedule
+ *	interrupt on mailbox 3 also arrives here and switches to the preempting task.
  */
 void xTickISR(void)
 {
+	unsigned int corenum = getCoreID();								// Get the core ID
+	struct CoreControlBlock* ccb = this_cpu();						// Pointer to core control block
+	uint32_t source = CoreIrqSource(corenum);						// Read the core IRQ sources
+	bool preempted = false;											// Set if a reschedule switched task
+	IdleExit(ccb);													// Interrupt may have woken core from WFI
+	if (source & QA7_IRQ_GPU)										// GPU peripheral interrupt
+	{
+		if (gpuIrqHandler) gpuIrqHandler();							// Let the driver clear and service it
+		if ((source & (QA7_IRQ_CNTPNSIRQ | QA7_IRQ_MAILBOX(MAILBOX_RESCHEDULE))) == 0) return;
+	}
+	if (source & QA7_IRQ_MAILBOX(MAILBOX_RESCHEDULE))				// Reschedule interrupt
+	{
+		uint32_t msg;
+		ReadCoreMessage(&msg, corenum, MAILBOX_RESCHEDULE);			// Clear the reschedule interrupt
+		struct TaskControlBlock* task = (struct TaskControlBlock*) ccb->pxPreemptTCB;
+		ccb->pxPreemptTCB = 0;										// Request taken
+		if (task && (task->taskState == tskREADY_CHAR))				// Task is still ready
+		{
+			ccb->pxCurrentTCB = task;								// Switch to it, round robin continues from it
+			preempted = true;
+		}
+		if ((source & QA7_IRQ_CNTPNSIRQ) == 0) return;				// Timer not also due
+	}
+#if (configSCHEDULER_MODE == configSCHEDULER_CYCLIC)
+	if (ccb->scheduleTable)											// Core is running a cyclic executive
+	{
+		CyclicSlotBoundary(ccb);									// Timer is at a slot boundary
+		return;
+	}
+#endif
 	xTaskIncrementTick();											// Run the timer tick
-	xSchedule();													// Run scheduler selecting next task 
+	if (!preempted) xSchedule();									// Run scheduler unless the preempting task was just selected
 	EL0_Timer_Set(m_nClockTicksPerHZTick);							// Set EL0 timer again for timer tick period
 }
 
@@ -0,0 +1,298 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "workqueue.h"
+
+/* Tick a is at or after tick b allowing for the tick counter wrapping */
+#define TICK_REACHED(a, b) ((RegType_t)((a) - (b)) < ((RegType_t)~0 >> 1))
+
+/*--------------------------------------------------------------------------}
+{					  SOFTWARE TIMER STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  Active timers sit in the core timer list in order of expiry so the tick
+.  need only look at the list head. Expired timers are moved as a batch to
+.  the core worker task using the separate batch link.
+.--------------------------------------------------------------------------*/
+struct xTimer
+{
+	struct xTimer* next;										/*< Next timer in core timer list */
+	struct xTimer* prev;										/*< Prev timer in core timer list */
+	struct xTimer* batchNext;									/*< Next timer in expired batch */
+	RegType_t expiry;											/*< Tick count at which timer expires */
+	RegType_t period;											/*< Timer period in ticks */
+	TimerCallbackFunction_t callback;							/*< Function called on expiry */
+	void* id;													/*< Private identifier for the callback */
+	struct {
+		volatile uint32_t active : 1;							/*< Timer is in the core timer list */
+		uint32_t autoReload : 1;								/*< Timer restarts itself on expiry */
+		uint32_t corenum : 3;									/*< Core the timer callback runs on */
+		uint32_t _reserved : 26;
+		volatile uint32_t inUse : 1;							/*< This timer is in use field */
+	};
+};
+
+/*--------------------------------------------------------------------------}
+{				  CORE TIMER CONTROL STRUCTURE DEFINED						}
+{--------------------------------------------------------------------------*/
+static struct __attribute__((aligned(PER_CPU_LINE))) TimerCoreBlock
+{
+	struct xTimer* head;										/*< First timer to expire on core */
+	volatile uint32_t lock;										/*< Spin lock for the core timer list, 0 is free */
+	volatile RegType_t nextExpiry;								/*< Tick of first expiry, read by tick without lock */
+	volatile uint32_t armed;									/*< Set when nextExpiry is valid */
+} timerCB[MAX_CPU_CORES] PER_CPU = { 0 };
+
+static struct xTimer timerBlock[configMAX_TIMERS] = { 0 };
+
+/*--------------------------------------------------------------------------}
+{	  Masks IRQ and FIQ on the core returning the previous mask state		}
+{--------------------------------------------------------------------------*/
+static inline RegType_t TimerMaskInterrupts (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	return state;
+}
+
+/*--------------------------------------------------------------------------}
+{		Restores the IRQ and FIQ mask state from TimerMaskInterrupts		}
+{--------------------------------------------------------------------------*/
+static inline void TimerRestoreInterrupts (RegType_t state)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Locks the core timer list with interrupts masked for the whole hold,	}
+{	so no task on the same core can be switched in to spin on it. Before	}
+{	the scheduler runs only core 0 runs so no exclusive is used, which		}
+{	matters as exclusives need the MMU on.									}
+{--------------------------------------------------------------------------*/
+static RegType_t LockTimerList (struct TimerCoreBlock* tcb)
+{
+	RegType_t state = TimerMaskInterrupts();						// No switch away while holding the lock
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		while (__atomic_exchange_n(&tcb->lock, 1, __ATOMIC_ACQUIRE) != 0) {};
+	return state;
+}
+
+static void UnlockTimerList (struct TimerCoreBlock* tcb, RegType_t state)
+{
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		__atomic_store_n(&tcb->lock, 0, __ATOMIC_RELEASE);
+	TimerRestoreInterrupts(state);
+}
+
+/*--------------------------------------------------------------------------}
+{	 Inserts timer in the core timer list in expiry order, lock must be held	}
+{--------------------------------------------------------------------------*/
+static void InsertTimer (struct TimerCoreBlock* tcb, struct xTimer* t, RegType_t now)
+{
+	struct xTimer* prev = 0;
+	struct xTimer* cur = tcb->head;
+	while (cur && ((cur->expiry - now) <= (t->expiry - now)))		// Equal expiry keep start order
+	{
+		prev = cur;
+		cur = cur->next;
+	}
+	t->prev = prev;
+	t->next = cur;
+	if (cur) cur->prev = t;
+	if (prev) prev->next = t;
+		else tcb->head = t;											// Timer is new head
+	t->active = 1;													// Timer now in list
+}
+
+/*--------------------------------------------------------------------------}
+{		Removes timer from the core timer list, lock must be held			}
+{--------------------------------------------------------------------------*/
+static void RemoveTimer (struct TimerCoreBlock* tcb, struct xTimer* t)
+{
+	if (t->prev) t->prev->next = t->next;
+		else tcb->head = t->next;
+	if (t->next) t->next->prev = t->prev;
+	t->next = t->prev = 0;
+	t->active = 0;													// Timer no longer in list
+}
+
+/*--------------------------------------------------------------------------}
+{	Publishes the first expiry for the tick to check, lock must be held		}
+{--------------------------------------------------------------------------*/
+static void UpdateNextExpiry (struct TimerCoreBlock* tcb)
+{
+	if (tcb->head)
+	{
+		tcb->nextExpiry = tcb->head->expiry;						// First timer to expire
+		__atomic_store_n(&tcb->armed, 1, __ATOMIC_RELEASE);			// Tick may now check it
+	}
+	else __atomic_store_n(&tcb->armed, 0, __ATOMIC_RELEASE);		// Nothing for tick to check
+}
+
+/*--------------------------------------------------------------------------}
+{	Deferred by the tick to the core worker task. Every timer that has		}
+{	expired when it runs is taken off the list as one batch and the			}
+{	callbacks then run without the lock held so they may start and stop		}
+{	timers themselves.														}
+{--------------------------------------------------------------------------*/
+static void TimerExpire (void* pvArg)
+{
+	struct TimerCoreBlock* tcb = pvArg;
+	struct xTimer* batch = 0;
+	struct xTimer** tail = &batch;
+	RegType_t now = xTaskGetTickCount();							// Current tick count
+	RegType_t state = LockTimerList(tcb);							// Lock the core timer list
+	while (tcb->head && TICK_REACHED(now, tcb->head->expiry))
+	{
+		struct xTimer* t = tcb->head;
+		RemoveTimer(tcb, t);										// Take expired timer off list
+		t->batchNext = 0;
+		*tail = t;													// Add to end of batch
+		tail = &t->batchNext;
+		if (t->autoReload)
+		{
+			t->expiry += t->period;									// Next expiry keeps the period phase
+			if (TICK_REACHED(now, t->expiry))						// We fell more than a period behind
+				t->expiry = now + t->period;
+			InsertTimer(tcb, t, now);								// Back on the list
+		}
+	}
+	UpdateNextExpiry(tcb);										// Publish new first expiry
+	UnlockTimerList(tcb, state);								// Release the core timer list
+	while (batch)												// Run the whole batch
+	{
+		struct xTimer* t = batch;
+		batch = t->batchNext;
+		if (t->callback) t->callback(t);						// Run the callback
+	}
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ xTimerCreate ]---------------------------------------------------------}
+.  Creates a software timer whose callback will run from the work queue
+.  worker task of the given core. The work queue for a core is created with
+.  its first timer so this must be called before xTaskStartScheduler.
+.  The timer is created dormant, use xTimerStart.
+.  RETURN: The timer handle, NULL if no timer is available
+.--------------------------------------------------------------------------*/
+TimerHandle_t xTimerCreate (uint8_t corenum,						// The core number the callback runs on
+							RegType_t xPeriodInTicks,				// Timer period in ticks (non zero)
+							bool xAutoReload,						// True = periodic, false = one shot
+							void* pvTimerID,						// Private identifier for the callback
+							TimerCallbackFunction_t pxCallbackFunction)// The callback function
+{
+	if ((corenum >= MAX_CPU_CORES) || (xPeriodInTicks == 0)) return 0;	// Invalid core or period
+	struct xTimer* t = 0;
+	if (xWorkQueueCreate(corenum))									// Core worker runs the callbacks
+	{
+		for (int i = 0; i < configMAX_TIMERS; i++)
+		{
+			if (timerBlock[i].inUse == 0)
+			{
+				t = &timerBlock[i];
+				*t = (struct xTimer){ 0 };							// Clear the timer
+				t->period = xPeriodInTicks;							// Hold the period
+				t->callback = pxCallbackFunction;					// Hold the callback
+				t->id = pvTimerID;									// Hold the identifier
+				t->autoReload = (xAutoReload) ? 1 : 0;				// Hold one shot or periodic
+				t->corenum = corenum;								// Hold the core
+				t->inUse = 1;										// Set the timer in use flag
+				break;
+			}
+		}
+	}
+	return t;
+}
+
+/*-[ xTimerStart ]----------------------------------------------------------}
+.  Starts, or restarts, the timer to expire its period from now.
+.  RETURN: true for success, false for an invalid timer
+.--------------------------------------------------------------------------*/
+bool xTimerStart (TimerHandle_t xTimer)
+{
+	if ((xTimer == 0) || (xTimer->inUse == 0)) return false;		// Invalid timer
+	struct TimerCoreBlock* tcb = &timerCB[xTimer->corenum];
+	RegType_t state = LockTimerList(tcb);							// Lock the core timer list
+	RegType_t now = xTaskGetCoreTickCount(xTimer->corenum);			// Expiry is checked against the owning core ticks
+	if (xTimer->active) RemoveTimer(tcb, xTimer);					// Restart so take off list
+	xTimer->expiry = now + xTimer->period;							// Expire one period from now
+	InsertTimer(tcb, xTimer, now);									// Put on list in order
+	UpdateNextExpiry(tcb);											// Publish new first expiry
+	UnlockTimerList(tcb, state);									// Release the core timer list
+	return true;
+}
+
+/*-[ xTimerStop ]-----------------------------------------------------------}
+.  Stops the timer so it will not expire.
+.  RETURN: true for success, false for an invalid timer
+.--------------------------------------------------------------------------*/
+bool xTimerStop (TimerHandle_t xTimer)
+{
+	if ((xTimer == 0) || (xTimer->inUse == 0)) return false;		// Invalid timer
+	struct TimerCoreBlock* tcb = &timerCB[xTimer->corenum];
+	RegType_t state = LockTimerList(tcb);							// Lock the core timer list
+	if (xTimer->active) RemoveTimer(tcb, xTimer);					// Take off list
+	UpdateNextExpiry(tcb);											// Publish new first expiry
+	UnlockTimerList(tcb, state);									// Release the core timer list
+	return true;
+}
+
+/*-[ xTimerChangePeriod ]---------------------------------------------------}
+.  Changes the timer period and starts the timer with the new period.
+.  RETURN: true for success, false for an invalid timer or period
+.--------------------------------------------------------------------------*/
+bool xTimerChangePeriod (TimerHandle_t xTimer, RegType_t xNewPeriodInTicks)
+{
+	if ((xTimer == 0) || (xTimer->inUse == 0) || (xNewPeriodInTicks == 0))
+		return false;												// Invalid timer or period
+	xTimer->period = xNewPeriodInTicks;								// Hold the new period
+	return xTimerStart(xTimer);										// Start with the new period
+}
+
+/*-[ xTimerIsTimerActive ]--------------------------------------------------}
+.  RETURN: true if the timer is started and has not expired (one shot)
+.--------------------------------------------------------------------------*/
+bool xTimerIsTimerActive (TimerHandle_t xTimer)
+{
+	return (xTimer && xTimer->inUse && xTimer->active);
+}
+
+/*-[ pvTimerGetTimerID ]----------------------------------------------------}
+.  RETURN: The private identifier given when the timer was created
+.--------------------------------------------------------------------------*/
+void* pvTimerGetTimerID (TimerHandle_t xTimer)
+{
+	return (xTimer) ? xTimer->id : 0;
+}
+
+/*-[ xTimerTickCheck ]------------------------------------------------------}
+.  Called by the kernel timer tick on each core. When the first timer on the
+.  core timer list is due it defers the expiry to the core work queue.
+.--------------------------------------------------------------------------*/
+void xTimerTickCheck (RegType_t xTickCount)
+{
+	RegType_t state = TimerMaskInterrupts();						// Stay on this core while checking it
+	unsigned int corenum = xTaskGetCoreID();						// Core read masked once for list and queue
+	struct TimerCoreBlock* tcb = &timerCB[corenum];
+	if (__atomic_load_n(&tcb->armed, __ATOMIC_ACQUIRE)				// Core has a timer running
+		&& TICK_REACHED(xTickCount, tcb->nextExpiry))				// and the first one is due
+	{
+		tcb->armed = 0;												// Only defer once, expiry republishes
+		if (!xWorkQueueDefer(corenum, TimerExpire, tcb))			// Worker runs the batch
+			__atomic_store_n(&tcb->armed, 1, __ATOMIC_RELEASE);		// Queue full so retry next tick
+	}
+	TimerRestoreInterrupts(state);									// Restore interrupt state
+}
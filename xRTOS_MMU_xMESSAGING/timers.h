@@ -0,0 +1,65 @@
+#ifndef _TIMERS_H
+#define _TIMERS_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stdbool.h>							// Needed for bool
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+#include "rpi-SmartStart.h"						// Needed for RegType_t
+
+typedef struct xTimer* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t) (TimerHandle_t xTimer);
+
+/*-[ xTimerCreate ]---------------------------------------------------------}
+.  Creates a software timer whose callback will run from the work queue
+.  worker task of the given core. The work queue for a core is created with
+.  its first timer so this must be called before xTaskStartScheduler.
+.  The timer is created dormant, use xTimerStart.
+.  RETURN: The timer handle, NULL if no timer is available
+.--------------------------------------------------------------------------*/
+TimerHandle_t xTimerCreate (uint8_t corenum,						// The core number the callback runs on
+							RegType_t xPeriodInTicks,				// Timer period in ticks (non zero)
+							bool xAutoReload,						// True = periodic, false = one shot
+							void* pvTimerID,						// Private identifier for the callback
+							TimerCallbackFunction_t pxCallbackFunction);// The callback function
+
+/*-[ xTimerStart ]----------------------------------------------------------}
+.  Starts, or restarts, the timer to expire its period from now.
+.  RETURN: true for success, false for an invalid timer
+.--------------------------------------------------------------------------*/
+bool xTimerStart (TimerHandle_t xTimer);
+
+/*-[ xTimerStop ]-----------------------------------------------------------}
+.  Stops the timer so it will not expire.
+.  RETURN: true for success, false for an invalid timer
+.--------------------------------------------------------------------------*/
+bool xTimerStop (TimerHandle_t xTimer);
+
+/*-[ xTimerChangePeriod ]---------------------------------------------------}
+.  Changes the timer period and starts the timer with the new period.
+.  RETURN: true for success, false for an invalid timer or period
+.--------------------------------------------------------------------------*/
+bool xTimerChangePeriod (TimerHandle_t xTimer, RegType_t xNewPeriodInTicks);
+
+/*-[ xTimerIsTimerActive ]--------------------------------------------------}
+.  RETURN: true if the timer is started and has not expired (one shot)
+.--------------------------------------------------------------------------*/
+bool xTimerIsTimerActive (TimerHandle_t xTimer);
+
+/*-[ pvTimerGetTimerID ]----------------------------------------------------}
+.  RETURN: The private identifier given when the timer was created
+.--------------------------------------------------------------------------*/
+void* pvTimerGetTimerID (TimerHandle_t xTimer);
+
+/*-[ xTimerTickCheck ]------------------------------------------------------}
+.  Called by the kernel timer tick on each core. When the first timer on the
+.  core timer list is due it defers the expiry to the core work queue.
+.--------------------------------------------------------------------------*/
+void xTimerTickCheck (RegType_t xTickCount);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
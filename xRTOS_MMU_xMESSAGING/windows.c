@@ -22,12 +22,16 @@
 {																			}
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
+{  1.01 Double buffered console with PiConsole_Present added				}
+{  1.02 Damage rectangles so PiConsole_Present copies only what changed	}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 #include <stdbool.h>			// C standard unit needed for bool and true/false
 #include <stdint.h>				// C standard unit needed for uint8_t, uint32_t, etc
 #include "rpi-smartstart.h"
 #include "Font8x16.h"			// Provides the 8x16 bitmap font for console 
+#include "slab.h"				// Slab cache for created DCs
+#include "task.h"				// Scheduler state for the damage list lock
 #include "windows.h"			// This units header
 
 /*--------------------------------------------------------------------------}
@@ -68,6 +72,10 @@ static struct __attribute__((__packed__, aligned(4))) {
 	uint32_t ht;													// Screen height (of frame buffer)
 	uint32_t depth;													// Colour depth (of frame buffer)
 	uint32_t pitch;													// Pitch (Line to line offset)
+	uintptr_t fbBuffer[2];											// Both buffer addresses when double buffered
+	uint32_t backBuffer;											// Index of the buffer fb is drawing to
+	bool doubleBuffer;												// Virtual height is twice the screen so fb is the back buffer
+	bool vsync;														// Firmware answers the wait for vsync tag
 	/* Function pointers that are set to graphics primitives depending on colour depth */
 	void (*ClearArea) (struct tagINTDC* dc, uint_fast32_t x1, uint_fast32_t y1, uint_fast32_t x2, uint_fast32_t y2);
 	void (*VertLine) (struct tagINTDC* dc, uint_fast32_t cy, int_fast8_t dir);
@@ -81,11 +89,329 @@ static struct __attribute__((__packed__, aligned(4))) {
 #define MAX_EXT_DC 10
 static unsigned int extDCcount = 0;
 static INTDC extDC[MAX_EXT_DC] = { 0 };
+static SlabCache_t dcCache = SLAB_CACHE_INIT("DC", sizeof(INTDC));	// Cache for DCs from CreateCompatibleDC
 
 /***************************************************************************}
 {						  PRIVATE C ROUTINES 			                    }
 {***************************************************************************/
 
+/*--------------------------------------------------------------------------}
+{						  NEON SPAN FILL AND COPY							}
+{---------------------------------------------------------------------------}
+.  A clear or image put is a run of rows, each a span of bytes. The spans
+.  are written a byte at a time up to a 16 byte boundary, then with NEON
+.  stores of 64 bytes (48 for 24 bit colour so the pattern lines up), then
+.  16 bytes, then bytes for what is left. The context switch does not save
+.  the NEON registers so each span masks interrupts while it uses them.
+.--------------------------------------------------------------------------*/
+#define SPAN_PATTERN_SIZE	80										// 15 head bytes and a 64 byte block of pattern
+
+static inline RegType_t SpanMaskInterrupts (void)
+{
+	RegType_t state;
+#if __aarch64__ == 1
+	__asm volatile ("mrs %0, daif\n\tmsr daifset, #3" : "=r" (state) : : "memory");
+#else
+	__asm volatile ("mrs %0, cpsr\n\tcpsid if" : "=r" (state) : : "memory");
+#endif
+	return state;
+}
+
+static inline void SpanRestoreInterrupts (RegType_t state)
+{
+#if __aarch64__ == 1
+	__asm volatile ("msr daif, %0" : : "r" (state) : "memory");
+#else
+	__asm volatile ("msr cpsr_c, %0" : : "r" (state) : "memory");
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Sets pat to the colour repeated, so pat[i] is byte i of a pixel run		}
+{--------------------------------------------------------------------------*/
+static void SpanPattern (uint8_t* pat, const void* colour, unsigned int bytesPerPixel)
+{
+	const uint8_t* c = colour;
+	for (unsigned int i = 0; i < SPAN_PATTERN_SIZE; i++)
+		pat[i] = c[i % bytesPerPixel];
+}
+
+/*--------------------------------------------------------------------------}
+{	Writes blocks of block bytes then chunks of 16 bytes from pat to the	}
+{	16 byte aligned dst. The chunks follow on in the pattern, so chunk n	}
+{	is bytes 16n to 16n+15 of the block.									}
+{--------------------------------------------------------------------------*/
+static void SpanFillBlocks (uint8_t* dst, size_t blocks, size_t chunks, const uint8_t* pat, size_t block)
+{
+#if __aarch64__ == 1
+	#define SPAN_FILL_CHUNKS "2:\n\t"										\
+		"cbz %[chunks], 3f\n\t"												\
+		"st1 {v0.16b}, [%[dst]], #16\n\t"									\
+		"cmp %[chunks], #1\n\t"												\
+		"b.eq 3f\n\t"														\
+		"st1 {v1.16b}, [%[dst]], #16\n\t"									\
+		"cmp %[chunks], #2\n\t"												\
+		"b.eq 3f\n\t"														\
+		"st1 {v2.16b}, [%[dst]], #16\n"										\
+		"3:"
+	if (block == 48)
+		__asm volatile ("ld1 {v0.16b, v1.16b, v2.16b}, [%[pat]]\n\t"
+			"cbz %[blocks], 2f\n"
+			"1:\n\t"
+			"st1 {v0.16b, v1.16b, v2.16b}, [%[dst]], #48\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"b.ne 1b\n"
+			SPAN_FILL_CHUNKS
+			: [dst] "+r" (dst), [blocks] "+r" (blocks)
+			: [pat] "r" (pat), [chunks] "r" (chunks)
+			: "v0", "v1", "v2", "cc", "memory");
+		else __asm volatile ("ld1 {v0.16b, v1.16b, v2.16b, v3.16b}, [%[pat]]\n\t"
+			"cbz %[blocks], 2f\n"
+			"1:\n\t"
+			"st1 {v0.16b, v1.16b, v2.16b, v3.16b}, [%[dst]], #64\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"b.ne 1b\n"
+			SPAN_FILL_CHUNKS
+			: [dst] "+r" (dst), [blocks] "+r" (blocks)
+			: [pat] "r" (pat), [chunks] "r" (chunks)
+			: "v0", "v1", "v2", "v3", "cc", "memory");
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#define SPAN_FILL_CHUNKS "2:\n\t"										\
+		"cmp %[chunks], #0\n\t"												\
+		"beq 3f\n\t"														\
+		"vst1.8 {d0-d1}, [%[dst]:128]!\n\t"									\
+		"cmp %[chunks], #1\n\t"												\
+		"beq 3f\n\t"														\
+		"vst1.8 {d2-d3}, [%[dst]:128]!\n\t"									\
+		"cmp %[chunks], #2\n\t"												\
+		"beq 3f\n\t"														\
+		"vst1.8 {d4-d5}, [%[dst]:128]!\n"									\
+		"3:"
+	if (block == 48)
+		__asm volatile ("vld1.8 {d0-d3}, [%[pat]]!\n\t"
+			"vld1.8 {d4-d5}, [%[pat]]\n\t"
+			"cmp %[blocks], #0\n\t"
+			"beq 2f\n"
+			"1:\n\t"
+			"vst1.8 {d0-d3}, [%[dst]:128]!\n\t"
+			"vst1.8 {d4-d5}, [%[dst]:128]!\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"bne 1b\n"
+			SPAN_FILL_CHUNKS
+			: [dst] "+r" (dst), [blocks] "+r" (blocks), [pat] "+r" (pat)
+			: [chunks] "r" (chunks)
+			: "d0", "d1", "d2", "d3", "d4", "d5", "cc", "memory");
+		else __asm volatile ("vld1.8 {d0-d3}, [%[pat]]!\n\t"
+			"vld1.8 {d4-d7}, [%[pat]]\n\t"
+			"cmp %[blocks], #0\n\t"
+			"beq 2f\n"
+			"1:\n\t"
+			"vst1.8 {d0-d3}, [%[dst]:128]!\n\t"
+			"vst1.8 {d4-d7}, [%[dst]:128]!\n\t"
+			"subs %[blocks], %[blocks], #1\n\t"
+			"bne 1b\n"
+			SPAN_FILL_CHUNKS
+			: [dst] "+r" (dst), [blocks] "+r" (blocks), [pat] "+r" (pat)
+			: [chunks] "r" (chunks)
+			: "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
+#else
+	for (size_t i = 0; i < blocks * block + chunks * 16; i++)
+		dst[i] = pat[i % block];									// No NEON so a byte at a time
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Copies blocks of 64 bytes then chunks of 16 bytes from src to the 16	}
+{	byte aligned dst. The source may have any alignment.					}
+{--------------------------------------------------------------------------*/
+static void SpanCopyBlocks (uint8_t* dst, const uint8_t* src, size_t blocks, size_t chunks)
+{
+#if __aarch64__ == 1
+	__asm volatile ("cbz %[blocks], 2f\n"
+		"1:\n\t"
+		"ld1 {v0.16b, v1.16b, v2.16b, v3.16b}, [%[src]], #64\n\t"
+		"st1 {v0.16b, v1.16b, v2.16b, v3.16b}, [%[dst]], #64\n\t"
+		"subs %[blocks], %[blocks], #1\n\t"
+		"b.ne 1b\n"
+		"2:\n\t"
+		"cbz %[chunks], 4f\n"
+		"3:\n\t"
+		"ld1 {v0.16b}, [%[src]], #16\n\t"
+		"st1 {v0.16b}, [%[dst]], #16\n\t"
+		"subs %[chunks], %[chunks], #1\n\t"
+		"b.ne 3b\n"
+		"4:"
+		: [dst] "+r" (dst), [src] "+r" (src), [blocks] "+r" (blocks), [chunks] "+r" (chunks)
+		:
+		: "v0", "v1", "v2", "v3", "cc", "memory");
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	__asm volatile ("cmp %[blocks], #0\n\t"
+		"beq 2f\n"
+		"1:\n\t"
+		"vld1.8 {d0-d3}, [%[src]]!\n\t"
+		"vld1.8 {d4-d7}, [%[src]]!\n\t"
+		"vst1.8 {d0-d3}, [%[dst]:128]!\n\t"
+		"vst1.8 {d4-d7}, [%[dst]:128]!\n\t"
+		"subs %[blocks], %[blocks], #1\n\t"
+		"bne 1b\n"
+		"2:\n\t"
+		"cmp %[chunks], #0\n\t"
+		"beq 4f\n"
+		"3:\n\t"
+		"vld1.8 {d0-d1}, [%[src]]!\n\t"
+		"vst1.8 {d0-d1}, [%[dst]:128]!\n\t"
+		"subs %[chunks], %[chunks], #1\n\t"
+		"bne 3b\n"
+		"4:"
+		: [dst] "+r" (dst), [src] "+r" (src), [blocks] "+r" (blocks), [chunks] "+r" (chunks)
+		:
+		: "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
+#else
+	for (size_t i = 0; i < blocks * 64 + chunks * 16; i++)
+		dst[i] = src[i];											// No NEON so a byte at a time
+#endif
+}
+
+/*--------------------------------------------------------------------------}
+{	Fills bytes at dst with the pattern from SpanPattern, the span starting	}
+{	on a pixel. block is 48 for 24 bit colour and 64 otherwise.				}
+{--------------------------------------------------------------------------*/
+static void SpanFill (uint8_t* dst, size_t bytes, const uint8_t* pat, size_t block)
+{
+	size_t head = (0 - (uintptr_t)dst) & 15;						// Bytes up to a 16 byte boundary
+	if (head > bytes) head = bytes;
+	for (size_t i = 0; i < head; i++) dst[i] = pat[i];
+	dst += head;
+	pat += head;													// Pattern follows on from the head
+	bytes -= head;
+	size_t blocks = bytes / block;
+	size_t chunks = (bytes % block) / 16;
+	if (blocks | chunks)
+	{
+		RegType_t state = SpanMaskInterrupts();						// NEON registers are not saved on a switch
+		SpanFillBlocks(dst, blocks, chunks, pat, block);
+		SpanRestoreInterrupts(state);
+		dst += blocks * block + chunks * 16;
+		bytes -= blocks * block + chunks * 16;
+		pat += chunks * 16;											// Blocks are whole pattern repeats
+	}
+	for (size_t i = 0; i < bytes; i++) dst[i] = pat[i];				// Tail under 16 bytes
+}
+
+/*--------------------------------------------------------------------------}
+{				Copies bytes from src to dst as a span						}
+{--------------------------------------------------------------------------*/
+static void SpanCopy (uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+	size_t head = (0 - (uintptr_t)dst) & 15;						// Bytes up to a 16 byte boundary
+	if (head > bytes) head = bytes;
+	for (size_t i = 0; i < head; i++) dst[i] = src[i];
+	dst += head;
+	src += head;
+	bytes -= head;
+	size_t blocks = bytes / 64;
+	size_t chunks = (bytes % 64) / 16;
+	if (blocks | chunks)
+	{
+		RegType_t state = SpanMaskInterrupts();						// NEON registers are not saved on a switch
+		SpanCopyBlocks(dst, src, blocks, chunks);
+		SpanRestoreInterrupts(state);
+		dst += blocks * 64 + chunks * 16;
+		src += blocks * 64 + chunks * 16;
+		bytes -= blocks * 64 + chunks * 16;
+	}
+	for (size_t i = 0; i < bytes; i++) dst[i] = src[i];				// Tail under 16 bytes
+}
+
+/*--------------------------------------------------------------------------}
+{							DAMAGE RECTANGLES								}
+{---------------------------------------------------------------------------}
+.  On a double buffered console every draw adds the screen area it wrote
+.  to the damage list of the frame. A rectangle that overlaps or touches
+.  one already held is merged with it and the result checked again against
+.  the rest, so a line of text written a character at a time ends up as
+.  one rectangle. With the list full a new one is merged into the held one
+.  it grows least. PiConsole_Present copies only these to the new back
+.  buffer. Drawing tasks on other cores may add at the same time, so the
+.  list has a spin lock once the scheduler runs, held with interrupts off.
+.--------------------------------------------------------------------------*/
+#define DAMAGE_MAX_RECTS	16										// Rectangles held before merging is forced
+
+typedef struct {
+	uint32_t left;													// Left x, included
+	uint32_t top;													// Top y, included
+	uint32_t right;													// Right x, not included
+	uint32_t bottom;												// Bottom y, not included
+} DAMAGERECT;
+
+static struct {
+	uint32_t lock;													// Spin lock, 0 is free
+	uint32_t count;													// Rectangles in the list
+	DAMAGERECT rect[DAMAGE_MAX_RECTS];								// Damage of the frame being drawn
+} damage = { 0 };
+
+static RegType_t DamageLock (void)
+{
+	RegType_t state = SpanMaskInterrupts();							// No switch away while holding the lock
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)			// Exclusives need the MMU on
+		while (__atomic_exchange_n(&damage.lock, 1, __ATOMIC_ACQUIRE) != 0) {};
+	return state;
+}
+
+static void DamageUnlock (RegType_t state)
+{
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		__atomic_store_n(&damage.lock, 0, __ATOMIC_RELEASE);
+	SpanRestoreInterrupts(state);
+}
+
+static void DamageAdd (int_fast32_t x1, int_fast32_t y1, int_fast32_t x2, int_fast32_t y2)
+{
+	if (!WINAPI_CB.doubleBuffer) return;							// Drawing is already on screen
+	DAMAGERECT r;
+	r.left = (x1 < 0) ? 0 : x1;										// Clip the area to the screen
+	r.top = (y1 < 0) ? 0 : y1;
+	r.right = (x2 > (int_fast32_t)WINAPI_CB.wth) ? WINAPI_CB.wth : ((x2 < 0) ? 0 : x2);
+	r.bottom = (y2 > (int_fast32_t)WINAPI_CB.ht) ? WINAPI_CB.ht : ((y2 < 0) ? 0 : y2);
+	if ((r.right <= r.left) || (r.bottom <= r.top)) return;			// Nothing on screen
+	RegType_t state = DamageLock();
+	uint32_t i = 0;
+	while (i < damage.count) {
+		DAMAGERECT* d = &damage.rect[i];
+		if ((r.left <= d->right) && (d->left <= r.right) &&
+			(r.top <= d->bottom) && (d->top <= r.bottom)) {			// Overlaps or touches
+			if (d->left < r.left) r.left = d->left;					// Take it into the new one
+			if (d->top < r.top) r.top = d->top;
+			if (d->right > r.right) r.right = d->right;
+			if (d->bottom > r.bottom) r.bottom = d->bottom;
+			*d = damage.rect[--damage.count];						// Last one fills its slot
+			i = 0;													// Grown so check them all again
+		}
+		else i++;
+	}
+	if (damage.count < DAMAGE_MAX_RECTS) damage.rect[damage.count++] = r;
+	else {
+		uint32_t best = 0;
+		uint64_t bestGrowth = UINT64_MAX;
+		for (i = 0; i < DAMAGE_MAX_RECTS; i++) {					// Find the one the union grows least
+			DAMAGERECT* d = &damage.rect[i];
+			uint64_t w = ((d->right > r.right) ? d->right : r.right) - ((d->left < r.left) ? d->left : r.left);
+			uint64_t h = ((d->bottom > r.bottom) ? d->bottom : r.bottom) - ((d->top < r.top) ? d->top : r.top);
+			uint64_t growth = w * h - (uint64_t)(d->right - d->left) * (d->bottom - d->top);
+			if (growth < bestGrowth) {
+				bestGrowth = growth;
+				best = i;
+			}
+		}
+		DAMAGERECT* d = &damage.rect[best];
+		if (r.left < d->left) d->left = r.left;						// Merge into it, overlap left with others only costs a copy
+		if (r.top < d->top) d->top = r.top;
+		if (r.right > d->right) d->right = r.right;
+		if (r.bottom > d->bottom) d->bottom = r.bottom;
+	}
+	DamageUnlock(state);
+}
+
 /*--------------------------------------------------------------------------}
 {					   16 BIT COLOUR GRAPHICS ROUTINES						}
 {--------------------------------------------------------------------------*/
@@ -96,12 +422,12 @@ static INTDC extDC[MAX_EXT_DC] = { 0 };
 . As an internal function pairs assumed to be correctly ordered and dc valid.
 .--------------------------------------------------------------------------*/
 static void ClearArea16(INTDC* dc, uint_fast32_t x1, uint_fast32_t y1, uint_fast32_t x2, uint_fast32_t y2) {
-	RGB565* __attribute__((__packed__, aligned(2))) video_wr_ptr = (RGB565*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 2) + (x1 * 2));
+	uint8_t pat[SPAN_PATTERN_SIZE];
+	SpanPattern(&pat[0], &dc->BrushColor565, 2);					// Brush colour as a byte pattern
+	uint8_t* video_wr_ptr = (uint8_t*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 2) + (x1 * 2));
 	for (uint_fast32_t y = 0; y < (y2 - y1); y++) {					// For each y line
-		for (uint_fast32_t x = 0; x < (x2 - x1); x++) {				// For each x between x1 and x2
-			video_wr_ptr[x] = dc->BrushColor565;					// Write the colour
-		}
-		video_wr_ptr += WINAPI_CB.pitch;							// Offset to next line
+		SpanFill(video_wr_ptr, (x2 - x1) * 2, &pat[0], 64);			// Fill from x1 up to x2
+		video_wr_ptr += WINAPI_CB.pitch * 2;						// Offset to next line
 	}
 }
 
@@ -207,9 +533,7 @@ static void PutImage16(INTDC * dc, uint_fast32_t dx, uint_fast32_t dy, uint_fast
 	HIMAGE video_wr_ptr;
 	video_wr_ptr.ptrRGB565 = (RGB565*)(uintptr_t)(WINAPI_CB.fb + (dc->curPos.y * WINAPI_CB.pitch * 2) + (dc->curPos.x * 2));
 	for (uint_fast32_t y = 0; y < dy; y++) {						// For each line
-		for (uint_fast32_t x = 0; x < dx; x++) {					// For each pixel
-			video_wr_ptr.ptrRGB565[x] = ImageSrc.ptrRGB565[x];		// Transfer pixel
-		}
+		SpanCopy(video_wr_ptr.rawImage, ImageSrc.rawImage, dx * 2);	// Transfer the line
 		if (BottomUp) video_wr_ptr.ptrRGB565 -= WINAPI_CB.pitch;	// Next line up
 			else video_wr_ptr.ptrRGB565 += WINAPI_CB.pitch;			// Next line down
 		ImageSrc.rawImage += p2wth;									// Adjust image pointer by power 2 width
@@ -226,12 +550,12 @@ static void PutImage16(INTDC * dc, uint_fast32_t dx, uint_fast32_t dy, uint_fast
 . As an internal function pairs assumed to be correctly ordered and dc valid.
 .--------------------------------------------------------------------------*/
 static void ClearArea24(INTDC * dc, uint_fast32_t x1, uint_fast32_t y1, uint_fast32_t x2, uint_fast32_t y2) {
-	RGB* __attribute__((aligned(1))) video_wr_ptr = (RGB*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 3) + (x1 * 3));
+	uint8_t pat[SPAN_PATTERN_SIZE];
+	SpanPattern(&pat[0], &dc->BrushColor.rgb, 3);					// Brush colour as a byte pattern
+	uint8_t* video_wr_ptr = (uint8_t*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 3) + (x1 * 3));
 	for (uint_fast32_t y = 0; y < (y2 - y1); y++) {					// For each y line
-		for (uint_fast32_t x = 0; x < (x2 - x1); x++) {				// For each x between x1 and x2
-			video_wr_ptr[x] = dc->BrushColor.rgb;					// Write the colour
-		}
-		video_wr_ptr += WINAPI_CB.pitch;							// Offset to next line
+		SpanFill(video_wr_ptr, (x2 - x1) * 3, &pat[0], 48);			// Fill from x1 up to x2, 48 bytes is 16 pixels
+		video_wr_ptr += WINAPI_CB.pitch * 3;						// Offset to next line
 	}
 }
 
@@ -337,9 +661,7 @@ static void PutImage24(INTDC * dc, uint_fast32_t dx, uint_fast32_t dy, uint_fast
 	HIMAGE video_wr_ptr;
 	video_wr_ptr.ptrRGB = (RGB*)(uintptr_t)(WINAPI_CB.fb + (dc->curPos.y * WINAPI_CB.pitch * 3) + (dc->curPos.x * 3));
 	for (uint_fast32_t y = 0; y < dy; y++) {						// For each line
-		for (uint_fast32_t x = 0; x < dx; x++) {					// For each pixel
-			video_wr_ptr.ptrRGB[x] = ImageSrc.ptrRGB[x];			// Transfer pixel
-		}
+		SpanCopy(video_wr_ptr.rawImage, ImageSrc.rawImage, dx * 3);	// Transfer the line
 		if (BottomUp) video_wr_ptr.ptrRGB -= WINAPI_CB.pitch;		// Next line up
 			else video_wr_ptr.ptrRGB += WINAPI_CB.pitch;			// Next line down
 		ImageSrc.rawImage += p2wth;									// Adjust image pointer by power 2 width
@@ -356,12 +678,12 @@ static void PutImage24(INTDC * dc, uint_fast32_t dx, uint_fast32_t dy, uint_fast
 . As an internal function pairs assumed to be correctly ordered and dc valid.
 .--------------------------------------------------------------------------*/
 static void ClearArea32(INTDC * dc, uint_fast32_t x1, uint_fast32_t y1, uint_fast32_t x2, uint_fast32_t y2) {
-	RGBA* __attribute__((aligned(4))) video_wr_ptr = (RGBA*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 4) + (y1 * 4));
+	uint8_t pat[SPAN_PATTERN_SIZE];
+	SpanPattern(&pat[0], &dc->BrushColor, 4);						// Brush colour as a byte pattern
+	uint8_t* video_wr_ptr = (uint8_t*)(uintptr_t)(WINAPI_CB.fb + (y1 * WINAPI_CB.pitch * 4) + (x1 * 4));
 	for (uint_fast32_t y = 0; y < (y2 - y1); y++) {					// For each y line
-		for (uint_fast32_t x = 0; x < (x2 - x1); x++) {				// For each x between x1 and x2
-			video_wr_ptr[x] = dc->BrushColor;						// Write the current brush colour
-		}
-		video_wr_ptr += WINAPI_CB.pitch;							// Next line down
+		SpanFill(video_wr_ptr, (x2 - x1) * 4, &pat[0], 64);			// Fill from x1 up to x2
+		video_wr_ptr += WINAPI_CB.pitch * 4;						// Next line down
 	}
 }
 
@@ -467,9 +789,7 @@ static void PutImage32(INTDC * dc, uint_fast32_t dx, uint_fast32_t dy, uint_fast
 	HIMAGE video_wr_ptr;
 	video_wr_ptr.ptrRGBA = (RGBA*)(uintptr_t)(WINAPI_CB.fb + (dc->curPos.y * WINAPI_CB.pitch * 4) + (dc->curPos.x * 4));
 	for (uint_fast32_t y = 0; y < dy; y++) {						// For each line
-		for (uint_fast32_t x = 0; x < dx; x++) {					// For each pixel
-			video_wr_ptr.ptrRGBA[x] = ImageSrc.ptrRGBA[x];			// Transfer pixel
-		}
+		SpanCopy(video_wr_ptr.rawImage, ImageSrc.rawImage, dx * 4);	// Transfer the line
 		if (BottomUp) video_wr_ptr.ptrRGBA -= WINAPI_CB.pitch;		// Next line up
 			else video_wr_ptr.ptrRGBA += WINAPI_CB.pitch;			// Next line down
 		ImageSrc.rawImage += p2wth;									// Adjust image pointer by power 2 width
@@ -612,6 +932,9 @@ BOOL LineTo (HDC hdc,												// Handle to the DC (0 means use standard conso
 		if (dx == 0) WINAPI_CB.VertLine(intDC, dy, ydir);			// Zero dx means vertical line
 			else if (dy == 0) WINAPI_CB.HorzLine(intDC, dx, xdir);	// Zero dy means horizontal line
 			else WINAPI_CB.DiagLine(intDC, dx, dy, xdir, ydir);		// Anything else is a diagonal line
+		DamageAdd((xdir < 0) ? nXEnd : intDC->curPos.x, (ydir < 0) ? nYEnd : intDC->curPos.y,
+			((xdir < 0) ? intDC->curPos.x : nXEnd) + 1,
+			((ydir < 0) ? intDC->curPos.y : nYEnd) + 1);			// Box around the line
 		intDC->curPos.x = nXEnd;									// Update x position
 		intDC->curPos.y = nYEnd;									// Update y position
 		return TRUE;												// Function successfully completed
@@ -666,6 +989,7 @@ BOOL Rectangle (HDC hdc,											// Handle to the DC (0 means use standard con
 			WINAPI_CB.ClearArea(intDC, nLeftRect, nTopRect, nRightRect,
 				nBottomRect);										// Call clear area function
 		}
+		DamageAdd(nLeftRect, nTopRect, nRightRect, nBottomRect);	// Fill and outline both inside the rectangle
 		return TRUE;												// Return success
 	}
 	return FALSE;													// Return fail as one or both coords pairs were inverted 
@@ -692,6 +1016,7 @@ BOOL TextOut (HDC hdc,												// Handle to the DC (0 means use standard cons
 			else WINAPI_CB.WriteChar(intDC, lpString[i]);			// Write the character in fore/back colours
 			intDC->curPos.x += BitFontWth;							// Move X position
 		}
+		DamageAdd(nXStart, nYStart, intDC->curPos.x, nYStart + BitFontHt);
 		return TRUE;												// Return success
 	}
 	return FALSE;													// Return failure as string or count zero or no frame buffer
@@ -715,6 +1040,21 @@ bool PiConsole_Init (int Width,										// Screen width request (Use 0 if you w
 					 int Height,									// Screen height request (Use 0 if you wish autodetect height)
 					 int Depth,										// Screen colour depth request (Use 0 if you wish autodetect colour depth) 
 					 int(*prn_handler) (const char* fmt, ...))		// Print handler to display setting result on if successful
+{
+	return PiConsole_InitEx(Width, Height, Depth, false, prn_handler);// Single buffered console
+}
+
+/*-[PiConsole_InitEx]-------------------------------------------------------}
+. As PiConsole_Init but with DoubleBuffer set it asks for a virtual height
+. of twice the screen. All drawing then goes to the half not on screen and
+. PiConsole_Present flips it on to the screen. If the firmware will not give
+. the virtual height the console is single buffered as PiConsole_Init.
+.--------------------------------------------------------------------------*/
+bool PiConsole_InitEx (int Width,									// Screen width request (Use 0 if you wish autodetect width)
+					   int Height,									// Screen height request (Use 0 if you wish autodetect height)
+					   int Depth,									// Screen colour depth request (Use 0 if you wish autodetect colour depth)
+					   bool DoubleBuffer,							// Draw to a back buffer shown by PiConsole_Present
+					   int(*prn_handler) (const char* fmt, ...))	// Print handler to display setting result on if successful
 {
 	uint32_t buffer[23];
 	if ((Width == 0) || (Height == 0)) {							// Has auto width or height been requested
@@ -733,13 +1073,24 @@ bool PiConsole_Init (int Width,										// Screen width request (Use 0 if you w
 	}
 	if (!mailbox_tag_message(&buffer[0], 23,
 		MAILBOX_TAG_SET_PHYSICAL_WIDTH_HEIGHT, 8, 8, Width, Height,
-		MAILBOX_TAG_SET_VIRTUAL_WIDTH_HEIGHT, 8, 8, Width, Height,
+		MAILBOX_TAG_SET_VIRTUAL_WIDTH_HEIGHT, 8, 8, Width, (DoubleBuffer) ? Height * 2 : Height,
 		MAILBOX_TAG_SET_COLOUR_DEPTH, 4, 4, Depth,
 		MAILBOX_TAG_ALLOCATE_FRAMEBUFFER, 8, 4, 16, 0,
 		MAILBOX_TAG_GET_PITCH, 4, 0, 0))							// Attempt to set the requested settings
 		return false;												// The requesting settings failed so return the failure
 	WINAPI_CB.fb = GPUaddrToARMaddr(buffer[17]);					// Transfer the frame buffer
 	WINAPI_CB.pitch = buffer[22];									// Transfer the line pitch
+	WINAPI_CB.doubleBuffer = DoubleBuffer && (buffer[9] >= Height * 2);// Firmware gave the virtual height for two buffers
+	WINAPI_CB.vsync = WINAPI_CB.doubleBuffer;						// Until the firmware shows it has no vsync tag
+	WINAPI_CB.fbBuffer[0] = WINAPI_CB.fb;							// First buffer is on screen at offset 0
+	WINAPI_CB.fbBuffer[1] = WINAPI_CB.fb + Height * buffer[22];		// Second buffer follows it
+	WINAPI_CB.backBuffer = 0;
+	if (WINAPI_CB.doubleBuffer) {
+		WINAPI_CB.backBuffer = 1;									// Draw to the second buffer
+		WINAPI_CB.fb = WINAPI_CB.fbBuffer[1];
+		damage.count = 1;											// Whole screen so the first present makes the buffers match
+		damage.rect[0] = (DAMAGERECT) { 0, 0, Width, Height };
+	}
 	WINAPI_CB.wth = Width;											// Transfer the screen width
 	WINAPI_CB.ht = Height;											// Transfer the screen height
 	WINAPI_CB.depth = Depth;										// Transfer the screen depth
@@ -789,6 +1140,54 @@ bool PiConsole_Init (int Width,										// Screen width request (Use 0 if you w
 	return true;													// Return successful
 }
 
+/*-[PiConsole_Present]------------------------------------------------------}
+. Shows the back buffer on a double buffered console by moving the virtual
+. offset on to it with the SET_VIRTUAL_OFFSET tag. Where the firmware has
+. the wait for vsync tag it is sent in the same message, so the old front
+. buffer is no longer scanned out when this returns. The old front then
+. has only the areas drawn since the last present copied from the new one,
+. which the draw calls keep as a list of damage rectangles. No draw
+. may run while this does, so call it from the drawing task or under the
+. lock the drawing tasks share. It is called from a task, which is fine
+. as the tag message goes through the static 1:1 mapped mailbox buffer.
+. RETURN: TRUE if flipped, FALSE if not double buffered or mailbox failed
+.--------------------------------------------------------------------------*/
+BOOL PiConsole_Present (void)
+{
+	uint32_t buffer[9];
+	if (!WINAPI_CB.doubleBuffer) return FALSE;						// Drawing is already on screen
+	uint32_t showY = WINAPI_CB.backBuffer * WINAPI_CB.ht;			// Virtual row the back buffer starts on
+	if (WINAPI_CB.vsync) {
+		if (!mailbox_tag_message(&buffer[0], 9,
+			MAILBOX_TAG_SET_VIRTUAL_OFFSET, 8, 8, 0, showY,
+			MAILBOX_TAG_WAIT_FOR_VSYNC, 4, 4, 0)) return FALSE;		// Flip and wait for the vsync in one message
+		if ((buffer[7] & 0x80000000) == 0) WINAPI_CB.vsync = false;	// No response bit so firmware has no vsync tag
+	}
+	else if (!mailbox_tag_message(&buffer[0], 5,
+		MAILBOX_TAG_SET_VIRTUAL_OFFSET, 8, 8, 0, showY)) return FALSE;// Flip only
+	if ((buffer[2] & 0x80000000) == 0) return FALSE;				// Offset not answered so the buffers were not flipped
+	uint8_t* front = (uint8_t*)WINAPI_CB.fbBuffer[WINAPI_CB.backBuffer];
+	WINAPI_CB.backBuffer ^= 1;										// Old front is the new back
+	WINAPI_CB.fb = WINAPI_CB.fbBuffer[WINAPI_CB.backBuffer];
+	uint32_t bpp = WINAPI_CB.depth / 8;
+	uint32_t bytePitch = WINAPI_CB.pitch * bpp;
+	DAMAGERECT rect[DAMAGE_MAX_RECTS];
+	RegType_t state = DamageLock();
+	uint32_t count = damage.count;
+	for (uint32_t i = 0; i < count; i++)
+		rect[i] = damage.rect[i];									// Snapshot the damage
+	damage.count = 0;												// Next frame starts undamaged
+	DamageUnlock(state);											// Copy runs with interrupts enabled
+	for (uint32_t i = 0; i < count; i++) {							// The buffers only differ in the damage
+		DAMAGERECT* d = &rect[i];
+		uint32_t offset = d->top * bytePitch + d->left * bpp;
+		for (uint32_t y = d->top; y < d->bottom; y++, offset += bytePitch)
+			SpanCopy((uint8_t*)WINAPI_CB.fb + offset, front + offset,
+				(d->right - d->left) * bpp);						// Back buffer catches up with the screen
+	}
+	return TRUE;
+}
+
 
 /*-[GetConsole_FrameBuffer]-------------------------------------------------}
 . Simply returns the console frame buffer. If PiConsole_Init has not yet been
@@ -877,6 +1276,8 @@ void WriteText(char* lpString) {
 			extDC[0].curPos.x = extDC[0].cursor.x * BitFontWth;
 			extDC[0].curPos.y = extDC[0].cursor.y * BitFontHt;
 			WINAPI_CB.WriteChar(&extDC[0], *lpString);				// Write the character to graphics screen
+			DamageAdd(extDC[0].curPos.x, extDC[0].curPos.y,
+				extDC[0].curPos.x + BitFontWth, extDC[0].curPos.y + BitFontHt);
 			extDC[0].cursor.x++;									// Cursor.x forward one character
 		}
 				 break;
@@ -987,6 +1388,7 @@ HGDIOBJ SelectObject (HDC hdc,									// Handle to the DC (0 means use standard
 					(h.bitmap->bmBottomUp) ? intDC->curPos.y-- : intDC->curPos.y++;
 				}
 			}
+			DamageAdd(0, 0, h.bitmap->bmWidth, h.bitmap->bmHeight + 1);// Image is put at the DC origin
 			intDC->bmp = h.bitmap;								// Hold the bitmap pointer
 		}
 		}
@@ -997,25 +1399,30 @@ HGDIOBJ SelectObject (HDC hdc,									// Handle to the DC (0 means use standard
 /*==========================================================================}
 {								DC ROUTINES									}
 {==========================================================================*/
-HDC CreateExternalDC (int num)
+static void CopyDC (INTDC* dc, INTDC* src)
 {
-	if (num < MAX_EXT_DC) {
-		if (extDC[num].usedDC == 0)
-		{
-			extDC[num].curPos = extDC[0].curPos;
-			extDC[num].cursor = extDC[0].cursor;
+	dc->curPos = src->curPos;
+	dc->cursor = src->cursor;
+
+	dc->TxtColor = src->TxtColor;
+	dc->BkColor = src->BkColor;
+	dc->BrushColor = src->BrushColor;
 
-			extDC[num].TxtColor = extDC[0].TxtColor;
-			extDC[num].BkColor = extDC[0].BkColor;
-			extDC[num].BrushColor = extDC[0].BrushColor;
+	dc->TxtColor565 = src->TxtColor565;
+	dc->BkColor565 = src->BkColor565;
+	dc->BrushColor565 = src->BrushColor565;
 
-			extDC[num].TxtColor565 = extDC[0].TxtColor565;
-			extDC[num].BkColor565 = extDC[0].BkColor565;
-			extDC[num].BrushColor565 = extDC[0].BrushColor565;
+	dc->BkGndTransparent = src->BkGndTransparent;
 
-			extDC[num].BkGndTransparent = extDC[0].BkGndTransparent;
+	dc->usedDC = 1;
+}
 
-			extDC[num].usedDC = 1;
+HDC CreateExternalDC (int num)
+{
+	if (num < MAX_EXT_DC) {
+		if (extDC[num].usedDC == 0)
+		{
+			CopyDC(&extDC[num], &extDC[0]);
 			extDCcount++;
 		}
 		return((HDC)& extDC[num]);
@@ -1023,6 +1430,35 @@ HDC CreateExternalDC (int num)
 	return 0;
 }
 
+/*-[CreateCompatibleDC]-----------------------------------------------------}
+. Matches WIN32 API, Creates a DC with the same settings as the given DC.
+. There is no limit on the number of DCs, and each DC sits on its own cache
+. line so tasks on different cores drawing with their own DC never share.
+. RETURN: The new DC handle, 0 if no memory was available
+.--------------------------------------------------------------------------*/
+HDC CreateCompatibleDC (HDC hdc)									// Handle to the DC to copy (0 means use standard console DC)
+{
+	INTDC* src = (hdc == 0) ? &extDC[0] : (INTDC*)hdc;				// If hdc is zero then we want extDC[0] otherwise convert handle
+	INTDC* dc = pvSlabAlloc(&dcCache);								// Cleared DC from the cache
+	if (dc == 0) return 0;
+	CopyDC(dc, src);
+	return (HDC)dc;
+}
+
+/*-[DeleteDC]---------------------------------------------------------------}
+. Matches WIN32 API, Deletes a DC created by CreateCompatibleDC.
+. RETURN: TRUE for success, FALSE if not a DC from CreateCompatibleDC
+.--------------------------------------------------------------------------*/
+BOOL DeleteDC (HDC hdc)												// Handle to the DC to delete
+{
+	INTDC* dc = (INTDC*)hdc;
+	if ((dc == 0) || ((dc >= &extDC[0]) && (dc < &extDC[MAX_EXT_DC])) || (dc->usedDC == 0))
+		return FALSE;												// Not a created DC
+	dc->usedDC = 0;
+	vSlabFree(&dcCache, dc);										// Back to the cache
+	return TRUE;
+}
+
 
 /*==========================================================================}
 {						SCREEN RESOLUTION API								}
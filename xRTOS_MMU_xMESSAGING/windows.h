@@ -29,6 +29,8 @@ extern "C" {									// Put extern C directive wrapper around
 {																			}
 {++++++++++++++++++++++++[ REVISIONS ]++++++++++++++++++++++++++++++++++++++}
 {  1.00 Initial version														}
+{  1.01 Double buffered console with PiConsole_Present added				}
+{  1.02 Damage rectangles so PiConsole_Present copies only what changed	}
 {++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 
 /* System font is 8 wide and 16 height so these are preset for the moment */
@@ -253,6 +255,31 @@ bool PiConsole_Init(int Width,										// Screen width request (Use 0 if you wi
 	int Depth,										// Screen colour depth request (Use 0 if you wish autodetect colour depth) 
 	int(*prn_handler) (const char* fmt, ...));		// Print handler to display setting result on if successful
 
+/*-[PiConsole_InitEx]-------------------------------------------------------}
+. As PiConsole_Init but with DoubleBuffer set it asks for a virtual height
+. of twice the screen. All drawing then goes to the half not on screen and
+. PiConsole_Present flips it on to the screen. If the firmware will not give
+. the virtual height the console is single buffered as PiConsole_Init.
+.--------------------------------------------------------------------------*/
+bool PiConsole_InitEx (int Width,									// Screen width request (Use 0 if you wish autodetect width)
+					   int Height,									// Screen height request (Use 0 if you wish autodetect height)
+					   int Depth,									// Screen colour depth request (Use 0 if you wish autodetect colour depth)
+					   bool DoubleBuffer,							// Draw to a back buffer shown by PiConsole_Present
+					   int(*prn_handler) (const char* fmt, ...));	// Print handler to display setting result on if successful
+
+/*-[PiConsole_Present]------------------------------------------------------}
+. Shows the back buffer on a double buffered console by moving the virtual
+. offset on to it with the SET_VIRTUAL_OFFSET tag. Where the firmware has
+. the wait for vsync tag it is sent in the same message, so the old front
+. buffer is no longer scanned out when this returns. The old front then
+. has only the areas drawn since the last present copied from the new one,
+. which the draw calls keep as a list of damage rectangles. No draw
+. may run while this does, so call it from the drawing task or under the
+. lock the drawing tasks share.
+. RETURN: TRUE if flipped, FALSE if not double buffered or mailbox failed
+.--------------------------------------------------------------------------*/
+BOOL PiConsole_Present (void);
+
 /*-[GetConsole_FrameBuffer]-------------------------------------------------}
 . Simply returns the console frame buffer. If PiConsole_Init has not yet been
 . called it will return 0, which sort of forms an error check value.
@@ -321,6 +348,20 @@ HGDIOBJ SelectObject(HDC hdc,										// Handle to the DC (0 means use standard
 {==========================================================================*/
 HDC CreateExternalDC (int num);
 
+/*-[CreateCompatibleDC]-----------------------------------------------------}
+. Matches WIN32 API, Creates a DC with the same settings as the given DC.
+. There is no limit on the number of DCs, and each DC sits on its own cache
+. line so tasks on different cores drawing with their own DC never share.
+. RETURN: The new DC handle, 0 if no memory was available
+.--------------------------------------------------------------------------*/
+HDC CreateCompatibleDC (HDC hdc);									// Handle to the DC to copy (0 means use standard console DC)
+
+/*-[DeleteDC]---------------------------------------------------------------}
+. Matches WIN32 API, Deletes a DC created by CreateCompatibleDC.
+. RETURN: TRUE for success, FALSE if not a DC from CreateCompatibleDC
+.--------------------------------------------------------------------------*/
+BOOL DeleteDC (HDC hdc);											// Handle to the DC to delete
+
 
 /*==========================================================================}
 {						SCREEN RESOLUTION API								}
@@ -0,0 +1,148 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "rpi-SmartStart.h"
+#include "xRTOS.h"
+#include "task.h"
+#include "workqueue.h"
+
+/* The name allocated to the deferred work task */
+#ifndef configWORK_TASK_NAME
+	#define configWORK_TASK_NAME "WORK"
+#endif
+
+#if (configWORK_QUEUE_LENGTH & (configWORK_QUEUE_LENGTH - 1)) != 0
+	#error configWORK_QUEUE_LENGTH must be a power of 2
+#endif
+
+#define WORK_QUEUE_MASK		(configWORK_QUEUE_LENGTH - 1)
+
+/*--------------------------------------------------------------------------}
+{						WORK QUEUE STRUCTURE DEFINED						}
+{---------------------------------------------------------------------------}
+.  Each core has a bounded ring of work cells. Any number of producers on
+.  any core claim a cell with a single compare and swap on enqueuePos and
+.  publish it by advancing the cell sequence, so no lock is ever taken and
+.  an interrupt can queue work while a task on the same core is doing so.
+.  The core worker task is the only consumer.
+.--------------------------------------------------------------------------*/
+struct WorkCell
+{
+	volatile uint32_t sequence;									/*< Cell is free when sequence == position, full when position + 1 */
+	WorkFunction_t function;									/*< Work function */
+	void* arg;													/*< Argument for work function */
+};
+
+static struct WorkQueue
+{
+	struct WorkCell cells[configWORK_QUEUE_LENGTH];				/*< The ring of work cells */
+	volatile uint32_t enqueuePos __attribute__((aligned(64)));	/*< Next position producers claim, own cache line */
+	uint32_t dequeuePos __attribute__((aligned(64)));			/*< Next position the worker takes, own cache line */
+	volatile uint32_t dropCount;								/*< Work refused because queue was full */
+	TaskHandle_t worker;										/*< Core worker task */
+} workQueue[MAX_CPU_CORES] PER_CPU = { 0 };
+
+/*--------------------------------------------------------------------------}
+{	Takes the next work item from the queue, only the worker calls this		}
+{--------------------------------------------------------------------------*/
+static bool WorkDequeue (struct WorkQueue* wq, WorkFunction_t* function, void** arg)
+{
+	struct WorkCell* cell = &wq->cells[wq->dequeuePos & WORK_QUEUE_MASK];
+	if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != wq->dequeuePos + 1)
+		return false;												// Cell not published yet so queue is empty
+	*function = cell->function;										// Take the work
+	*arg = cell->arg;
+	__atomic_store_n(&cell->sequence, wq->dequeuePos + configWORK_QUEUE_LENGTH,
+		__ATOMIC_RELEASE);											// Cell free for producers on next lap
+	wq->dequeuePos++;												// Next position
+	return true;
+}
+
+/*--------------------------------------------------------------------------}
+{	The kernel worker task, one per core. It runs all queued work then		}
+{	waits for a notification that more work has been queued.				}
+{--------------------------------------------------------------------------*/
+static void prvWorkTask (void* pvParameters)
+{
+	struct WorkQueue* wq = pvParameters;
+	WorkFunction_t function;
+	void* arg;
+	for (;;)
+	{
+		while (WorkDequeue(wq, &function, &arg))					// Run all the queued work
+			function(arg);
+		xTaskNotifyWait(0, 0xFFFFFFFF);								// Wait for more work
+	}
+}
+
+/***************************************************************************}
+{					    PUBLIC INTERFACE ROUTINES						    }
+****************************************************************************/
+
+/*-[ xWorkQueueCreate ]-----------------------------------------------------}
+.  Creates the deferred work queue and its kernel worker task on the given
+.  core. Must be called before xTaskStartScheduler for each core that is
+.  to have work deferred to it.
+.  RETURN: true for success, false for invalid core or no task available
+.--------------------------------------------------------------------------*/
+bool xWorkQueueCreate (uint8_t corenum)
+{
+	if (corenum >= MAX_CPU_CORES) return false;						// Invalid core
+	struct WorkQueue* wq = &workQueue[corenum];
+	if (wq->worker) return true;									// Already created
+	for (uint32_t i = 0; i < configWORK_QUEUE_LENGTH; i++)
+		wq->cells[i].sequence = i;									// Each cell free for its first lap
+	wq->enqueuePos = 0;
+	wq->dequeuePos = 0;
+	wq->dropCount = 0;
+	xTaskCreate(corenum, prvWorkTask, configWORK_TASK_NAME,
+		configWORK_TASK_STACK_SIZE, wq,
+		configWORK_TASK_PRIORITY, &wq->worker);						// Create core worker task
+	return (wq->worker != 0);
+}
+
+/*-[ xWorkQueueDefer ]------------------------------------------------------}
+.  Queues the function and argument to be run by the worker task of the
+.  given core. The queue is lock free so this may be called from an IRQ or
+.  FIQ handler, or from any task, on any core and it never blocks.
+.  RETURN: true if queued, false if the queue is full or not created
+.--------------------------------------------------------------------------*/
+bool xWorkQueueDefer (uint8_t corenum,								// The core to run the work on
+					  WorkFunction_t pxFunction,					// The work function
+					  void* pvArg)									// Argument passed to the work function
+{
+	if ((corenum >= MAX_CPU_CORES) || (pxFunction == 0)) return false;// Invalid core or function
+	struct WorkQueue* wq = &workQueue[corenum];
+	if (wq->worker == 0) return false;								// Queue not created
+	struct WorkCell* cell;
+	uint32_t pos = __atomic_load_n(&wq->enqueuePos, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		cell = &wq->cells[pos & WORK_QUEUE_MASK];
+		int32_t dif = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0)												// Cell is free for this position
+		{
+			if (__atomic_compare_exchange_n(&wq->enqueuePos, &pos, pos + 1,
+				true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))			// Claim it
+				break;
+		}
+		else if (dif < 0)											// Worker has not freed cell so queue is full
+		{
+			__atomic_fetch_add(&wq->dropCount, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+		else pos = __atomic_load_n(&wq->enqueuePos, __ATOMIC_RELAXED);// Another producer got in, try again
+	}
+	cell->function = pxFunction;									// Fill the claimed cell
+	cell->arg = pvArg;
+	__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);	// Publish it to the worker
+	xTaskNotify(wq->worker, 1, eSetBits);							// Wake the worker
+	return true;
+}
+
+/*-[ xWorkQueueGetDropCount ]-----------------------------------------------}
+.  RETURN: Number of work items refused on the core queue because it was full
+.--------------------------------------------------------------------------*/
+uint32_t xWorkQueueGetDropCount (uint8_t corenum)
+{
+	return (corenum < MAX_CPU_CORES) ? workQueue[corenum].dropCount : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#ifdef __cplusplus								// If we are including to a C++
+extern "C" {									// Put extern C directive wrapper around
+#endif
+#include <stdbool.h>							// Needed for bool
+#include <stdint.h>								// Needed for uint8_t, uint32_t, etc
+
+typedef void (*WorkFunction_t) (void* pvArg);
+
+/*-[ xWorkQueueCreate ]-----------------------------------------------------}
+.  Creates the deferred work queue and its kernel worker task on the given
+.  core. Must be called before xTaskStartScheduler for each core that is
+.  to have work deferred to it.
+.  RETURN: true for success, false for invalid core or no task available
+.--------------------------------------------------------------------------*/
+bool xWorkQueueCreate (uint8_t corenum);
+
+/*-[ xWorkQueueDefer ]------------------------------------------------------}
+.  Queues the function and argument to be run by the worker task of the
+.  given core. The queue is lock free so this may be called from an IRQ or
+.  FIQ handler, or from any task, on any core and it never blocks.
+.  RETURN: true if queued, false if the queue is full or not created
+.--------------------------------------------------------------------------*/
+bool xWorkQueueDefer (uint8_t corenum,								// The core to run the work on
+					  WorkFunction_t pxFunction,					// The work function
+					  void* pvArg);									// Argument passed to the work function
+
+/*-[ xWorkQueueGetDropCount ]-----------------------------------------------}
+.  RETURN: Number of work items refused on the core queue because it was full
+.--------------------------------------------------------------------------*/
+uint32_t xWorkQueueGetDropCount (uint8_t corenum);
+
+#ifdef __cplusplus								// If we are including to a C++ file
+}												// Close the extern C directive wrapper
+#endif
+
+#endif
@@ -2,12 +2,36 @@
 #define xRTOS_CONFIG_H
 
 #define MAX_CPU_CORES							( 4	)				// The Raspberry Pi3 has 4 cores	
-#define MAX_TASKS_PER_CORE						( 8 )				// For the moment task storage is static so we need some size
+#define PER_CPU_LINE							( 64 )				// Per core data is padded to whole cache lines of this size
+#define PER_CPU		__attribute__((section(".percpu"), aligned(PER_CPU_LINE)))	// Places a per core data array in the linker .percpu section
 #define configTICK_RATE_HZ						( 1000 )			// Timer tick frequency	
 #define tskIDLE_PRIORITY						( 0	)				// Idle priority is 0 .. rarely would this ever change	
 #define configMAX_TASK_NAME_LEN					( 16 )				// Maxium length of a task name
 #define configMINIMAL_STACK_SIZE				( 128 )				// Minimum stack size used by idle task
 
+#define configSCHEDULER_ROUNDROBIN				( 0 )				// Round robin on the ready tasks each timer tick
+#define configSCHEDULER_CYCLIC					( 1 )				// Time triggered cyclic executive dispatched from a static schedule table
+#define configSCHEDULER_MODE					( configSCHEDULER_ROUNDROBIN )	// Scheduler mode in use on all cores
+#define configMAX_SCHEDULE_SLOTS				( 16 )				// Maximum minor frame slots in a cyclic executive schedule table
+#define configMAX_EVENT_GROUPS					( 16 )				// For the moment event group storage is static so we need some size
+#define configMAX_TIMERS						( 32 )				// For the moment software timer storage is static so we need some size
+#define configUSE_GOVERNOR						( 1 )				// Run the load and temperature driven ARM clock governor
+#define configGOVERNOR_PERIOD					( configTICK_RATE_HZ )	// Ticks between governor decisions, matches the load analysis frame
+#define configGOVERNOR_LOAD_UP					( 80 )				// Busiest core load percent at or above which the clock goes to max
+#define configGOVERNOR_LOAD_DOWN				( 30 )				// Busiest core load percent at or below which the clock steps down
+#define configGOVERNOR_DOWN_PERIODS				( 3 )				// Periods the load must stay low before each step down
+#define configGOVERNOR_STEP_HZ					( 100000000 )		// ARM clock step size in Hz
+#define configGOVERNOR_TEMP_LIMIT				( 75000 )			// SoC temperature (1/1000 C) to back off at, below firmware throttle
+#define configGOVERNOR_TEMP_HYSTERESIS			( 5000 )			// SoC temperature drop (1/1000 C) before the thermal cap is lifted
+#define configUSE_THERMAL_PLACEMENT				( 1 )				// Governor packs best effort tasks onto one core when hot
+#define configPLACEMENT_TEMP_LIMIT				( 70000 )			// SoC temperature (1/1000 C) to pack best effort tasks at
+#define configPLACEMENT_CORE					( 0 )				// Core the best effort tasks are packed on to
+#define configWORK_QUEUE_LENGTH					( 32 )				// Deferred work items per core queue, must be a power of 2
+#define configWORK_TASK_PRIORITY				( 7 )				// Deferred work task priority, above user tasks so a defer preempts them
+#define configWORK_TASK_STACK_SIZE				( 256 )				// Stack size of the deferred work task on each core
+#define configSLAB_MAGAZINE_SIZE				( 16 )				// Free objects each core holds in its magazine for each slab cache
+#define configSLAB_OBJECTS_PER_SLAB				( 16 )				// Objects taken from the heap each time a slab cache grows
+
 
 #endif 
 